@@ -80,6 +80,7 @@ CUUGUCCUAAGGAGACCAUGCAACCGGAUUAACAGUUCAAUGCCGGACAUUUGGUUUCUAGCUCUGGACAAGAAG
 
 #include "tr-decoy-experiment.hh"
 #include "decoy-contact-folder.hh"
+#include "folder-factory.hh"
 
 int main( int ac, char **av)
 {
@@ -92,11 +93,39 @@ int main( int ac, char **av)
 	// seed the random number generator
 	Random::seed(p.random_seed);
 
+	// starting sequences, also the one that calibrates the translation error rate,
+	// are drawn from the sequence bank, if there is one
+	SequenceBank::setDefaultFile( p.sequence_bank );
+
 	// initialize the protein folder
-	ifstream fin((p.contact_map_dir+string("maps.txt")).c_str());
-	DecoyContactFolder folder(p.protein_length, p.log_nconf, fin, p.contact_map_dir);
+	// a directory name ends in "/"; anything else is a file of packed contact maps.
+	// a directory without maps.txt is read in full, sorted by filename.
+	FolderFactory factory;
+	factory.setNumThreads( p.num_threads );
+	auto_ptr<DecoyContactFolder> folder;
+	ContactMapLoadTimes load_times;
+	if ( !p.contact_map_dir.empty() && p.contact_map_dir[p.contact_map_dir.size()-1] == '/' ) {
+		ifstream fin((p.contact_map_dir+string("maps.txt")).c_str());
+		if ( fin.good() ) {
+			folder.reset( factory.createDecoyFolder(p.protein_length, p.log_nconf, fin, p.contact_map_dir, 0., -1, 0.6, p.shared_table, p.fold_backend) );
+			load_times = folder->getLoadTimes();
+		}
+		else {
+			vector<DecoyContactStructure*> structs;
+			ContactMapUtil::readContactMapsFromDirectory(p.contact_map_dir, structs, p.num_threads, &load_times);
+			folder.reset( factory.createDecoyFolder(p.protein_length, p.log_nconf, structs, 0., -1, 0.6, p.fold_backend) );
+			load_times.build = folder->getLoadTimes().build;
+		}
+	}
+	else {
+		folder.reset( factory.createDecoyFolder(p.protein_length, p.log_nconf, p.contact_map_dir, 0., -1, 0.6, p.fold_backend) );
+		load_times = folder->getLoadTimes();
+	}
 
 	cout << p;
+	cout << "# Decoys: " << folder->getNumStructures() << endl;
+	cout << "# Load times (s): enumerate " << load_times.enumerate << ", parse " << load_times.parse << ", build " << load_times.build << endl;
+	cout << "# Selected fold backend: " << folder->getBackend() << endl;
 	// Create Polymerase based on input parameter p.mutation_rate
 	double GCtoAT = 69.;
 	double ATtoGC = 41.;
@@ -109,11 +138,11 @@ int main( int ac, char **av)
 	// Choose the FitnessEvaluator based on input parameters (p.eval_type).
 	ErrorproneTranslation* fe = NULL;
 	if (p.eval_type == "tr") {
-		ErrorproneTranslation* ept = new ErrorproneTranslation( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, p.target_fraction_accurate );
+		ErrorproneTranslation* ept = new ErrorproneTranslation( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, p.target_fraction_accurate );
 		fe = ept;
 	}
 	else if (p.eval_type == "nu") {
-		FoldingOnlyFitness* fof = new FoldingOnlyFitness( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, p.target_fraction_accurate );
+		FoldingOnlyFitness* fof = new FoldingOnlyFitness( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, p.target_fraction_accurate );
 		fe = fof;
 	}
 	if (!fe) {
@@ -121,6 +150,9 @@ int main( int ac, char **av)
 		exit(1);
 	}
 
+	// the offspring of a generation are evaluated on the same threads as the decoys
+	fe->setBatchThreads( p.num_threads );
+
 	cout << setprecision(4);
 	evolutionExperiment( p, *fe, poly);
 	//evolutionTest( p, *fe, poly);
@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "tools.hh"
 #include "gene-util.hh"
 #include "folder-util.hh"
+#include "sequence-bank.hh"
 #include "mutator.hh"
 
 #include <cmath>
@@ -55,13 +56,17 @@ public:
 	int N;
 	mutable int structure_ID;
 	string run_id;
+	string shared_table; ///< name of the shared structure table, or empty
+	string fold_backend; ///< name of the fold backend, or "auto" for the default one
+	unsigned int num_threads; ///< number of threads that evaluate decoys and offspring
+	string sequence_bank; ///< file of pre-designed starting sequences, or empty
 	bool valid;
 
 	Parameters( int ac, char **av ) {
 		if ( ac < 17 )	{
 			valid = false;
 			cout << "Start program like this:" << endl;
-			cout << "\t" << av[0] << " <eval type> <prot length> <contact map dir> <log10 num confs> <pop size> <log10 tr cost> <ca cost> <target facc> <structure id> <free energy cutoff> <free energy minimum> <mutation rate> <window time> <equilibration time> <repetitions> <random seed> <run ID>" << endl;
+			cout << "\t" << av[0] << " <eval type> <prot length> <contact map dir/ or packed maps> <log10 num confs> <pop size> <log10 tr cost> <ca cost> <target facc> <structure id> <free energy cutoff> <free energy minimum> <mutation rate> <window time> <equilibration time> <repetitions> <random seed> [<run ID> [<shared table> [<fold backend> [<threads> [<sequence bank>]]]]]" << endl;
 			return;
 		}
 
@@ -83,12 +88,36 @@ public:
 		equilibration_time = atoi( av[i++] );
 		repetitions = atoi( av[i++] );
 		random_seed = atoi( av[i++] );
-		if (ac==18){
+		if (ac>=18){
 			run_id = av[i++];
 		}
 		else{
 			run_id = itoa(random_seed, 10);
 		}
+		if (ac>=19){
+			shared_table = av[i++];
+			// "-" means no shared table
+			if (shared_table == "-")
+				shared_table = "";
+		}
+		if (ac>=20){
+			fold_backend = av[i++];
+		}
+		else{
+			fold_backend = "auto";
+		}
+		if (ac>=21){
+			num_threads = atoi( av[i++] );
+		}
+		else{
+			num_threads = 1;
+		}
+		if (ac>=22){
+			sequence_bank = av[i++];
+			// "-" means no sequence bank
+			if (sequence_bank == "-")
+				sequence_bank = "";
+		}
 
 		valid = true;
 	}
@@ -80,6 +80,7 @@ CUUGUCCUAAGGAGACCAUGCAACCGGAUUAACAGUUCAAUGCCGGACAUUUGGUUUCUAGCUCUGGACAAGAAG
 
 #include "translation-experiment.hh"
 #include "compact-lattice-folder.hh"
+#include "folder-factory.hh"
 
 int main( int ac, char **av)
 {
@@ -95,9 +96,13 @@ int main( int ac, char **av)
 	// initialize the protein folder
 	int side_length = (int)(sqrt(float(p.protein_length)));
 	assert(side_length*side_length == p.protein_length);
-	CompactLatticeFolder folder(side_length);
+	// starting sequences are drawn from the sequence bank, if there is one
+	SequenceBank::setDefaultFile( p.sequence_bank );
+	FolderFactory factory;
+	auto_ptr<CompactLatticeFolder> folder( factory.createLatticeFolder(side_length, 0, -1, 0.6, p.shared_table, p.fold_backend) );
 
 	cout << p;
+	cout << "# Selected fold backend: " << folder->getBackend() << endl;
 	// Create Polymerase based on input parameter p.mutation_rate
 	double GCtoAT = 69.;
 	double ATtoGC = 41.;
@@ -109,27 +114,27 @@ int main( int ac, char **av)
 	Polymerase poly(p.u);
 
 	// Get error rates
-	Gene seed_gene = FolderUtil::getSequenceForStructure(folder, 3*p.protein_length, p.free_energy_cutoff, p.structure_ID);
-	ErrorproneTranslation ept_temp(&folder, seed_gene.codonLength(), p.structure_ID, p.free_energy_cutoff, 1, p.ca_cost, 0.1, 0.1, 0.1 );
+	Gene seed_gene = SequenceBank::getSequenceForStructure(*folder, 3*p.protein_length, p.free_energy_cutoff, p.structure_ID);
+	ErrorproneTranslation ept_temp(folder.get(), seed_gene.codonLength(), p.structure_ID, p.free_energy_cutoff, 1, p.ca_cost, 0.1, 0.1, 0.1 );
 	double error_rate, accuracy_weight, error_weight;
 	ept_temp.getWeightsForTargetAccuracy(seed_gene, p.target_trans_accuracy, error_rate, accuracy_weight, error_weight, 2000, 2000);
 
 	// Choose the FitnessEvaluator based on input parameters (p.eval_type).
 	ErrorproneTranslation* fe = NULL;
 	if (p.eval_type == "tr") {
-		ErrorproneTranslation* ept = new ErrorproneTranslation( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
+		ErrorproneTranslation* ept = new ErrorproneTranslation( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
 		fe = ept;
 	}
 	else if (p.eval_type == "acc") {
-		AccuracyOnlyTranslation* afe = new AccuracyOnlyTranslation( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
+		AccuracyOnlyTranslation* afe = new AccuracyOnlyTranslation( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
 		fe = afe;
 	}
 	else if (p.eval_type == "rob") {
-		RobustnessOnlyTranslation* rob = new RobustnessOnlyTranslation( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
+		RobustnessOnlyTranslation* rob = new RobustnessOnlyTranslation( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
 		fe = rob;
 	}
 	else if (p.eval_type == "nu") {
-		FoldingOnlyFitness* fof = new FoldingOnlyFitness( &folder, p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
+		FoldingOnlyFitness* fof = new FoldingOnlyFitness( folder.get(), p.protein_length, p.structure_ID, p.free_energy_cutoff, p.tr_cost, p.ca_cost, error_rate, accuracy_weight, error_weight );
 		fe = fof;
 	}
 	if (!fe) {
@@ -41,6 +41,11 @@ ostream & operator<<( ostream &s, const Parameters &p )
 	s << "#   repetitions: " << p.repetitions << endl;
 	s << "#   random seed: " << p.random_seed << endl;
 	s << "#   run ID: " << p.run_id << endl;
+	if ( !p.shared_table.empty() )
+		s << "#   shared structure table: " << p.shared_table << endl;
+	s << "#   fold backend: " << p.fold_backend << endl;
+	if ( !p.sequence_bank.empty() )
+		s << "#   sequence bank: " << p.sequence_bank << endl;
 	s << "#" << endl;
 	return s;
 }
@@ -127,7 +132,7 @@ bool runAndAnalyzeReplica( ErrorproneTranslation *fe, Polymerase *poly, const Pa
 
 	Folder& folder = *(fe->getFolder());
 	// Find a sequence.
-	CodingDNA g = FolderUtil::getSequenceForStructure(folder, p.protein_length*3, p.free_energy_cutoff, p.structure_ID);
+	CodingDNA g = SequenceBank::getSequenceForStructure(folder, p.protein_length*3, p.free_energy_cutoff, p.structure_ID);
 	s << "# Starting genotype: " << g << endl;
 	// Fill the population with the genotype that we found above
 	pop.init( g, fe, poly );
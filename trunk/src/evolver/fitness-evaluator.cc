@@ -25,17 +25,103 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "translator.hh"
 #include "gene-util.hh"
 #include "folder-util.hh"
+#include "sequence-bank.hh"
 #include "tools.hh"
+#include "random.hh"
+#include "thread-pool.hh"
 
 #include <cmath>
 #include <iomanip>
 #include <memory>
 
 FitnessEvaluator::FitnessEvaluator()
+	: m_batch_pool( 0 ), m_epoch( 0 )
 {}
 
 FitnessEvaluator::~FitnessEvaluator()
-{}
+{
+	delete m_batch_pool;
+}
+
+void FitnessEvaluator::setBatchThreads( unsigned int num_threads )
+{
+	delete m_batch_pool;
+	m_batch_pool = 0;
+	if ( num_threads > 1 )
+		m_batch_pool = new ThreadPool( num_threads );
+}
+
+void FitnessEvaluator::getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness )
+{
+	for ( unsigned int i=0; i<genes.size(); i++ )
+		fitness[i] = getFitness( *genes[i] );
+}
+
+
+/**
+ * Evaluates the genes of a batch for getFitnessBatch(). Each item is a group of genes
+ * that are evaluated one after another, in the same thread.
+ */
+class FitnessBatchTask : public ThreadTask {
+private:
+	FitnessEvaluator& m_evaluator;
+	const vector<const CodingDNA*>& m_genes;
+	const vector<vector<unsigned int> >& m_groups;
+	double* m_fitness;
+
+public:
+	FitnessBatchTask( FitnessEvaluator& evaluator, const vector<const CodingDNA*>& genes, const vector<vector<unsigned int> >& groups, double* fitness )
+		: m_evaluator( evaluator ), m_genes( genes ), m_groups( groups ), m_fitness( fitness ) {}
+
+	void run( unsigned int item ) {
+		const vector<unsigned int>& group = m_groups[item];
+		for ( unsigned int k=0; k<group.size(); k++ )
+			m_fitness[group[k]] = m_evaluator.getFitness( *m_genes[group[k]] );
+	}
+};
+
+/**
+ * Evaluates a batch of genes with getFitness(), each distinct one only once. If by_protein
+ * is true, the fitness of a full-length gene depends only on its protein, and each
+ * distinct protein is evaluated once. Otherwise, distinct genes that encode the same
+ * protein are evaluated in the same thread. The genes are evaluated on the threads of
+ * pool, or in the calling thread if pool is NULL.
+ */
+static void evaluateFitnessBatch( FitnessEvaluator& evaluator, const vector<const CodingDNA*>& genes, double* fitness, bool by_protein, ThreadPool* pool )
+{
+	// the first gene with the same result as gene i
+	vector<unsigned int> source( genes.size() );
+	map<string, unsigned int> first;
+	map<string, unsigned int> protein_group;
+	vector<vector<unsigned int> > groups;
+	for ( unsigned int i=0; i<genes.size(); i++ ) {
+		const CodingDNA& g = *genes[i];
+		string protein = g.encodesFullLength() ? "p" + string( g.translate() ) : "";
+		string key = ( by_protein && !protein.empty() ) ? protein : "g" + string( g );
+		pair<map<string, unsigned int>::iterator, bool> res = first.insert( make_pair( key, i ) );
+		source[i] = res.first->second;
+		if ( !res.second )
+			continue;
+		if ( protein.empty() || by_protein ) {
+			groups.push_back( vector<unsigned int>( 1, i ) );
+			continue;
+		}
+		pair<map<string, unsigned int>::iterator, bool> group = protein_group.insert( make_pair( protein, groups.size() ) );
+		if ( group.second )
+			groups.push_back( vector<unsigned int>() );
+		groups[group.first->second].push_back( i );
+	}
+
+	FitnessBatchTask task( evaluator, genes, groups, fitness );
+	if ( pool && groups.size() > 1 )
+		pool->run( task, groups.size() );
+	else {
+		for ( unsigned int k=0; k<groups.size(); k++ )
+			task.run( k );
+	}
+	for ( unsigned int i=0; i<genes.size(); i++ )
+		fitness[i] = fitness[source[i]];
+}
 
 ProteinFreeEnergyFitness::ProteinFreeEnergyFitness( Folder *protein_folder )
 	: m_protein_folder( protein_folder )
@@ -62,6 +148,10 @@ double ProteinFreeEnergyFitness::getFitness( const Protein &p ) {
 	return x/(1.0+x);
 }
 
+void ProteinFreeEnergyFitness::getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness ) {
+	evaluateFitnessBatch( *this, genes, fitness, true, m_batch_pool );
+}
+
 
 
 ProteinStructureFitness::ProteinStructureFitness( Folder *protein_folder, int protein_structure_ID, double max_free_energy )
@@ -93,14 +183,6 @@ double ProteinStructureFitness::getFitness( const Protein &p ) {
 	return 1;
 }
 
-struct greater_pair_first
-{
-	bool operator()(const pair<double, int>& p1, const pair<double, int>& p2)
-	{
-		return p1.first > p2.first;
-	}
-};
-
 ErrorproneTranslation::ErrorproneTranslation() {
 	m_protein_folder = NULL;
 	m_max_free_energy = 0.0;
@@ -110,9 +192,13 @@ ErrorproneTranslation::ErrorproneTranslation() {
 	m_protein_structure_ID = -1;
 	m_accuracy_weight = 1;
 	m_error_weight = 1;
+	m_outcome_memo_size = 1000;
+	m_outcome_memo_hits = 0;
+	pthread_mutex_init( &m_outcome_memo_mutex, 0 );
 }
 
-ErrorproneTranslation::ErrorproneTranslation(Folder *protein_folder, const int protein_length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double target_fraction_accurate )
+ErrorproneTranslation::ErrorproneTranslation(Folder *protein_folder, const int protein_length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double target_fraction_accurate,
+											 const unsigned int num_chains )
 {
 	m_protein_folder = protein_folder;
 	m_protein_length = protein_length;
@@ -121,19 +207,27 @@ ErrorproneTranslation::ErrorproneTranslation(Folder *protein_folder, const int p
 	m_tr_cost = tr_cost;
 	m_ca_cost = ca_cost;
 	m_protein_structure_ID = protein_structure_ID;
+	m_outcome_memo_size = 1000;
+	m_outcome_memo_hits = 0;
+	pthread_mutex_init( &m_outcome_memo_mutex, 0 );
 
 	// Build the weight matrices for translation.
 	buildWeightMatrix();
 	//cout << "Preparing to find seed gene" << endl;
-	// Get a seed genotype.
-	CodingDNA seed_gene = FolderUtil::getSequenceForStructure(*protein_folder, protein_length*3, max_free_energy, protein_structure_ID);
+	// Get a seed genotype, from the default sequence bank if there is one.
+	CodingDNA seed_gene = SequenceBank::getSequenceForStructure(*protein_folder, protein_length*3, max_free_energy, protein_structure_ID);
 	//cout << "Found seed gene: " << seed_gene << endl;
 	assert(seed_gene.encodesFullLength());
 	assert(seed_gene.translate().length() == protein_length);
 	assert(getFolded(seed_gene));
 	// Set weights.
 	double error_rate, error_weight, accuracy_weight;
-	getWeightsForTargetAccuracy(seed_gene, target_fraction_accurate, error_rate, accuracy_weight, error_weight, 1000, 1000);
+	if (num_chains > 1) {
+		getWeightsForTargetAccuracy(seed_gene, target_fraction_accurate, error_rate, accuracy_weight, error_weight, 1000, 1000, num_chains, num_chains, Random::rint());
+	}
+	else {
+		getWeightsForTargetAccuracy(seed_gene, target_fraction_accurate, error_rate, accuracy_weight, error_weight, 1000, 1000);
+	}
 	m_error_rate = error_rate;
 	m_error_weight = error_weight;
 	m_accuracy_weight = accuracy_weight;
@@ -150,84 +244,31 @@ ErrorproneTranslation::ErrorproneTranslation( Folder *protein_folder, const int
 	m_accuracy_weight = accuracy_weight;
 	m_error_weight = error_weight;
 	m_protein_structure_ID = protein_structure_ID;
+	m_outcome_memo_size = 1000;
+	m_outcome_memo_hits = 0;
+	pthread_mutex_init( &m_outcome_memo_mutex, 0 );
 
 	buildWeightMatrix();
 }
 
 void ErrorproneTranslation::buildWeightMatrix() {
-	// This weight matrix contains the probability that a given codon will be mistranslated as a given amino acid,
-	// including a stop (at pos 20).
-	//m_weight_matrix.resize( 64 );
-
-	//This weight matrix contains the sorted cumulative probability that
-	//a given codon will be mistranslated as a given amino acid, including a stop.
-	m_cum_weight_matrix.resize(64);
-
-	for (int c=0; c<64; c++)
-	{
-		//m_weight_matrix[c].resize( 21 ); // 20 aa's plus stop
-		m_cum_weight_matrix[c].resize(21, pair<double,int>(0.0,-2));
-	}
-	vector<vector<double> > codon_to_codon_probabilities(64);
-	for ( int c = 0; c<64; c++ )
-	{
-		codon_to_codon_probabilities[c].resize(64);
-		double total_weight = 0.0;
-		// now loop over all target codons
-		// compute normalization
-		for ( int tc = 0; tc<64; tc++ )
-		{
-			total_weight += calcWeight(c, tc);
-		}
-		// compute probabilities of transitions to each codon
-		for ( int tc = 0; tc<64; tc++ )
-		{
-			double w = calcWeight(c, tc);
-			codon_to_codon_probabilities[c][tc] = w/total_weight;
-		}
-	}
-	// Now compute the codon-to-aa probabilities
-	for ( int c=0; c<64; c++ ) {
-		for (int aa=0; aa<21; aa++)	{
-			if (aa<20) {
-				m_cum_weight_matrix[c][aa].second = GeneticCodeUtil::indexToAminoAcidLetter(aa);
-			}
-			else {
-				m_cum_weight_matrix[c][aa].second = GeneticCodeUtil::STOP;
-			}
-		}
-		for (int tc=0; tc<64; tc++)	{
-			Codon codon = GeneticCodeUtil::indexToCodon(tc);
-			char aa_char = GeneticCodeUtil::geneticCode(codon);
-			int aa = GeneticCodeUtil::aminoAcidLetterToIndex(aa_char);
-			if (aa < 0)	{
-				aa = 20;
-			}
-
-			//m_weight_matrix[c][aa] += codon_to_codon_probabilities[c][tc];
-			m_cum_weight_matrix[c][aa].first += codon_to_codon_probabilities[c][tc];
-		}
-		// Sort the weights in preparation for computing ordered cumulative probabilities
-		vector<pair<double,char> >& v = m_cum_weight_matrix[c];
-		sort(v.begin(), v.end(), greater_pair_first());
-		// Calculate the cumulative probabilities.
-		double tot = 0.0;
-		for (unsigned int i=0; i<m_cum_weight_matrix[c].size(); i++) {
-			pair<double, char>&p = m_cum_weight_matrix[c][i];
-			p.first += tot;
-			tot = p.first;
-		}
-	}
+	// the weights don't depend on the parameters of this object, so all objects share them
+	m_translation_weights = TranslationWeights::getShared();
 }
 
 ErrorproneTranslation::~ErrorproneTranslation()
 {
+	pthread_mutex_destroy( &m_outcome_memo_mutex );
 }
 
 
 bool ErrorproneTranslation::sequenceFolds(Protein& p)
 {
 	// test if residue sequence folds into correct structure and has correct free energy
+	ProteinFolder* folder = dynamic_cast<ProteinFolder*>( m_protein_folder );
+	if ( folder )
+		return folder->foldsInto( p, m_protein_structure_ID, m_max_free_energy );
+
 	auto_ptr<FoldInfo> fold_data( m_protein_folder->fold(p) );
 
 	if ( fold_data->getDeltaG() > m_max_free_energy )
@@ -239,43 +280,96 @@ bool ErrorproneTranslation::sequenceFolds(Protein& p)
 	return true;
 }
 
-
-double ErrorproneTranslation::calcWeight( int co, int ct )
+bool ErrorproneTranslation::mutantFolds(const ParentFoldState* parent, Protein& p, int site)
 {
-	if ( co == ct )
-		return 0;
+	ProteinFolder* folder = dynamic_cast<ProteinFolder*>( m_protein_folder );
+	if ( !parent || !folder )
+		return sequenceFolds(p);
+
+	auto_ptr<FoldInfo> fold_data( folder->foldMutant( parent, p, site ) );
+
+	if ( fold_data->getDeltaG() > m_max_free_energy )
+		return false;  // free energy above cutoff
+
+	if ( fold_data->getStructure() != m_protein_structure_ID )
+		return false; // sequence folds into the wrong structure
+
+	return true;
+}
 
-	double stop_factor = 1;
-	Codon from_codon = GeneticCodeUtil::indexToCodon(co);
-	Codon to_codon = GeneticCodeUtil::indexToCodon(ct);
-	if ( GeneticCodeUtil::geneticCode(to_codon) == GeneticCodeUtil::STOP ) // does target codon code for stop?
-		stop_factor = 0.33; // then probability is reduced to approx. one third.
-
-	int lo1, lo2, lo3;
-	int lt1, lt2, lt3;
-
-	if (from_codon.distance(to_codon) == 1) {
-		if (from_codon[0] != to_codon[0]) {
-			if ( GeneticCodeUtil::isTransition( from_codon[0], to_codon[0] ) )
-				return 1.*stop_factor;
-			else
-				return 0.5*stop_factor;
+void ErrorproneTranslation::siteMutantsFold(const ParentFoldState* parent, Protein& p, int site, const string& new_aas, vector<bool>& folds)
+{
+	folds.resize( new_aas.size() );
+	ProteinFolder* folder = dynamic_cast<ProteinFolder*>( m_protein_folder );
+	if ( !parent || !folder ) {
+		const char old_res = p[site];
+		for ( unsigned int k=0; k<new_aas.size(); k++ ) {
+			p[site] = new_aas[k];
+			folds[k] = mutantFolds( parent, p, site );
 		}
-		if (from_codon[1] != to_codon[1]) {
-			if ( GeneticCodeUtil::isTransition( from_codon[1], to_codon[1] ) )
-				return 0.5*stop_factor;
-			else
-				return 0.1*stop_factor;
+		p[site] = old_res;
+		return;
+	}
+
+	vector<FoldInfo*> fold_data;
+	folder->foldSiteMutants( parent, p, site, new_aas, fold_data );
+	for ( unsigned int k=0; k<new_aas.size(); k++ ) {
+		folds[k] = fold_data[k]->getDeltaG() <= m_max_free_energy && fold_data[k]->getStructure() == m_protein_structure_ID;
+		delete fold_data[k];
+	}
+}
+
+
+void ErrorproneTranslation::setOutcomeMemoSize( unsigned int size )
+{
+	pthread_mutex_lock( &m_outcome_memo_mutex );
+	m_outcome_memo_size = size;
+	while ( m_outcome_memo_order.size() > m_outcome_memo_size ) {
+		m_outcome_memo.erase( m_outcome_memo_order.front() );
+		m_outcome_memo_order.pop_front();
+	}
+	pthread_mutex_unlock( &m_outcome_memo_mutex );
+}
+
+void ErrorproneTranslation::clearOutcomeMemo()
+{
+	pthread_mutex_lock( &m_outcome_memo_mutex );
+	m_outcome_memo.clear();
+	m_outcome_memo_order.clear();
+	pthread_mutex_unlock( &m_outcome_memo_mutex );
+}
+
+unsigned long ErrorproneTranslation::getOutcomeMemoHits() const
+{
+	pthread_mutex_lock( &m_outcome_memo_mutex );
+	unsigned long hits = m_outcome_memo_hits;
+	pthread_mutex_unlock( &m_outcome_memo_mutex );
+	return hits;
+}
+
+shared_ptr<ErrorproneTranslation::OutcomeTable> ErrorproneTranslation::getOutcomeTable( const Protein& p )
+{
+	shared_ptr<OutcomeTable> table;
+	pthread_mutex_lock( &m_outcome_memo_mutex );
+	if ( m_outcome_memo_size > 0 ) {
+		shared_ptr<OutcomeTable>& entry = m_outcome_memo[p];
+		if ( entry ) {
+			m_outcome_memo_hits++;
 		}
-		if (from_codon[2] != to_codon[2]) {
-			if ( GeneticCodeUtil::isTransition( from_codon[2], to_codon[2] ) )
-				return 1.*stop_factor;
-			else
-				return 1.*stop_factor;
+		else {
+			entry.reset( new OutcomeTable );
+			entry->native_folds = -1;
+			entry->mutant_folds.resize( 20*p.length(), -1 );
+			m_outcome_memo_order.push_back( p );
+			if ( m_outcome_memo_order.size() > m_outcome_memo_size ) {
+				m_outcome_memo.erase( m_outcome_memo_order.front() );
+				m_outcome_memo_order.pop_front();
+			}
 		}
+		table = entry;
 	}
-
-	return 0;
+	pthread_mutex_unlock( &m_outcome_memo_mutex );
+	return table;
 }
 
 /**
@@ -302,6 +396,10 @@ double ErrorproneTranslation::getFitness( const Gene &g ) {
 	return fitness;
 }
 
+void ErrorproneTranslation::getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness ) {
+	evaluateFitnessBatch( *this, genes, fitness, false, m_batch_pool );
+}
+
 void ErrorproneTranslation::setTargetAccuracyOfRandomGenes(const Gene& seed_genotype, const double target_fraction_accurate, const int num_equil, const int num_rand) {
 	// sets m_error_weight and m_accuracy_weight
 	getWeightsForTargetAccuracy(seed_genotype, target_fraction_accurate, m_error_rate, m_accuracy_weight, m_error_weight, num_equil, num_rand);
@@ -434,29 +532,8 @@ void ErrorproneTranslation::getWeightsForTargetAccuracy(const Gene& seed_genotyp
 			nequil++;
 			if (nequil > num_equil) {
 				// We've equilibrated enough; record the weights.
-				double acc_weight_total = 0.0;
-				double err_weight_total = 0.0;
-				for ( unsigned int i=0; i<g.codonLength(); i++ ) {
-					double last_event_prob = 0.0;
-					Codon ci = g.getCodon(i);
-					int codon_index = Codon::codonToIndex(ci);
-					// Compute probability of synonymous error
-					double p_synonymous = 0.0;
-					for (unsigned int outcome=0; outcome<m_cum_weight_matrix[codon_index].size(); outcome++) {
-						pair<double, char> event = m_cum_weight_matrix[codon_index][outcome];
-						// events record cumulative probabilities, so get the probability.
-						double event_prob = event.first - last_event_prob;
-						if (event.second == GeneticCodeUtil::geneticCode(ci)) {
-							// Synonymous error
-							p_synonymous += event_prob;
-						}
-						last_event_prob = event_prob;
-					}
-					// Compute the site_weight and aggregate.
-					double site_weight = (1.0 + m_codon_cost[codon_index]*(m_ca_cost-1));
-					acc_weight_total += site_weight * (1-p_synonymous);
-					err_weight_total += site_weight;
-				}
+				double acc_weight_total, err_weight_total;
+				calcGeneWeights(g, acc_weight_total, err_weight_total);
 				// Aggregate the total weights.
 				random_accuracy_weight += acc_weight_total;
 				random_error_weight += err_weight_total;
@@ -476,6 +553,148 @@ void ErrorproneTranslation::getWeightsForTargetAccuracy(const Gene& seed_genotyp
 	error_rate = estimateErrorRateFromAccuracy(target_fraction_accurate, accuracy_weight, error_weight);
 }
 
+void ErrorproneTranslation::calcGeneWeights(const CodingDNA& g, double& accuracy_weight, double& error_weight) const {
+	double acc_weight_total = 0.0;
+	double err_weight_total = 0.0;
+	for ( unsigned int i=0; i<g.codonLength(); i++ ) {
+		double last_event_prob = 0.0;
+		Codon ci = g.getCodon(i);
+		int codon_index = Codon::codonToIndex(ci);
+		// Compute probability of synonymous error
+		double p_synonymous = 0.0;
+		const vector<pair<double, char> >& events = m_translation_weights->getCumulativeWeights()[codon_index];
+		for (unsigned int outcome=0; outcome<events.size(); outcome++) {
+			pair<double, char> event = events[outcome];
+			// events record cumulative probabilities, so get the probability.
+			double event_prob = event.first - last_event_prob;
+			if (event.second == GeneticCodeUtil::geneticCode(ci)) {
+				// Synonymous error
+				p_synonymous += event_prob;
+			}
+			last_event_prob = event_prob;
+		}
+		// Compute the site_weight and aggregate.
+		double site_weight = (1.0 + m_codon_cost[codon_index]*(m_ca_cost-1));
+		acc_weight_total += site_weight * (1-p_synonymous);
+		err_weight_total += site_weight;
+	}
+	accuracy_weight = acc_weight_total;
+	error_weight = err_weight_total;
+}
+
+void ErrorproneTranslation::runCalibrationChain(const CodingDNA& seed_genotype, const int num_equil, const int num_rand, RandomStream& rng,
+												vector<double>& accuracy_weights, vector<double>& error_weights) {
+	// the same chain as in the serial getWeightsForTargetAccuracy(), but with
+	// the random numbers drawn from rng
+	CodingDNA g(seed_genotype);
+	int nrand=0, nequil=0;
+	while ( nrand < num_rand ) {
+		int randpos = rng.rint(g.codonLength());
+		Codon from_codon = g.getCodon(randpos);
+		Codon to_codon = from_codon;
+		do {
+			to_codon = Codon::indexToCodon(rng.rint(64));
+		} while (to_codon == from_codon);
+
+		g.setCodon(randpos,to_codon);
+		if (getFolded(g)) {
+			nequil++;
+			if (nequil > num_equil) {
+				double acc_weight, err_weight;
+				calcGeneWeights(g, acc_weight, err_weight);
+				accuracy_weights.push_back(acc_weight);
+				error_weights.push_back(err_weight);
+				nrand++;
+			}
+		}
+		else {
+			g.setCodon(randpos, from_codon);
+		}
+	}
+}
+
+/**
+ * The chains of the parallel ErrorproneTranslation::getWeightsForTargetAccuracy().
+ */
+class CalibrationChainTask : public ThreadTask {
+private:
+	ErrorproneTranslation& m_ept;
+	const CodingDNA& m_seed_genotype;
+	int m_num_equil;
+	int m_num_rand;
+	uint m_seed;
+
+public:
+	vector<vector<double> > accuracy_weights, error_weights;
+
+	CalibrationChainTask( ErrorproneTranslation& ept, const CodingDNA& seed_genotype, int num_equil, int num_rand, uint seed, unsigned int num_chains )
+		: m_ept( ept ), m_seed_genotype( seed_genotype ), m_num_equil( num_equil ), m_num_rand( num_rand ), m_seed( seed ),
+		accuracy_weights( num_chains ), error_weights( num_chains ) {}
+
+	void run( unsigned int item ) {
+		RandomStream rng( m_seed, item );
+		m_ept.runCalibrationChain( m_seed_genotype, m_num_equil, m_num_rand, rng, accuracy_weights[item], error_weights[item] );
+	}
+};
+
+// Gelman-Rubin potential scale reduction factor of equally long chains.
+static double calcPotentialScaleReduction( const vector<vector<double> >& chains )
+{
+	unsigned int m = chains.size();
+	unsigned int n = chains[0].size();
+	if ( m < 2 || n < 2 )
+		return 1.0;
+	vector<double> chain_means( m );
+	double within = 0.0;
+	for ( unsigned int j=0; j<m; j++ ) {
+		chain_means[j] = mean( chains[j] );
+		within += variance( chains[j] );
+	}
+	within /= m;
+	double between = variance( chain_means ); // B/n
+	if ( within <= 0 )
+		return 1.0;
+	return sqrt( ( (n-1.0)/n*within + between )/within );
+}
+
+void ErrorproneTranslation::getWeightsForTargetAccuracy(const CodingDNA& seed_genotype, const double target_fraction_accurate, double& error_rate,
+														double& accuracy_weight, double& error_weight, const int num_equil, const int num_rand,
+														unsigned int num_chains, unsigned int num_threads, uint seed, CalibrationDiagnostics* diagnostics) {
+	if (!getFolded(seed_genotype)) {
+		cerr << "# ERROR: getRandomWeights() requires a folded seed_genotype." << endl;
+		return;
+	}
+	num_chains = max( num_chains, 1U );
+	int samples_per_chain = max( (num_rand + (int) num_chains - 1)/(int) num_chains, 1 );
+
+	CalibrationChainTask task( *this, seed_genotype, num_equil, samples_per_chain, seed, num_chains );
+	ThreadPool pool( max( num_threads, 1U ) );
+	pool.run( task, num_chains );
+
+	// pool the samples of all chains, in chain order
+	Accumulator random_accuracy_weight;
+	Accumulator random_error_weight;
+	vector<double> chain_error_rates( num_chains );
+	for (unsigned int k=0; k<num_chains; k++) {
+		for (int i=0; i<samples_per_chain; i++) {
+			random_accuracy_weight += task.accuracy_weights[k][i];
+			random_error_weight += task.error_weights[k][i];
+		}
+		chain_error_rates[k] = estimateErrorRateFromAccuracy(target_fraction_accurate, mean(task.accuracy_weights[k]), mean(task.error_weights[k]));
+	}
+	accuracy_weight = random_accuracy_weight.value();
+	error_weight = random_error_weight.value();
+	error_rate = estimateErrorRateFromAccuracy(target_fraction_accurate, accuracy_weight, error_weight);
+
+	if (diagnostics) {
+		diagnostics->num_chains = num_chains;
+		diagnostics->samples_per_chain = samples_per_chain;
+		diagnostics->error_rate_stderror = ( num_chains > 1 ? sqrt(variance(chain_error_rates)/num_chains) : 0.0 );
+		diagnostics->rhat_accuracy_weight = calcPotentialScaleReduction(task.accuracy_weights);
+		diagnostics->rhat_error_weight = calcPotentialScaleReduction(task.error_weights);
+	}
+}
+
 
 /*
  * Computes the expected value of various translational outcomes from the gene g.
@@ -496,7 +715,18 @@ double ErrorproneTranslation::calcOutcomes( const CodingDNA &g, double &frac_acc
 
 	Protein prot( g.translate() );
 	//cout << prot << endl;
-	bool native_seq_folds = sequenceFolds(prot);
+	// folding outcomes that were found before for this protein
+	shared_ptr<OutcomeTable> table = getOutcomeTable(prot);
+	bool native_seq_folds;
+	if ( table && table->native_folds >= 0 ) {
+		native_seq_folds = table->native_folds;
+	}
+	else {
+		native_seq_folds = sequenceFolds(prot);
+		if ( table ) {
+			table->native_folds = native_seq_folds;
+		}
+	}
 
 	// Bail out if native sequence is misfolded.
 	if (!native_seq_folds) {
@@ -508,11 +738,18 @@ double ErrorproneTranslation::calcOutcomes( const CodingDNA &g, double &frac_acc
 		return 0.0;
 	}
 
+	// All mistranslated proteins below are point mutants of the native one;
+	// their folding state is prepared when the first unknown one has to be folded
+	ProteinFolder* folder = dynamic_cast<ProteinFolder*>( m_protein_folder );
+	auto_ptr<ParentFoldState> parent;
+	bool parent_prepared = false;
+
 	// Initialize our target properties
 	double p_acc = 1.0;
 	double p_fold = 1.0;
 	double p_notrunc = 1.0;
 	double inv_site_error_weight = 1.0/(m_error_weight/g.codonLength());
+	const vector<vector<pair<double, char> > >& cum_weights = m_translation_weights->getCumulativeWeights();
 	Codon codon;
 	int codon_index = -2;
 	// Iterate over all sites
@@ -528,23 +765,26 @@ double ErrorproneTranslation::calcOutcomes( const CodingDNA &g, double &frac_acc
 		double p_error_folds = 0.0;
 		double p_synonymous = 0.0;
 		double p_trunc_site = 0.0;
+		// the changed, untruncated residues, which are folded together below
+		string new_aas;
+		vector<double> p_new_aas;
 		for (unsigned int noutcome=0; noutcome<21; noutcome++) {
 			// The first member of the pair is a cumulative probability; the second is
 			// the residue resulting from the error.
-			pair<double, char> p = m_cum_weight_matrix[codon_index][noutcome];
-			prot[i] = p.second;
+			pair<double, char> p = cum_weights[codon_index][noutcome];
 			// Probability of this particular event given an error at this site
 			double p_outcome = (p.first-last_prob);
 			if (p_outcome < 1e-6) { // Ignore this and all subsequent very-low-probability events
 				break;
 			}
-			bool trunc = (prot[i] == GeneticCodeUtil::STOP); // truncation error.
+			bool trunc = (p.second == GeneticCodeUtil::STOP); // truncation error.
 			if (trunc) {
 				p_trunc_site += p_outcome;
 			}
-			if (prot[i] != old_res) { // Change from wildtype sequence
-				if (!trunc && sequenceFolds(prot)) { // Truncated means misfolded
-					p_error_folds += p_outcome;
+			if (p.second != old_res) { // Change from wildtype sequence
+				if (!trunc) { // Truncated means misfolded
+					new_aas += p.second;
+					p_new_aas.push_back( p_outcome );
 				}
 			}
 			else { // No change from wildtype sequence
@@ -552,6 +792,43 @@ double ErrorproneTranslation::calcOutcomes( const CodingDNA &g, double &frac_acc
 			}
 			last_prob += p_outcome;
 		}
+		vector<bool> folds( new_aas.size() );
+		string unknown_aas = new_aas;
+		if ( table ) {
+			unknown_aas.clear();
+			for (unsigned int k=0; k<new_aas.size(); k++) {
+				signed char f = table->mutant_folds[20*i+GeneticCodeUtil::aminoAcidLetterToIndex(new_aas[k])];
+				if ( f < 0 ) {
+					unknown_aas += new_aas[k];
+				}
+				folds[k] = ( f > 0 );
+			}
+		}
+		if ( !unknown_aas.empty() ) {
+			if ( !parent_prepared ) {
+				parent.reset( folder ? folder->prepareMutants( prot ) : 0 );
+				parent_prepared = true;
+			}
+			vector<bool> unknown_folds;
+			siteMutantsFold(parent.get(), prot, i, unknown_aas, unknown_folds);
+			if ( table ) {
+				for (unsigned int k=0, u=0; k<new_aas.size(); k++) {
+					signed char& f = table->mutant_folds[20*i+GeneticCodeUtil::aminoAcidLetterToIndex(new_aas[k])];
+					if ( f < 0 ) {
+						f = unknown_folds[u++];
+						folds[k] = f;
+					}
+				}
+			}
+			else {
+				folds = unknown_folds;
+			}
+		}
+		for (unsigned int k=0; k<new_aas.size(); k++) {
+			if (folds[k]) {
+				p_error_folds += p_new_aas[k];
+			}
+		}
 		// to be accurate, either have no error, or have a synonymous error
 		// p_acc = prod_i (1 - p_codon_error(i)) + p_codon_error(i) * p_synonymous(i)
 		p_acc  *= (1.0 - p_codon_error * (1 - p_synonymous));
@@ -610,7 +887,7 @@ double ErrorproneTranslation::countOutcomes( const Gene &g, const int num_to_fol
 	int numMistranslated = 0;
 	for (int i=0; i<num_to_fold; i++) {
 		//bool truncated = false;
-		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_cum_weight_matrix, m_codon_cost, m_ca_cost, truncated);
+		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated);
 		if (truncated) {
 			numTrunc++;
 		}
@@ -652,7 +929,48 @@ void ErrorproneTranslation::stabilityOutcomes( const Gene &g, const int num_to_f
 	Protein p = g.translate();
 	for (int i=0; i<num_to_fold;) {
 		bool truncated = false;
-		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_cum_weight_matrix, m_codon_cost, m_ca_cost, truncated);
+		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated);
+		// Only record mistranslations that are folded into the correct structure
+		if (numErrors>0 && !truncated) {
+			auto_ptr<FoldInfo> fold_data( m_protein_folder->fold(p) );
+			if (fold_data->getStructure() == m_protein_structure_ID) {
+				ddgs.push_back(fold_data->getDeltaG());
+				i++;
+			}
+		}
+	}
+}
+
+// Number of proteins per chunk of the parallel countOutcomes() and stabilityOutcomes().
+static const int OUTCOME_CHUNK_SIZE = 100;
+
+void ErrorproneTranslation::countOutcomeChunk(const CodingDNA& g, const int num_trials, const bool native_seq_folds, RandomStream& rng, int& num_mistranslated, int& num_truncated, int& num_folded) {
+	Translator t(m_error_rate);
+	Protein p(g.codonLength());
+	for (int i=0; i<num_trials; i++) {
+		bool truncated = false;
+		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated, rng);
+		if (truncated) {
+			num_truncated++;
+		}
+		if (numErrors > 0) { // Some errors.
+			num_mistranslated++;
+			if (!truncated && sequenceFolds(p)) {
+				num_folded++;
+			}
+		}
+		else if (native_seq_folds) { // No errors; just record if native sequence folds.
+			num_folded++;
+		}
+	}
+}
+
+void ErrorproneTranslation::stabilityOutcomeChunk(const CodingDNA& g, const int num_to_fold, RandomStream& rng, vector<double>& ddgs) {
+	Translator t(m_error_rate);
+	Protein p = g.translate();
+	for (int i=0; i<num_to_fold;) {
+		bool truncated = false;
+		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated, rng);
 		// Only record mistranslations that are folded into the correct structure
 		if (numErrors>0 && !truncated) {
 			auto_ptr<FoldInfo> fold_data( m_protein_folder->fold(p) );
@@ -664,6 +982,102 @@ void ErrorproneTranslation::stabilityOutcomes( const Gene &g, const int num_to_f
 	}
 }
 
+/**
+ * The chunks of the parallel ErrorproneTranslation::countOutcomes(). Each chunk
+ * has its own counts, which are added up in chunk order afterwards.
+ */
+class OutcomeCountTask : public ThreadTask {
+private:
+	ErrorproneTranslation& m_ept;
+	const CodingDNA& m_gene;
+	int m_num_to_fold;
+	bool m_native_seq_folds;
+	uint m_seed;
+
+public:
+	vector<int> num_mistranslated, num_truncated, num_folded;
+
+	OutcomeCountTask( ErrorproneTranslation& ept, const CodingDNA& g, int num_to_fold, bool native_seq_folds, uint seed, unsigned int num_chunks )
+		: m_ept( ept ), m_gene( g ), m_num_to_fold( num_to_fold ), m_native_seq_folds( native_seq_folds ), m_seed( seed ),
+		num_mistranslated( num_chunks, 0 ), num_truncated( num_chunks, 0 ), num_folded( num_chunks, 0 ) {}
+
+	void run( unsigned int item ) {
+		RandomStream rng( m_seed, item );
+		int num_trials = min( OUTCOME_CHUNK_SIZE, m_num_to_fold - (int) item*OUTCOME_CHUNK_SIZE );
+		m_ept.countOutcomeChunk( m_gene, num_trials, m_native_seq_folds, rng, num_mistranslated[item], num_truncated[item], num_folded[item] );
+	}
+};
+
+/**
+ * The chunks of the parallel ErrorproneTranslation::stabilityOutcomes().
+ */
+class StabilityOutcomeTask : public ThreadTask {
+private:
+	ErrorproneTranslation& m_ept;
+	const CodingDNA& m_gene;
+	int m_num_to_fold;
+	uint m_seed;
+
+public:
+	vector<vector<double> > ddgs;
+
+	StabilityOutcomeTask( ErrorproneTranslation& ept, const CodingDNA& g, int num_to_fold, uint seed, unsigned int num_chunks )
+		: m_ept( ept ), m_gene( g ), m_num_to_fold( num_to_fold ), m_seed( seed ), ddgs( num_chunks ) {}
+
+	void run( unsigned int item ) {
+		RandomStream rng( m_seed, item );
+		int num_to_fold = min( OUTCOME_CHUNK_SIZE, m_num_to_fold - (int) item*OUTCOME_CHUNK_SIZE );
+		m_ept.stabilityOutcomeChunk( m_gene, num_to_fold, rng, ddgs[item] );
+	}
+};
+
+double ErrorproneTranslation::countOutcomes( const CodingDNA& g, const int num_to_fold, int& num_accurate, int& num_robust, int& num_truncated, int& num_folded,
+											 unsigned int num_threads, uint seed ) {
+	if (num_to_fold <= 0) {
+		num_truncated = 0;
+		num_accurate = 0;
+		num_folded = 0;
+		num_robust = 0;
+		return (getFolded(g) ? 1.0 : 0.0);
+	}
+	bool native_seq_folds = getFolded(g);
+
+	unsigned int num_chunks = (num_to_fold + OUTCOME_CHUNK_SIZE - 1)/OUTCOME_CHUNK_SIZE;
+	OutcomeCountTask task( *this, g, num_to_fold, native_seq_folds, seed, num_chunks );
+	ThreadPool pool( max( num_threads, 1U ) );
+	pool.run( task, num_chunks );
+
+	int numFolded = 0;
+	int numTrunc = 0;
+	int numMistranslated = 0;
+	for (unsigned int k=0; k<num_chunks; k++) {
+		numMistranslated += task.num_mistranslated[k];
+		numTrunc += task.num_truncated[k];
+		numFolded += task.num_folded[k];
+	}
+	num_truncated = numTrunc;
+	num_accurate = num_to_fold-numMistranslated;
+	num_folded = numFolded;
+	num_robust = numFolded - (native_seq_folds ? 1 : 0)*num_accurate;
+	double frac_folded = numFolded/(double)num_to_fold;
+
+	// return fitness
+	return exp( - m_tr_cost * (1-frac_folded) / frac_folded );
+}
+
+void ErrorproneTranslation::stabilityOutcomes( const CodingDNA& g, const int num_to_fold, vector<double>& ddgs, unsigned int num_threads, uint seed ) {
+	if (num_to_fold <= 0) {
+		return;
+	}
+	unsigned int num_chunks = (num_to_fold + OUTCOME_CHUNK_SIZE - 1)/OUTCOME_CHUNK_SIZE;
+	StabilityOutcomeTask task( *this, g, num_to_fold, seed, num_chunks );
+	ThreadPool pool( max( num_threads, 1U ) );
+	pool.run( task, num_chunks );
+	for (unsigned int k=0; k<num_chunks; k++) {
+		ddgs.insert( ddgs.end(), task.ddgs[k].begin(), task.ddgs[k].end() );
+	}
+}
+
 /**
  * Record the set of proteins coming off the translation system under
  * the error spectrum of this translator.
@@ -673,7 +1087,7 @@ void ErrorproneTranslation::translationOutcomes( const CodingDNA& g, const int n
 	Protein p = g.translate();
 	for (int i=0; i<num_to_translate;) {
 		bool truncated = false;
-		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_cum_weight_matrix, m_codon_cost, m_ca_cost, truncated);
+		int numErrors = t.translateRelativeWeighted(g, p, m_error_weight, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated);
 		if (!only_mistranslated || (only_mistranslated && numErrors>0)) {
 			proteins.push_back(p);
 			i++;
@@ -786,7 +1200,7 @@ void ErrorproneTranslation::printCodonCosts(ostream& os) {
 
 double* ErrorproneTranslation::getCodonCosts() const { return ErrorproneTranslation::m_codon_cost; }
 
-vector<vector<pair<double, char> > > ErrorproneTranslation::getTranslationWeights() const { return m_cum_weight_matrix; }
+vector<vector<pair<double, char> > > ErrorproneTranslation::getTranslationWeights() const { return m_translation_weights->getCumulativeWeights(); }
 
 vector<bool> ErrorproneTranslation::getOptimalCodons(bool print_report) const {
 	vector<bool> is_optimal(64, false);
@@ -827,7 +1241,7 @@ vector<bool> ErrorproneTranslation::getOptimalCodons(bool print_report) const {
 			family_degeneracies[aa]++;
 			for (int reps=0; reps<max_reps; reps++) {
 				g.setCodon(0, codon);
-				int n_errors = t.translateRelativeWeighted(g, p, m_error_weight/m_protein_length, m_cum_weight_matrix, m_codon_cost, m_ca_cost, truncated);
+				int n_errors = t.translateRelativeWeighted(g, p, m_error_weight/m_protein_length, m_translation_weights->getCumulativeWeights(), m_codon_cost, m_ca_cost, truncated);
 				// Increment totals
 				family_accuracies[aa].second++;
 				codon_accuracies[ci].second++;
@@ -1089,6 +1503,8 @@ AccuracyOnlyTranslation::~AccuracyOnlyTranslation() {
 
 AccuracyOnlyTranslation::AccuracyOnlyTranslation( Folder *protein_folder, const int length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double error_rate, const double accuracy_weight, const double error_weight )
  : ErrorproneTranslation(protein_folder, length, protein_structure_ID, max_free_energy, tr_cost, ca_cost, error_rate, accuracy_weight, error_weight), m_target_sequence(length) {
+	// whether a protein "folds" depends on the target sequence, which changes with each gene
+	setOutcomeMemoSize( 0 );
 }
 
 bool AccuracyOnlyTranslation::sequenceFolds(Protein& p) {
@@ -1126,22 +1542,142 @@ double AccuracyOnlyTranslation::getFitness( const Gene &g ) {
 }
 
 RobustnessOnlyTranslation::~RobustnessOnlyTranslation() {
+	pthread_mutex_destroy( &m_neutrality_mutex );
 }
 
-RobustnessOnlyTranslation::RobustnessOnlyTranslation(Folder *protein_folder, const int length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double error_rate ) : ErrorproneTranslation(protein_folder, length, protein_structure_ID, max_free_energy, tr_cost, ca_cost, error_rate, (double)length, (double)length) {
-
-	// Fixed fraction mistranslated based on error rate
-	m_fraction_accurate = 1.0 - pow((1.0 - error_rate), (double)length);
+RobustnessOnlyTranslation::RobustnessOnlyTranslation(Folder *protein_folder, const int length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double error_rate ) : ErrorproneTranslation(protein_folder, length, protein_structure_ID, max_free_energy, tr_cost, ca_cost, error_rate, (double)length, (double)length), m_weighted_accuracy( false ), m_num_threads( 1 ),
+	m_neutrality_cache_size( 1000 ), m_neutrality_lookups( 0 ), m_neutrality_hits( 0 ), m_neutrality_updates( 0 ), m_neutrality_cache_epoch( 0 ) {
+	pthread_mutex_init( &m_neutrality_mutex, 0 );
+	updateFractionAccurate();
 }
 
 RobustnessOnlyTranslation::RobustnessOnlyTranslation(Folder *protein_folder, const int length, const StructureID protein_structure_ID,
 													 const double max_free_energy, const double tr_cost, const double ca_cost, const double error_rate,
 													 const double accuracy_weight, const double error_weight ) :
-	ErrorproneTranslation(protein_folder, length, protein_structure_ID, max_free_energy, tr_cost, ca_cost, error_rate, accuracy_weight, error_weight) {
+	ErrorproneTranslation(protein_folder, length, protein_structure_ID, max_free_energy, tr_cost, ca_cost, error_rate, accuracy_weight, error_weight), m_weighted_accuracy( true ), m_num_threads( 1 ),
+	m_neutrality_cache_size( 1000 ), m_neutrality_lookups( 0 ), m_neutrality_hits( 0 ), m_neutrality_updates( 0 ), m_neutrality_cache_epoch( 0 ) {
+	pthread_mutex_init( &m_neutrality_mutex, 0 );
+	updateFractionAccurate();
+	//cout << "acc = " << m_fraction_accurate << endl;
+}
 
+void RobustnessOnlyTranslation::updateFractionAccurate()
+{
 	// Fixed fraction mistranslated based on error rate
-	m_fraction_accurate = estimateAccuracyFromErrorRate(error_rate, accuracy_weight, error_weight);
-	//cout << "acc = " << m_fraction_accurate << endl;
+	if ( m_weighted_accuracy )
+		m_fraction_accurate = estimateAccuracyFromErrorRate(m_error_rate, m_accuracy_weight, m_error_weight);
+	else
+		m_fraction_accurate = 1.0 - pow((1.0 - m_error_rate), (double)m_protein_length);
+}
+
+void RobustnessOnlyTranslation::setErrorRate( const double error_rate )
+{
+	ErrorproneTranslation::setErrorRate( error_rate );
+	updateFractionAccurate();
+}
+
+void RobustnessOnlyTranslation::setErrorWeights( const double error_rate, const double accuracy_weight, const double error_weight )
+{
+	ErrorproneTranslation::setErrorWeights( error_rate, accuracy_weight, error_weight );
+	m_weighted_accuracy = true;
+	updateFractionAccurate();
+}
+
+void RobustnessOnlyTranslation::setNeutralityCacheSize( unsigned int size )
+{
+	pthread_mutex_lock( &m_neutrality_mutex );
+	m_neutrality_cache_size = size;
+	while ( m_neutrality_cache_order.size() > m_neutrality_cache_size ) {
+		m_neutrality_cache.erase( m_neutrality_cache_order.front() );
+		m_neutrality_cache_order.pop_front();
+	}
+	pthread_mutex_unlock( &m_neutrality_mutex );
+}
+
+pair<unsigned long, unsigned long> RobustnessOnlyTranslation::getNeutralityCacheStats() const
+{
+	pthread_mutex_lock( &m_neutrality_mutex );
+	pair<unsigned long, unsigned long> stats( m_neutrality_lookups, m_neutrality_hits );
+	pthread_mutex_unlock( &m_neutrality_mutex );
+	return stats;
+}
+
+unsigned long RobustnessOnlyTranslation::getNeutralityUpdates() const
+{
+	pthread_mutex_lock( &m_neutrality_mutex );
+	unsigned long updates = m_neutrality_updates;
+	pthread_mutex_unlock( &m_neutrality_mutex );
+	return updates;
+}
+
+string RobustnessOnlyTranslation::findCachedPointMutant( const Protein& p ) const
+{
+	deque<string>::const_reverse_iterator it = m_neutrality_cache_order.rbegin();
+	for ( ; it != m_neutrality_cache_order.rend(); it++ ) {
+		const string& q = *it;
+		if ( q.size() != p.size() || !m_neutrality_cache.find( q )->second.bounds )
+			continue;
+		unsigned int num_changes = 0;
+		for ( unsigned int i=0; i<q.size() && num_changes < 2; i++ ) {
+			if ( q[i] != p[i] )
+				num_changes++;
+		}
+		if ( num_changes == 1 )
+			return q;
+	}
+	return "";
+}
+
+double RobustnessOnlyTranslation::getNeutrality( const Protein& p )
+{
+	pthread_mutex_lock( &m_neutrality_mutex );
+	// the neutralities depend on the target structure and the free energy cutoff
+	if ( m_neutrality_cache_epoch != m_epoch ) {
+		m_neutrality_cache.clear();
+		m_neutrality_cache_order.clear();
+		m_neutrality_cache_epoch = m_epoch;
+	}
+	m_neutrality_lookups++;
+	map<string, NeutralityEntry>::const_iterator it = m_neutrality_cache.find( p );
+	if ( it != m_neutrality_cache.end() ) {
+		double nu = it->second.neutrality;
+		m_neutrality_hits++;
+		pthread_mutex_unlock( &m_neutrality_mutex );
+		return nu;
+	}
+	Protein parent( findCachedPointMutant( p ) );
+	shared_ptr<const NeutralityBounds> parent_bounds;
+	if ( parent.length() > 0 ) {
+		parent_bounds = m_neutrality_cache.find( parent )->second.bounds;
+		m_neutrality_updates++;
+	}
+	pthread_mutex_unlock( &m_neutrality_mutex );
+
+	// fold without holding the lock; threads that miss on the same protein
+	// at the same time compute the same value
+	vector<double> site_neutrality;
+	shared_ptr<NeutralityBounds> bounds( new NeutralityBounds );
+	double nu;
+	if ( parent_bounds )
+		nu = FolderUtil::updateNeutralityProfile(*m_protein_folder, parent, *parent_bounds, p, m_max_free_energy, site_neutrality, m_num_threads, bounds.get());
+	else
+		nu = FolderUtil::calcNeutralityProfile(*m_protein_folder, p, m_max_free_energy, site_neutrality, m_num_threads, bounds.get());
+	if ( bounds->empty() )
+		bounds.reset();
+
+	pthread_mutex_lock( &m_neutrality_mutex );
+	NeutralityEntry entry;
+	entry.neutrality = nu;
+	entry.bounds = bounds;
+	if ( m_neutrality_cache_size > 0 && m_neutrality_cache.insert( make_pair( string( p ), entry ) ).second ) {
+		m_neutrality_cache_order.push_back( p );
+		if ( m_neutrality_cache_order.size() > m_neutrality_cache_size ) {
+			m_neutrality_cache.erase( m_neutrality_cache_order.front() );
+			m_neutrality_cache_order.pop_front();
+		}
+	}
+	pthread_mutex_unlock( &m_neutrality_mutex );
+	return nu;
 }
 
 double RobustnessOnlyTranslation::getFitness( const Gene &g )
@@ -1153,7 +1689,7 @@ double RobustnessOnlyTranslation::getFitness( const Gene &g )
 		if ( ErrorproneTranslation::sequenceFolds(p) ) {
 			if ( m_tr_cost > 0 ) {
 				// Actual fraction folded will be (1-m_fraction_mistranslated) [all fold] + m_fraction_mistranslated*nu [neutral point mutations]
-				double nu = FolderUtil::calcNeutrality(*m_protein_folder, p, m_max_free_energy);
+				double nu = getNeutrality(p);
 				double ffold = m_fraction_accurate + nu*(1 - m_fraction_accurate);
 				fitness = exp( - m_tr_cost * (1.0 - ffold) / ffold );
 			}
@@ -1192,7 +1728,7 @@ double RobustnessOnlyTranslation::calcOutcomes( const Gene &g, double &frac_accu
 		return 0.0;
 	}
 
-	double nu = FolderUtil::calcNeutrality(*m_protein_folder, prot, m_max_free_energy);
+	double nu = getNeutrality(prot);
 	double ffold = m_fraction_accurate + nu*(1 - m_fraction_accurate);
 	double fitness = exp( - m_tr_cost * (1.0 - ffold) / ffold );
 
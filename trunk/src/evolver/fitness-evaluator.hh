@@ -25,18 +25,60 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "protein.hh"
 #include "folder.hh"
 #include "gene-util.hh"
+#include "translator.hh"
+
+#include <deque>
+#include <map>
+#include <pthread.h>
+
+class RandomStream;
+class ThreadPool;
+class NeutralityBounds;
+class OutcomeCountTask;
+class StabilityOutcomeTask;
+class CalibrationChainTask;
 
 class FitnessEvaluator {
 private:
 	FitnessEvaluator( const FitnessEvaluator& );
 	FitnessEvaluator& operator=( const FitnessEvaluator& );
 
+protected:
+	ThreadPool* m_batch_pool; ///< Evaluates batches of genes in parallel, or NULL.
+	unsigned int m_epoch; ///< Number of changes of the fitness function so far.
+
 public:
 	FitnessEvaluator();
 	virtual ~FitnessEvaluator();
 
 	virtual double getFitness( const CodingDNA& ) = 0;
 	virtual double getFitness( const Protein& ) = 0;
+
+	/**
+	Evaluates the fitness of several genes, e.g. of all mutated offspring of a
+	generation. The results are those of \ref getFitness() for each gene, which is
+	what the default calls. Evaluators override this function to evaluate each
+	distinct gene or protein only once, and to spread the work over several
+	threads (see \ref setBatchThreads()).
+	@param genes The genes.
+	@param fitness Set to the fitness of genes[i] at fitness[i], for all genes.
+	*/
+	virtual void getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness );
+
+	/**
+	Sets the number of threads that evaluate a batch of genes (see \ref getFitnessBatch()).
+	The threads are started here and serve all batches until the next call, so that
+	evaluating a generation doesn't start any threads.
+	@param num_threads The number of threads; the default is 1.
+	*/
+	void setBatchThreads( unsigned int num_threads );
+
+	/**
+	@return The epoch of the fitness function, i.e., the number of changes of the
+	parameters that determine the fitness of a gene. Fitness values obtained in an
+	earlier epoch are out of date.
+	*/
+	unsigned int getEpoch() const { return m_epoch; }
 };
 
 class ProteinFreeEnergyFitness : public FitnessEvaluator {
@@ -50,6 +92,11 @@ public:
 
 	double getFitness( const CodingDNA& g );
 	double getFitness( const Protein& p );
+
+	/**
+	Folds each distinct protein of the batch once, on the batch threads.
+	*/
+	void getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness );
 };
 
 
@@ -65,9 +112,14 @@ public:
 	ProteinStructureFitness( Folder *protein_folder, int protein_structure_ID, double max_free_energy );
 	virtual ~ProteinStructureFitness();
 
-	void setFreeEnergyCutoff(double cutoff) { m_max_free_energy = cutoff; }
+	void setFreeEnergyCutoff(double cutoff) { m_max_free_energy = cutoff; m_epoch++; }
 	double getDeltaGCutoff() const { return m_max_free_energy; }
 
+	/**
+	Changes the structure into which a protein has to fold.
+	*/
+	void changeStructure( int structure_ID ) { m_protein_structure_ID = structure_ID; m_epoch++; }
+
 	double getFitness( const CodingDNA& g );
 	double getFitness( const Protein& p );
 };
@@ -118,22 +170,101 @@ protected:
 	//vector<vector<double> > m_weight_matrix;
 
 	/**
-	This weight matrix contains the sorted cumulative probability that
-	a given codon will be mistranslated as a given amino acid, including
-	a stop.
+	The sorted cumulative probabilities that a given codon will be
+	mistranslated as a given amino acid, including a stop. They are
+	shared by all objects.
 	*/
-	vector<vector<pair<double, char> > > m_cum_weight_matrix;
+	shared_ptr<const TranslationWeights> m_translation_weights;
+
+	/**
+	The folding outcomes of a protein and of its point mutants, which depend only
+	on the protein sequence, not on its codons or on the translation weights.
+	*/
+	struct OutcomeTable {
+		signed char native_folds; ///< Whether the protein folds; -1 if not known yet.
+		vector<signed char> mutant_folds; ///< Whether the mutant with amino acid a at site i folds, at 20*i+a; -1 if not known yet.
+	};
+
+	map<string, shared_ptr<OutcomeTable> > m_outcome_memo; ///< Outcome tables of recently evaluated proteins.
+	deque<string> m_outcome_memo_order; ///< The proteins in m_outcome_memo, oldest first.
+	unsigned int m_outcome_memo_size; ///< Maximum number of proteins in m_outcome_memo.
+	unsigned long m_outcome_memo_hits; ///< Number of calls of calcOutcomes() that found their protein in m_outcome_memo.
+	mutable pthread_mutex_t m_outcome_memo_mutex; ///< Protects m_outcome_memo, m_outcome_memo_order, m_outcome_memo_size and m_outcome_memo_hits.
+
+	/**
+	@return The outcome table of protein p, which is added to the memo if necessary,
+	or an empty pointer if the memo is disabled. The caller shares the ownership of the
+	table, which therefore stays valid when it is evicted from the memo or the memo is
+	cleared. Can be called concurrently, but only one thread at a time may use the
+	table of a given protein.
+	*/
+	shared_ptr<OutcomeTable> getOutcomeTable( const Protein& p );
 
-	double calcWeight( int co, int ct );
 	virtual bool sequenceFolds(Protein& p);
 
+	/**
+	 * Like \ref sequenceFolds(), for a point mutant of a protein whose folding state
+	 * was prepared with \ref ProteinFolder::prepareMutants(). Classes that override
+	 * sequenceFolds() have to override this function as well.
+	 *
+	 * @param parent The folding state of the parent protein, or NULL.
+	 * @param p The mutant.
+	 * @param site The mutated site.
+	 **/
+	virtual bool mutantFolds(const ParentFoldState* parent, Protein& p, int site);
+
+	/**
+	 * Like \ref mutantFolds(), for all point mutants of a protein at one site. With a
+	 * parent state, the mutants are folded together with \ref ProteinFolder::foldSiteMutants();
+	 * otherwise, \ref mutantFolds() is called for each. Classes that override
+	 * mutantFolds() have to override this function as well.
+	 *
+	 * @param parent The folding state of the parent protein, or NULL.
+	 * @param p The parent protein. It is unchanged on return.
+	 * @param site The mutated site.
+	 * @param new_aas The amino acids at the site in the mutants.
+	 * @param folds Set to whether each mutant folds, in the order of new_aas.
+	 **/
+	virtual void siteMutantsFold(const ParentFoldState* parent, Protein& p, int site, const string& new_aas, vector<bool>& folds);
+
+	friend class OutcomeCountTask;
+	friend class StabilityOutcomeTask;
+	friend class CalibrationChainTask;
+
+	/**
+	 * Computes the accuracy weight and the error weight of a gene (see \ref getWeightsForTargetAccuracy()).
+	 */
+	void calcGeneWeights(const CodingDNA& g, double& accuracy_weight, double& error_weight) const;
+
+	/**
+	 * One chain of the parallel \ref getWeightsForTargetAccuracy(): evolves the seed gene
+	 * with random codon changes that preserve folding, drawn from rng, and records the
+	 * weights of num_rand genes after num_equil accepted changes.
+	 */
+	void runCalibrationChain(const CodingDNA& seed_genotype, const int num_equil, const int num_rand, RandomStream& rng,
+							 vector<double>& accuracy_weights, vector<double>& error_weights);
+
+	/**
+	 * Translates num_trials proteins from g for \ref countOutcomes(), drawing from rng,
+	 * and adds the numbers of mistranslated, truncated, and folded proteins to the counts.
+	 */
+	void countOutcomeChunk(const CodingDNA& g, const int num_trials, const bool native_seq_folds, RandomStream& rng, int& num_mistranslated, int& num_truncated, int& num_folded);
+
+	/**
+	 * Translates proteins from g for \ref stabilityOutcomes(), drawing from rng, until
+	 * num_to_fold mistranslated ones fold into the target structure, and appends their
+	 * free energies to ddgs.
+	 */
+	void stabilityOutcomeChunk(const CodingDNA& g, const int num_to_fold, RandomStream& rng, vector<double>& ddgs);
+
 	/**
 	 * Compute the translational accuracy-related gene weights of a large set of random genotypes encoding folded proteins.
 	 */
 	void setRandomWeights(const CodingDNA& seed_genotype, const int num_equil=5000, const int num_rand=1000);
 
 	/**
-	 * Build the weight matrices that will be used in translating genes.
+	 * Set up the weight matrices that will be used in translating genes.
+	 * The matrices are shared (see \ref TranslationWeights), so this is cheap.
 	 *
 	 * Note: must be called before getWeightsForTargetAccuracy is called.
 	 **/
@@ -166,8 +297,10 @@ public:
 	 * @param tr_cost Cost factor for
 	 * @param ca_cost Codon adapation cost.  This cost represents the average fold-decrease in codon accuracy for non-optimal codons relative to optimal synonymous codons.
 	 * @param target_fraction_accurate Desired probability that an average folded protein will be translated with out errors.
+	 * @param num_chains If larger than 1, the weights are determined with as many chains, on as many threads (see \ref getWeightsForTargetAccuracy()).
 	 **/
-	ErrorproneTranslation(Folder *protein_folder, const int protein_length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double target_fraction_accurate );
+	ErrorproneTranslation(Folder *protein_folder, const int protein_length, const StructureID protein_structure_ID, const double max_free_energy, const double tr_cost, const double ca_cost, const double target_fraction_accurate,
+						  const unsigned int num_chains = 1 );
 
 	/**
 	 * \brief Create new ErrorproneTranslation object from a preexisting object.
@@ -181,7 +314,10 @@ public:
 		m_error_rate = ept.m_error_rate;
 		m_accuracy_weight = ept.m_accuracy_weight;
 		m_error_weight = ept.m_error_weight;
-		buildWeightMatrix();
+		m_outcome_memo_size = ept.m_outcome_memo_size;
+		m_outcome_memo_hits = 0;
+		pthread_mutex_init( &m_outcome_memo_mutex, 0 );
+		m_translation_weights = ept.m_translation_weights;
 	}
 
 	/**
@@ -194,11 +330,52 @@ public:
 	 **/
 	void changeStructure( const StructureID structure_ID ) {
 		m_protein_structure_ID = structure_ID;
+		clearOutcomeMemo();
+		m_epoch++;
 	}
 
+	/**
+	 * \brief Change the largest free energy of a folded protein.
+	 **/
+	void setFreeEnergyCutoff( const double cutoff ) {
+		m_max_free_energy = cutoff;
+		clearOutcomeMemo();
+		m_epoch++;
+	}
+
+	/**
+	Sets the number of proteins whose folding outcomes are remembered by
+	\ref calcOutcomes(). Genes that encode a remembered protein, such as
+	offspring with only synonymous mutations, are evaluated without folding;
+	only the codon-dependent error weights are recombined with the outcomes.
+	When the memo is full, the protein evaluated first is forgotten.
+	@param size The number of proteins; 0 disables the memo. The default is 1000.
+	*/
+	void setOutcomeMemoSize( unsigned int size );
+
+	/**
+	Forgets all remembered folding outcomes. Has to be called by derived classes
+	when the folding criterion changes.
+	*/
+	void clearOutcomeMemo();
+
+	/**
+	@return The number of calls of \ref calcOutcomes() that found their protein in the memo.
+	*/
+	unsigned long getOutcomeMemoHits() const;
+
 	double getFitness( const CodingDNA& g );
 	double getFitness( const Protein& p );
 
+	/**
+	Evaluates each distinct gene of the batch once, on the batch threads. Genes that
+	encode the same protein are evaluated in the same thread, one after another,
+	so that they share the outcome table of the protein (see \ref setOutcomeMemoSize()).
+	Derived classes whose \ref getFitness() can't be called concurrently have to
+	override this function.
+	*/
+	virtual void getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness );
+
 	/**
 	Tests whether the protein encoded by the \ref CodingDNA g folds
 	correctly. Calls \ref sequenceFolds(), which may be overridden
@@ -302,6 +479,39 @@ public:
 	void getWeightsForTargetAccuracy(const CodingDNA& seed_genotype, const double target_fraction_accurate, double& error_rate,
 									 double& accuracy_weight, double& error_weight, const int num_equil, const int num_rand);
 
+	/**
+	 * Convergence diagnostics of the parallel \ref getWeightsForTargetAccuracy().
+	 **/
+	struct CalibrationDiagnostics {
+		unsigned int num_chains; ///< The number of chains.
+		int samples_per_chain; ///< The number of genes whose weights were recorded in each chain.
+		double error_rate_stderror; ///< The standard error of the error rate, from the spread of the estimates of the chains.
+		double rhat_accuracy_weight; ///< Gelman-Rubin potential scale reduction factor of the accuracy weight.
+		double rhat_error_weight; ///< Gelman-Rubin potential scale reduction factor of the error weight.
+	};
+
+	/**
+	Like the function above, but runs several chains, each started from the seed
+	genotype, on several threads. The num_rand recorded genes are divided among the
+	chains, while each chain equilibrates for num_equil steps, so with one thread
+	per chain the calibration takes a fraction of the time of a single chain.
+	Chain k draws its random numbers from \ref RandomStream (seed, k), so the
+	results depend on the seed and the number of chains, but not on the number of
+	threads. The weights are averaged over all chains.
+
+	Potential scale reduction factors (Gelman and Rubin, Stat. Sci. 7:457-472, 1992)
+	close to 1 indicate that the chains have forgotten the seed genotype and sample
+	the same distribution; values above about 1.1 call for longer equilibration.
+
+	@param num_chains The number of chains.
+	@param num_threads The number of threads.
+	@param seed The seed of the random streams.
+	@param diagnostics If not NULL, set to the convergence diagnostics.
+	 */
+	void getWeightsForTargetAccuracy(const CodingDNA& seed_genotype, const double target_fraction_accurate, double& error_rate,
+									 double& accuracy_weight, double& error_weight, const int num_equil, const int num_rand,
+									 unsigned int num_chains, unsigned int num_threads, uint seed, CalibrationDiagnostics* diagnostics = 0);
+
 	/**
 	 * Given a [[DAD: is this used?]]
 	 **/
@@ -310,21 +520,22 @@ public:
 	/**
 	 * Sets the translational error rate per codon directly.
 	 **/
-	void setErrorRate(const double error_rate) { m_error_rate = error_rate; }
+	virtual void setErrorRate(const double error_rate) { m_error_rate = error_rate; m_epoch++; }
 
 	/**
 	 * Sets the translational cost directly.
 	 **/
-	void setMisfoldingCost(const double cost) { m_tr_cost = cost; }
+	void setMisfoldingCost(const double cost) { m_tr_cost = cost; m_epoch++; }
 
 	/**
 	 * Sets the translational error rate, accuracy weight and error weight directly.
 	 * @see getWeightsForTargetAccuracy for detailed description of each quantity.
 	 **/
-	void setErrorWeights(const double error_rate, const double accuracy_weight, const double error_weight) {
+	virtual void setErrorWeights(const double error_rate, const double accuracy_weight, const double error_weight) {
 		m_error_rate = error_rate;
 		m_accuracy_weight = accuracy_weight;
 		m_error_weight = error_weight;
+		m_epoch++;
 	}
 
 	/**
@@ -370,11 +581,30 @@ public:
 	 **/
 	virtual double countOutcomes(const CodingDNA& g, const int num_to_fold, int& num_accurate, int& num_robust, int& num_truncated, int& num_folded);
 
+	/**
+	 * Like the function above, but translates and folds the proteins on several
+	 * threads. The proteins are translated in chunks of 100, and chunk k draws
+	 * its random numbers from \ref RandomStream (seed, k) instead of from
+	 * \ref Random, so the counts depend on the seed but not on the number of threads.
+	 *
+	 * @param num_threads The number of threads.
+	 * @param seed The seed of the random streams.
+	 **/
+	virtual double countOutcomes(const CodingDNA& g, const int num_to_fold, int& num_accurate, int& num_robust, int& num_truncated, int& num_folded,
+						 unsigned int num_threads, uint seed);
+
 	/**
 	 * Record stabilities of mistranslated proteins.
 	 */
 	virtual void stabilityOutcomes( const CodingDNA& g, const int num_to_fold, vector<double>& ddgs );
 
+	/**
+	 * Like the function above, but on several threads, with random streams as in the
+	 * parallel \ref countOutcomes(). The stabilities are appended in the order of
+	 * the chunks, so they depend on the seed but not on the number of threads.
+	 */
+	void stabilityOutcomes( const CodingDNA& g, const int num_to_fold, vector<double>& ddgs, unsigned int num_threads, uint seed );
+
 	/**
 	 * Record proteins coming off the simulated ribosome.
 	 */
@@ -442,6 +672,9 @@ private:
 protected:
 	Protein m_target_sequence;
 	bool sequenceFolds(Protein& p);
+	bool mutantFolds(const ParentFoldState*, Protein& p, int) { return sequenceFolds(p); }
+	void siteMutantsFold(const ParentFoldState*, Protein& p, int site, const string& new_aas, vector<bool>& folds) {
+		ErrorproneTranslation::siteMutantsFold( 0, p, site, new_aas, folds ); }
 
 public:
 	AccuracyOnlyTranslation( Folder* protein_folder, const int length, const StructureID protein_structure_ID, const double max_free_energy,
@@ -452,6 +685,11 @@ public:
 	double getFitness( const CodingDNA& g );
     double getFitness( const Protein& p ) { return getFitness( GeneUtil::reverseTranslate(p) ); }
 	bool getFolded( const CodingDNA& g );
+
+	/**
+	Evaluates the genes one after another, because \ref getFitness() sets the target sequence.
+	*/
+	void getFitnessBatch( const vector<const CodingDNA*>& genes, double* fitness ) { FitnessEvaluator::getFitnessBatch( genes, fitness ); }
 };
 
 /** \brief A \ref FitnessEvaluator, derived from \ref ErrorproneTranslation, in which all fitness differences are due to differing protein robustness to translation errors.
@@ -462,8 +700,51 @@ This class implements a case of \ref ErrorproneTranslation where translation alw
 class RobustnessOnlyTranslation : public ErrorproneTranslation {
 private:
 	RobustnessOnlyTranslation();
+	RobustnessOnlyTranslation( const RobustnessOnlyTranslation& );
+	RobustnessOnlyTranslation& operator=( const RobustnessOnlyTranslation& );
 protected:
 	double m_fraction_accurate;
+	bool m_weighted_accuracy; ///< Whether m_fraction_accurate is estimated from the error weights (see \ref estimateAccuracyFromErrorRate()), or from the error rate alone.
+	unsigned int m_num_threads; ///< Number of threads that fold point mutants.
+
+	/**
+	The neutrality of a protein, and the bounds on the free energies of its point
+	mutants from which the neutrality of its own point mutants can be updated.
+	*/
+	struct NeutralityEntry {
+		double neutrality;
+		shared_ptr<const NeutralityBounds> bounds; ///< NULL if the folder provides no bounds.
+	};
+
+	map<string, NeutralityEntry> m_neutrality_cache; ///< Neutralities of recently evaluated proteins.
+	deque<string> m_neutrality_cache_order; ///< The proteins in m_neutrality_cache, oldest first.
+	unsigned int m_neutrality_cache_size; ///< Maximum number of proteins in m_neutrality_cache.
+	unsigned long m_neutrality_lookups; ///< Number of neutralities asked for.
+	unsigned long m_neutrality_hits; ///< Number of neutralities found in m_neutrality_cache.
+	unsigned long m_neutrality_updates; ///< Number of neutralities updated from those of a point mutant in m_neutrality_cache.
+	unsigned int m_neutrality_cache_epoch; ///< The epoch of the values in m_neutrality_cache.
+	mutable pthread_mutex_t m_neutrality_mutex; ///< Protects the cache and its statistics.
+
+	/**
+	@return The neutrality of the protein p (see \ref FolderUtil::calcNeutrality()), from
+	the cache if possible. Otherwise, if the cache holds a protein that differs from p
+	at one site, such as the parent of an offspring with one amino-acid change, the
+	neutrality is updated from it (see \ref FolderUtil::updateNeutralityProfile()),
+	with the same result. Can be called concurrently.
+	*/
+	double getNeutrality( const Protein& p );
+
+	/**
+	@return A protein in the cache that differs from p at exactly one site and has
+	bounds, the most recent one if there are several, or an empty string. The cache
+	must be locked.
+	*/
+	string findCachedPointMutant( const Protein& p ) const;
+
+	/**
+	Recalculates m_fraction_accurate from the error rate and weights.
+	*/
+	void updateFractionAccurate();
 
 public:
 
@@ -476,6 +757,46 @@ public:
 	double getFitness( const CodingDNA& g );
     double getFitness( const Protein& p ) { return getFitness( GeneUtil::reverseTranslate(p) ); }
 
+	/**
+	Sets the number of threads that fold the point mutants of a protein when its
+	neutrality is calculated (see \ref FolderUtil::calcNeutralityProfile()).
+	@param num_threads The number of threads; the default is 1.
+	*/
+	void setNumThreads( unsigned int num_threads ) { m_num_threads = num_threads; }
+
+	/**
+	Sets the translational error rate, and recalculates the fraction of accurately
+	translated proteins from it.
+	*/
+	virtual void setErrorRate( const double error_rate );
+
+	/**
+	Sets the translational error rate and weights, and recalculates the fraction
+	of accurately translated proteins from them.
+	*/
+	virtual void setErrorWeights( const double error_rate, const double accuracy_weight, const double error_weight );
+
+	/**
+	Sets the number of proteins whose neutrality is remembered. Neutrality depends
+	only on the protein sequence, so offspring with only synonymous mutations are
+	evaluated without folding. When the cache is full, the protein evaluated first
+	is forgotten.
+	@param size The number of proteins; 0 disables the cache. The default is 1000.
+	*/
+	void setNeutralityCacheSize( unsigned int size );
+
+	/**
+	@return The number of neutralities that were asked for (first), and of those
+	that were found in the cache (second).
+	*/
+	pair<unsigned long, unsigned long> getNeutralityCacheStats() const;
+
+	/**
+	@return The number of neutralities that were not found in the cache, but updated
+	from the one of a point mutant in it, folding only the mutants whose outcome can differ.
+	*/
+	unsigned long getNeutralityUpdates() const;
+
 	/**
 	Compute the estimated fractions accurately translated, folded
 	despite mistranslation, truncated and folded, using the error
@@ -500,6 +821,12 @@ public:
 	 * @return The fitness that would result from the generated set of proteins.
 	 **/
 	virtual double countOutcomes(const CodingDNA& g, const int num_to_fold, int& num_accurate, int& num_robust, int& num_truncated, int& num_folded);
+
+	/**
+	 * The multithreaded countOutcomes() of \ref ErrorproneTranslation, which
+	 * translates and folds the proteins.
+	 **/
+	using ErrorproneTranslation::countOutcomes;
 };
 
 /** \brief A \ref FitnessEvaluator, derived from \ref ErrorproneTranslation, in which a minimum number of misfolded proteins are required before any fitness cost is incurred.
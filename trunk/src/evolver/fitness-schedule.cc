@@ -0,0 +1,114 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+
+#include "fitness-schedule.hh"
+
+#include "random.hh"
+
+#include <cmath>
+
+
+FitnessSchedule::FitnessSchedule()
+{
+}
+
+FitnessSchedule::~FitnessSchedule()
+{
+}
+
+void FitnessSchedule::addChange( Parameter parameter, int generation, double value )
+{
+	m_changes.insert( make_pair( generation, make_pair( parameter, value ) ) );
+}
+
+void FitnessSchedule::addPeriodicChange( Parameter parameter, int first_generation, int period, const vector<double>& values )
+{
+	if ( period < 1 || values.empty() ) {
+		cout << "# Warning: periodic change without period or values ignored" << endl;
+		return;
+	}
+	PeriodicChange change;
+	change.parameter = parameter;
+	change.first_generation = first_generation;
+	change.period = period;
+	change.values = values;
+	m_periodic_changes.push_back( change );
+}
+
+void FitnessSchedule::addRandomChanges( Parameter parameter, int first_generation, int last_generation, double probability, const vector<double>& values, uint seed )
+{
+	if ( values.empty() )
+		return;
+	RandomStream rng( seed );
+	for ( int t=first_generation; t<=last_generation; t++ ) {
+		if ( rng.runif() < probability )
+			addChange( parameter, t, values[rng.rint( values.size() )] );
+	}
+}
+
+bool FitnessSchedule::applyChange( Parameter parameter, double value, FitnessEvaluator& fe )
+{
+	ErrorproneTranslation* ept = dynamic_cast<ErrorproneTranslation*>( &fe );
+	ProteinStructureFitness* psf = dynamic_cast<ProteinStructureFitness*>( &fe );
+	switch ( parameter ) {
+	case TARGET_STRUCTURE:
+		if ( ept )
+			ept->changeStructure( (StructureID) floor( value + 0.5 ) );
+		else if ( psf )
+			psf->changeStructure( (int) floor( value + 0.5 ) );
+		else
+			break;
+		return true;
+	case FREE_ENERGY_CUTOFF:
+		if ( ept )
+			ept->setFreeEnergyCutoff( value );
+		else if ( psf )
+			psf->setFreeEnergyCutoff( value );
+		else
+			break;
+		return true;
+	case ERROR_RATE:
+		if ( !ept )
+			break;
+		ept->setErrorRate( value );
+		return true;
+	}
+	cout << "# Warning: the fitness evaluator has no parameter " << parameter << " to change" << endl;
+	return false;
+}
+
+bool FitnessSchedule::apply( int generation, FitnessEvaluator& fe ) const
+{
+	bool changed = false;
+	typedef multimap<int, pair<Parameter, double> >::const_iterator ChangeIterator;
+	pair<ChangeIterator, ChangeIterator> range = m_changes.equal_range( generation );
+	for ( ChangeIterator it = range.first; it != range.second; it++ )
+		changed |= applyChange( it->second.first, it->second.second, fe );
+
+	for ( unsigned int i=0; i<m_periodic_changes.size(); i++ ) {
+		const PeriodicChange& change = m_periodic_changes[i];
+		int t = generation - change.first_generation;
+		if ( t < 0 || t % change.period != 0 )
+			continue;
+		changed |= applyChange( change.parameter, change.values[( t / change.period ) % change.values.size()], fe );
+	}
+	return changed;
+}
@@ -0,0 +1,127 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+
+#ifndef FITNESS_SCHEDULE_HH
+#define FITNESS_SCHEDULE_HH
+
+#include "fitness-evaluator.hh"
+
+#include <map>
+#include <vector>
+
+/** \brief Changes of the environment of a \ref FitnessEvaluator at given generations, for time-varying fitness landscapes.
+
+A schedule changes the target structure, the free energy cutoff, or the translational
+error rate of an evaluator, at single generations, periodically, or at random
+generations. A \ref Population applies the changes for a generation at the start of
+\ref Population::evolve(). Each change starts a new epoch of the evaluator (see
+\ref FitnessEvaluator::getEpoch()), and the population evaluates its organisms again.
+
+Example: alternate between two target structures every 100 generations.
+\code
+FitnessSchedule schedule;
+vector<double> structures;
+structures.push_back( 599 );
+structures.push_back( 600 );
+schedule.addPeriodicChange( FitnessSchedule::TARGET_STRUCTURE, 100, 100, structures );
+pop.setFitnessSchedule( &schedule );
+\endcode
+*/
+class FitnessSchedule {
+public:
+	/**
+	The parameters of the environment that a schedule can change.
+	*/
+	enum Parameter { TARGET_STRUCTURE, FREE_ENERGY_CUTOFF, ERROR_RATE };
+
+private:
+	struct PeriodicChange {
+		Parameter parameter;
+		int first_generation;
+		int period;
+		vector<double> values;
+	};
+
+	multimap<int, pair<Parameter, double> > m_changes; ///< Single and random changes, by generation.
+	vector<PeriodicChange> m_periodic_changes;
+
+	FitnessSchedule( const FitnessSchedule& );
+	FitnessSchedule& operator=( const FitnessSchedule& );
+
+	/**
+	Sets a parameter of an evaluator.
+	@return False if the evaluator doesn't have the parameter.
+	*/
+	static bool applyChange( Parameter parameter, double value, FitnessEvaluator& fe );
+
+public:
+	FitnessSchedule();
+	~FitnessSchedule();
+
+	/**
+	Changes a parameter at a given generation.
+	@param parameter The parameter.
+	@param generation The generation, at least 1.
+	@param value The new value. Structure IDs are rounded to the nearest integer.
+	*/
+	void addChange( Parameter parameter, int generation, double value );
+
+	/**
+	Changes a parameter periodically, cycling through a list of values.
+	@param parameter The parameter.
+	@param first_generation The generation of the first change, at least 1.
+	@param period The number of generations between two changes.
+	@param values The values, in the order in which they are set; after the last one, the first one is set again.
+	*/
+	void addPeriodicChange( Parameter parameter, int first_generation, int period, const vector<double>& values );
+
+	/**
+	Changes a parameter at random generations. In each generation from first_generation
+	to last_generation, the parameter changes with the given probability, to a value
+	drawn at random from values. Generations and values are drawn here, from a stream
+	seeded with seed, so that a schedule doesn't depend on the random numbers that
+	the evolving population consumes.
+	@param parameter The parameter.
+	@param first_generation The first generation in which the parameter may change, at least 1.
+	@param last_generation The last generation in which the parameter may change.
+	@param probability The probability of a change in each generation.
+	@param values The possible values.
+	@param seed The seed of the random numbers.
+	*/
+	void addRandomChanges( Parameter parameter, int first_generation, int last_generation, double probability, const vector<double>& values, uint seed );
+
+	/**
+	Applies the changes scheduled for a generation to an evaluator: first the single
+	and random ones, in the order in which they were added, then the periodic ones.
+	Changes of parameters that the evaluator doesn't have are skipped with a warning.
+	@param generation The generation.
+	@param fe The evaluator.
+	@return True if a parameter of fe was changed.
+	*/
+	bool apply( int generation, FitnessEvaluator& fe ) const;
+
+	/**
+	@return True if no changes are scheduled.
+	*/
+	bool empty() const { return m_changes.empty() && m_periodic_changes.empty(); }
+};
+
+#endif // FITNESS_SCHEDULE_HH
@@ -40,7 +40,8 @@ class GenebankEntry
 {
 private:
 	const Organism m_organism; // the stored organism
-	const double m_fitness; // the fitness of this organism
+	double m_fitness; // the fitness of this organism
+	unsigned int m_epoch; // the epoch of the fitness function in which m_fitness was evaluated
 	GenebankEntry<Organism> *const m_parent; // the parent organism
 	const int m_id; // organism id
 	const int m_birthTime; // the time at which the organism first arose
@@ -52,8 +53,8 @@ private:
 	GenebankEntry( const GenebankEntry<Organism> & g );
 	const GenebankEntry<Organism> & operator=( const GenebankEntry<Organism> &g );
 public:
-	GenebankEntry( const Organism &organism, double fitness, GenebankEntry<Organism>* parent, int id, int birthTime ) :
-		m_organism( organism ), m_fitness( fitness ),
+	GenebankEntry( const Organism &organism, double fitness, GenebankEntry<Organism>* parent, int id, int birthTime, unsigned int epoch = 0 ) :
+		m_organism( organism ), m_fitness( fitness ), m_epoch( epoch ),
 		m_parent( parent ),
 		m_id( id ), m_birthTime( birthTime ), m_count( 1 ),
         m_coalescent( false ), m_tagged( false ) {}
@@ -99,6 +100,22 @@ public:
 	{
 		return m_fitness;
 	}
+	/**
+	 * Returns the epoch of the fitness function in which the fitness was evaluated
+	 * (see FitnessEvaluator::getEpoch()).
+	 **/
+	unsigned int getEpoch() const
+	{
+		return m_epoch;
+	}
+	/**
+	 * Replaces the fitness by one evaluated in a later epoch.
+	 **/
+	void setFitness( double fitness, unsigned int epoch )
+	{
+		m_fitness = fitness;
+		m_epoch = epoch;
+	}
 	int getCount() const
 	{
 		return m_count;
@@ -176,9 +193,9 @@ public:
 	 * Creates a new organism with the given characteristics. The organism
 	 * does not need to be added.
 	 **/
-	GenebankEntry<Organism>* createOrganism( const Organism &g, double fitness, GenebankEntry<Organism>* parent, int birthTime )
+	GenebankEntry<Organism>* createOrganism( const Organism &g, double fitness, GenebankEntry<Organism>* parent, int birthTime, unsigned int epoch = 0 )
 	{
-		GenebankEntry<Organism> *e = new GenebankEntry<Organism>( g, fitness, parent, m_maxId, birthTime );
+		GenebankEntry<Organism> *e = new GenebankEntry<Organism>( g, fitness, parent, m_maxId, birthTime, epoch );
 		m_organismMap[m_maxId] = e;
 		m_maxId += 1;
 
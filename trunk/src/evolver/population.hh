@@ -23,10 +23,12 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #define POPULATION_HH
 
 #include "genebank.hh"
+#include "fitness-schedule.hh"
 #include "random.hh"
 
 #include <fstream>
 #include <cassert>
+#include <vector>
 
 using namespace std;
 
@@ -51,6 +53,8 @@ private:
 	int m_time; // the time in generations
 	FitnessEvaluator *m_fitness_evaluator; // needed to evaluate organism fitnesses
 	Mutator *m_mutator; // introduces mutations into organisms
+	const FitnessSchedule *m_schedule; // changes of the fitness evaluator over time, or NULL
+	unsigned int m_epoch; // the epoch of the fitness evaluator in which the population was last evaluated
 
 	Genebank<Organism> m_genebank;
 
@@ -68,6 +72,23 @@ public:
 	 **/
 	void init( const Organism &g, FitnessEvaluator *fe, Mutator* mut );
 
+	/**
+	 * Sets the changes of the fitness evaluator over time. The changes for
+	 * generation t are applied at the start of the t-th call of evolve(). The
+	 * schedule is not copied, and has to exist as long as the population evolves.
+	 * @param schedule The schedule, or NULL for a constant environment.
+	 **/
+	void setFitnessSchedule( const FitnessSchedule* schedule ) { m_schedule = schedule; }
+
+	/**
+	 * Evaluates the fitness of the organisms in the population again if the fitness
+	 * evaluator has started a new epoch (see FitnessEvaluator::getEpoch()). Each
+	 * distinct organism is evaluated once, in one batch. Called by evolve(); has to
+	 * be called after changing the fitness evaluator directly if getAveFitness()
+	 * should reflect the change before the next generation.
+	 **/
+	void updateFitness();
+
 	/**
 	 * Create a new offspring based on a given one, with the correct
 	 * mutations etc.
@@ -101,7 +122,8 @@ public:
 	double getMutationRate() { return m_mutator.getMutationRate(); }
 
 	/**
-	 * Advances the population one time step.
+	 * Advances the population one time step. The fitness of all offspring that
+	 * carry new mutations is evaluated in one batch (see FitnessEvaluator::getFitnessBatch()).
 	 **/
 	void evolve();
 
@@ -215,7 +237,7 @@ protected:
 
 template <typename Organism, typename FitnessEvaluator, typename Mutator>
 Population<Organism, FitnessEvaluator, Mutator>::Population( int maxN )
-	: m_maxN( maxN ), m_N( maxN ), m_time( 0 )
+	: m_maxN( maxN ), m_N( maxN ), m_time( 0 ), m_schedule( 0 ), m_epoch( 0 )
 {
 	m_pop[0] = new GenebankEntry<Organism>*[m_maxN];
 	m_pop[1] = new GenebankEntry<Organism>*[m_maxN];
@@ -241,6 +263,7 @@ void Population<Organism, FitnessEvaluator, Mutator>::init( const Organism &g, F
 	m_time = 0;
 	assert( fe != 0 );
 	m_fitness_evaluator = fe;
+	m_epoch = m_fitness_evaluator->getEpoch();
 
 	// empty the genebank
 	m_genebank.clear();
@@ -250,12 +273,12 @@ void Population<Organism, FitnessEvaluator, Mutator>::init( const Organism &g, F
 	assert( f > 0.0 );
 
 	// create the parent of all organisms
-	GenebankEntry<Organism> *parent = m_genebank.createOrganism( g, f, 0, 0 );
+	GenebankEntry<Organism> *parent = m_genebank.createOrganism( g, f, 0, 0, m_epoch );
 	parent->setCoalescent();
 
 	// initialize population with given organism
 	for ( int i=0; i<m_N; i++ )
-		m_pop[m_buffer][i] = m_genebank.createOrganism( g, f, parent, 0 );
+		m_pop[m_buffer][i] = m_genebank.createOrganism( g, f, parent, 0, m_epoch );
 
 	// the parent is not part of the population anymore
 	m_genebank.removeOrganism( parent );
@@ -275,7 +298,35 @@ GenebankEntry<Organism>* Population<Organism, FitnessEvaluator, Mutator>::create
 	assert( m_fitness_evaluator != 0 );
 	double f =  m_fitness_evaluator->getFitness( g );
 	assert( f >= 0.0 );
-	return m_genebank.createOrganism( g, f, e, m_time );
+	return m_genebank.createOrganism( g, f, e, m_time, m_epoch );
+}
+
+template <typename Organism, typename FitnessEvaluator, typename Mutator>
+void Population<Organism, FitnessEvaluator, Mutator>::updateFitness()
+{
+	if ( m_fitness_evaluator->getEpoch() == m_epoch )
+		return;
+	m_epoch = m_fitness_evaluator->getEpoch();
+
+	// the distinct entries of the population; ancestors keep the fitness of their time
+	vector<GenebankEntry<Organism>*> entries;
+	vector<const Organism*> batch;
+	for ( iterator g = begin(); g != end(); g++ ) {
+		if ( (*g)->getEpoch() == m_epoch )
+			continue;
+		(*g)->setFitness( (*g)->getFitness(), m_epoch );
+		entries.push_back( *g );
+		batch.push_back( &(*g)->getOrganism() );
+	}
+	if ( batch.empty() )
+		return;
+
+	vector<double> fitness( batch.size() );
+	m_fitness_evaluator->getFitnessBatch( batch, &fitness[0] );
+	for ( unsigned int k=0; k<entries.size(); k++ ) {
+		assert( fitness[k] >= 0.0 );
+		entries[k]->setFitness( fitness[k], m_epoch );
+	}
 }
 
 template <typename Organism, typename FitnessEvaluator, typename Mutator>
@@ -318,6 +369,12 @@ void Population<Organism, FitnessEvaluator, Mutator>::evolve()
 	// advance generation time by one.
 	m_time += 1;
 
+	// change the environment as scheduled; in a constant environment, the
+	// fitness values stay valid
+	if ( m_schedule )
+		m_schedule->apply( m_time, *m_fitness_evaluator );
+	updateFitness();
+
 	// create the selection bins
 	iterator g = begin(); //iterator over the population
 	iterator e = end();
@@ -336,7 +393,10 @@ void Population<Organism, FitnessEvaluator, Mutator>::evolve()
 		m_selectionBins[i] /= fitnessSum;
 	}
 
-	// now do the selection/mutation step
+	// now do the selection/mutation step; for now, each offspring points to its parent
+	vector<Organism> offspring;
+	offspring.reserve( m_N );
+	vector<int> mutant_index( m_N, -1 ); // index of the mutated offspring, or -1 if not mutated
 	for ( int i=0; i<m_N; i++ ) {
 		index = Random::randintFromDistr( m_selectionBins, m_N );
 		double f = m_pop[m_buffer][index]->getFitness();
@@ -346,7 +406,32 @@ void Population<Organism, FitnessEvaluator, Mutator>::evolve()
 			//cout << "reproducing with fitness <= 0.0" << endl;
 		}
 
-		m_pop[outBuffer][i] = createOffspring( m_pop[m_buffer][index] );
+		m_pop[outBuffer][i] = m_pop[m_buffer][index];
+		Organism g = m_pop[outBuffer][i]->getOrganism();
+		if ( m_mutator->mutate(g) ) {
+			mutant_index[i] = offspring.size();
+			offspring.push_back( g );
+		}
+	}
+
+	// evaluate the mutated offspring together
+	assert( m_fitness_evaluator != 0 );
+	vector<const Organism*> batch( offspring.size() );
+	for ( unsigned int k=0; k<offspring.size(); k++ )
+		batch[k] = &offspring[k];
+	vector<double> fitness( offspring.size() );
+	if ( !batch.empty() )
+		m_fitness_evaluator->getFitnessBatch( batch, &fitness[0] );
+
+	// register the offspring, in the same order as createOffspring() would
+	for ( int i=0; i<m_N; i++ ) {
+		if ( mutant_index[i] < 0 ) {
+			m_genebank.addOrganism( m_pop[outBuffer][i] );
+			continue;
+		}
+		double f = fitness[mutant_index[i]];
+		assert( f >= 0.0 );
+		m_pop[outBuffer][i] = m_genebank.createOrganism( offspring[mutant_index[i]], f, m_pop[outBuffer][i], m_time, m_epoch );
 	}
 
 	// un-register the organisms of the old generation
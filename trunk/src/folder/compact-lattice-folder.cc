@@ -22,13 +22,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "genetic-code.hh"
 
 #include <cassert>
+#include <cfloat>
 #include <iostream>
 #include <cmath>
+#include <set>
 #include <iterator>
+#include <algorithm>
 
 // this defines the spacing in drawing protein structures
 #define CHARS_PER_SITE 2
 
+double CompactLatticeFolder::BAD_ENERGY = 999999.0;
+
 
 LatticeStructure::LatticeStructure()
 		: m_size(0), m_structure(0)
@@ -556,8 +561,9 @@ void SelfAvoidingWalk::getStructure( char * d ) const
 }
 
 
-CompactLatticeFolder::CompactLatticeFolder( int size, double deltaG_cutoff, StructureID target_sid  )
-	: DGCutoffFolder( deltaG_cutoff, target_sid ), m_size( size ), m_num_structures( 0 ), m_num_folded( 0 )
+CompactLatticeFolder::CompactLatticeFolder( int size, double deltaG_cutoff, StructureID target_sid, double kT, const string& shared_table )
+	: DGCutoffFolder( deltaG_cutoff, target_sid ), m_size( size ), m_kT( kT ), m_num_structures( 0 ), m_num_folded( 0 ),
+	m_contact_table( size, 3*size*size )
 {
 	if ( m_size > 15 )
 	{
@@ -568,8 +574,21 @@ CompactLatticeFolder::CompactLatticeFolder( int size, double deltaG_cutoff, Stru
 	m_ffw_struct = new char[3*m_size*m_size];
 	m_ss_struct = new char[3*m_size*m_size];
 	m_ss_struct2 = new char[3*m_size*m_size];
-	
-	enumerateStructures();
+	pthread_mutex_init( &m_shared_structures_mutex, 0 );
+
+	ContactTable::SharedState state = ContactTable::UNSHARED;
+	if ( !shared_table.empty() )
+		state = m_contact_table.openShared( shared_table );
+
+	if ( state != ContactTable::ATTACHED ) {
+		enumerateStructures();
+		buildContactTable();
+		// the structures are now in shared memory, so we don't need our own copy
+		if ( state == ContactTable::MUST_BUILD && m_contact_table.publishShared() )
+			releaseStructures();
+	}
+	m_num_structures = m_contact_table.getNumStructures();
+	findSitePartners();
 }
 
 CompactLatticeFolder::~CompactLatticeFolder()
@@ -578,10 +597,21 @@ CompactLatticeFolder::~CompactLatticeFolder()
 	delete [] m_ss_struct;
 	delete [] m_ss_struct2;
 
+	releaseStructures();
+	vector<LatticeStructure *>::iterator it = m_shared_structures.begin();
+	for ( ; it != m_shared_structures.end(); it++ )
+		delete (*it);
+	pthread_mutex_destroy( &m_shared_structures_mutex );
+}
+
+void CompactLatticeFolder::releaseStructures()
+{
 	vector<LatticeStructure *>::iterator it = m_structures.begin();
 
 	for ( ; it != m_structures.end(); it++ )
 		delete (*it);
+	m_structures.clear();
+	m_structure_map.clear();
 }
 
 void CompactLatticeFolder::findFillingWalks( SelfAvoidingWalk &w, int &moves )
@@ -767,6 +797,46 @@ void CompactLatticeFolder::enumerateStructures()
 }
 
 
+void CompactLatticeFolder::buildContactTable()
+{
+	// the drawing of each structure is stored along with its contacts, so that
+	// structures can be printed from a shared table
+	vector<char> record( 3*m_size*m_size, 0 );
+	m_contact_table.clear();
+	vector<LatticeStructure *>::const_iterator it = m_structures.begin();
+	for ( ; it!=m_structures.end(); it++ )
+	{
+		strncpy( &record[0], (*it)->getStructure(), record.size() );
+		m_contact_table.addStructure( (*it)->getInteractingPairs(), 1, &record[0] );
+	}
+}
+
+
+void CompactLatticeFolder::findSitePartners()
+{
+	unsigned int length = m_size*m_size;
+	vector<set<vector<unsigned int> > > partner_sets( length );
+	vector<vector<unsigned int> > partners( length );
+	for ( int sid=0; sid<m_num_structures; sid++ ) {
+		for ( unsigned int i=0; i<length; i++ )
+			partners[i].clear();
+		const ContactTable::Entry* it = m_contact_table.begin( sid );
+		const ContactTable::Entry* end = m_contact_table.end( sid );
+		for ( ; it!=end; it++ ) {
+			partners[it->first].push_back( it->second );
+			partners[it->second].push_back( it->first );
+		}
+		for ( unsigned int i=0; i<length; i++ ) {
+			sort( partners[i].begin(), partners[i].end() );
+			partner_sets[i].insert( partners[i] );
+		}
+	}
+	m_site_partners.resize( length );
+	for ( unsigned int i=0; i<length; i++ )
+		m_site_partners[i].assign( partner_sets[i].begin(), partner_sets[i].end() );
+}
+
+
 /**
  * Fold the sequence and return information about the result (structure, free energy).
  */
@@ -774,7 +844,7 @@ FoldInfo* CompactLatticeFolder::fold( const Protein& s ) const
 {
 	assert( m_num_structures > 0 );
 
-	double kT = 0.6;
+	double kT = m_kT;
 	double minE = 1e50;
 	int minIndex = 0;
 	double Z = 0;
@@ -785,26 +855,10 @@ FoldInfo* CompactLatticeFolder::fold( const Protein& s ) const
 	if (!valid) {
 		return new FoldInfo( false, false, 9999, -1);
 	}
-	/*cout << "ack " << s << endl;
-	for (int j=0; j<s.length(); j++) {
-		cout << aa_indices[j] << ' ';
-	}
-	cout << endl;
-	*/
-	for ( int i=0; i<m_num_structures; i++ ) {
-		double E = 0;
 
+	for ( int i=0; i<m_num_structures; i++ ) {
 		// calculate binding energy of this fold
-		const vector<Contact> &pair_list = m_structures[i]->getInteractingPairs();
-		vector<pair<int,int> >::const_iterator it=pair_list.begin();
-		for ( ; it!=pair_list.end(); it++ )
-		{
-			//cout << (*it).first << " " << (*it).second << endl;
-			assert((*it).first >0 && (*it).first <= aa_indices.size());
-			assert((*it).second >0 && (*it).second <= aa_indices.size());
-			double deltaE = contactEnergy(aa_indices[(*it).first-1], aa_indices[(*it).second-1]);
-			E += deltaE;
-		}
+		double E = calcEnergy( aa_indices, i );
 		// check if binding energy is lower than any previously calculated one
 		if ( E < minE )
 		{
@@ -814,38 +868,189 @@ FoldInfo* CompactLatticeFolder::fold( const Protein& s ) const
 		// add energy to partition sum
 		Z +=  exp(-E/kT);
 	}
-	//cout << "arg" << endl;
 	// calculate free energy of folding
 	G = minE + kT * log( Z - exp(-minE/kT) );
 
-	//cout <<  Z << " " << exp(-minE/kT) << " " << G << endl;
-	//cout << "Folding energy: " << minE << endl;
-	//cout << "Folding free energy: " << G << endl;
-
 	// increment folded count
-	m_num_folded += 1;
+	__sync_fetch_and_add( &m_num_folded, 1 );
 
 	return new FoldInfo( G<m_deltaG_cutoff, minIndex==m_target_sid, G, minIndex);
 }
 
-double CompactLatticeFolder::getEnergy(const Protein& p, StructureID sid) const {
-	const vector<Contact> &pair_list = m_structures[sid]->getInteractingPairs();
-	vector<Contact>::const_iterator it=pair_list.begin();
+StructureID CompactLatticeFolder::foldAtTemperatures( const Protein& s, const vector<double>& kTs, vector<double>& deltaGs ) const
+{
+	assert( m_num_structures > 0 );
+
+	deltaGs.assign( kTs.size(), 9999 );
+	vector<unsigned int> aa_indices(s.size());
+	if ( !getAminoAcidIndices(s, aa_indices) )
+		return -1;
+
+	vector<double> energies( m_num_structures );
+	for ( int i=0; i<m_num_structures; i++ )
+		energies[i] = calcEnergy( aa_indices, i );
+	StructureID min_index = min_element( energies.begin(), energies.end() ) - energies.begin();
+	double minE = energies[min_index];
+
+	// Partition sums of the unfolded states, relative to the minimum energy so that
+	// low temperatures don't underflow: dG = minE + kT log( sum exp(-E/kT) )
+	// = kT log( sum exp(-(E-minE)/kT) )
+	unsigned int n = kTs.size();
+	vector<double> beta( n ), Z( n, 0. );
+	for ( unsigned int t=0; t<n; t++ )
+		beta[t] = 1./kTs[t];
+	for ( int i=0; i<m_num_structures; i++ ) {
+		if ( i == min_index )
+			continue;
+		double dE = energies[i] - minE;
+		for ( unsigned int t=0; t<n; t++ )
+			Z[t] += exp( -dE*beta[t] );
+	}
+	for ( unsigned int t=0; t<n; t++ )
+		deltaGs[t] = kTs[t] * log( Z[t] );
+
+	// increment folded count
+	__sync_fetch_and_add( &m_num_folded, 1 );
+
+	return min_index;
+}
+
+double CompactLatticeFolder::calcEnergy( const vector<unsigned int>& aa_indices, StructureID sid ) const
+{
+	const ContactTable::Entry* it = m_contact_table.begin( sid );
+	const ContactTable::Entry* end = m_contact_table.end( sid );
 	double E = 0.0;
-	for ( ; it!=pair_list.end(); it++ ){
-		double deltaE = contactEnergy(p[(*it).first-1], p[(*it).second-1]);
-		E += deltaE;
-    }
+	for ( ; it!=end; it++ )
+	{
+		assert(it->first < aa_indices.size());
+		assert(it->second < aa_indices.size());
+		E += contactEnergy(aa_indices[it->first], aa_indices[it->second]);
+	}
 	return E;
 }
 
+double CompactLatticeFolder::getEnergy(const Protein& p, StructureID sid) const {
+	if ( sid < 0 || sid >= m_num_structures )
+		return CompactLatticeFolder::BAD_ENERGY;
+	vector<unsigned int> aa_indices(p.size());
+	getAminoAcidIndices(p, aa_indices);
+	return calcEnergy( aa_indices, sid );
+}
+
+bool CompactLatticeFolder::getEnergies(const Protein& p, const vector<StructureID>& sids, double* energies) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	for ( unsigned int i=0; i<sids.size(); i++ ) {
+		if ( sids[i] < 0 || sids[i] >= m_num_structures )
+			energies[i] = CompactLatticeFolder::BAD_ENERGY;
+		else
+			energies[i] = calcEnergy( aa_indices, sids[i] );
+	}
+	return true;
+}
+
+bool CompactLatticeFolder::getEnergies(const Protein& p, double* energies) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	for ( int i=0; i<m_num_structures; i++ )
+		energies[i] = calcEnergy( aa_indices, i );
+	return true;
+}
+
+bool CompactLatticeFolder::getSubstitutionEnergies(const Protein& p, StructureID sid, vector<double>& deltas) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	assert( sid >= 0 && sid < m_num_structures );
+	deltas.assign( 20*p.size(), 0. );
+	const ContactTable::Entry* it = m_contact_table.begin( sid );
+	const ContactTable::Entry* end = m_contact_table.end( sid );
+	for ( ; it!=end; it++ ) {
+		unsigned int aa1 = aa_indices[it->first];
+		unsigned int aa2 = aa_indices[it->second];
+		double E = contactEnergy( aa1, aa2 );
+		double* d1 = &deltas[20*it->first];
+		double* d2 = &deltas[20*it->second];
+		for ( unsigned int a=0; a<20; a++ ) {
+			d1[a] += contactEnergy( a, aa2 ) - E;
+			d2[a] += contactEnergy( aa1, a ) - E;
+		}
+	}
+	return true;
+}
+
+bool CompactLatticeFolder::boundStructureFreeEnergy( const FoldInfo& fi, StructureID sid, double cutoff, double& lo, double& hi ) const {
+	if ( cutoff > 0 || fi.getStructure() < 0 )
+		return false;
+	// fold() takes the partition sum of the unfolded states as the difference of two
+	// larger sums; relative to it, the rounding error grows as exp(-DeltaG/kT)
+	double eps = 4*( m_num_structures + 2 )*DBL_EPSILON;
+	if ( 2*m_kT*eps*( 1 + exp( -cutoff/m_kT ) ) > 1e-7 )
+		return false;
+	double dG = fi.getDeltaG();
+	double u = eps*( 1 + exp( -dG/m_kT ) );
+	double dG_lo = u < 0.5 ? dG + m_kT*log( 1 - u ) : -HUGE_VAL;
+	double dG_hi = dG + m_kT*log1p( u );
+	if ( fi.getStructure() == sid ) {
+		lo = dG_lo;
+		hi = dG_hi;
+	}
+	else {
+		lo = max( 0., -dG_hi );
+		hi = HUGE_VAL;
+	}
+	return true;
+}
+
+bool CompactLatticeFolder::boundResidueChange( const Protein& p, unsigned int site, char new_aa, StructureID sid, double& lo, double& hi ) const {
+	int new_index = GeneticCodeUtil::aminoAcidLetterToIndex( new_aa );
+	vector<unsigned int> aa_indices( p.size() );
+	if ( p.size() != m_site_partners.size() || site >= p.size() || sid < 0 || sid >= m_num_structures
+		 || new_index < 0 || !getAminoAcidIndices( p, aa_indices ) )
+		return false;
+	unsigned int old_index = aa_indices[site];
+
+	// the energy change in sid, and the range of the changes in all structures
+	double delta_sid = 0;
+	const ContactTable::Entry* it = m_contact_table.begin( sid );
+	const ContactTable::Entry* end = m_contact_table.end( sid );
+	for ( ; it!=end; it++ ) {
+		if ( it->first == site )
+			delta_sid += contactEnergy( new_index, aa_indices[it->second] ) - contactEnergy( old_index, aa_indices[it->second] );
+		else if ( it->second == site )
+			delta_sid += contactEnergy( aa_indices[it->first], new_index ) - contactEnergy( aa_indices[it->first], old_index );
+	}
+	// (the contact energies are symmetric, so the order of the contact doesn't matter)
+	double min_delta = HUGE_VAL;
+	double max_delta = -HUGE_VAL;
+	const vector<vector<unsigned int> >& partner_sets = m_site_partners[site];
+	for ( unsigned int k=0; k<partner_sets.size(); k++ ) {
+		double delta = 0;
+		for ( unsigned int j=0; j<partner_sets[k].size(); j++ ) {
+			unsigned int aa = aa_indices[partner_sets[k][j]];
+			delta += contactEnergy( new_index, aa ) - contactEnergy( old_index, aa );
+		}
+		min_delta = min( min_delta, delta );
+		max_delta = max( max_delta, delta );
+	}
+
+	// G_sid changes by delta_sid minus a Boltzmann average of the changes of the other structures
+	lo = delta_sid - max_delta;
+	hi = delta_sid - min_delta;
+	return true;
+}
+
 void CompactLatticeFolder::getMinMaxPartitionContributions(const Protein& p, const int ci, double& cmin, double& cmax) const {
-	double kT = 0.6;
+	double kT = m_kT;
 	double min_cont = 1e5;
 	double max_cont = -1e5;
+	vector<unsigned int> aa_indices(p.size());
+	getAminoAcidIndices(p, aa_indices);
 	for (int i=0; i<m_size*m_size-3; i++) {
 		for (int j=i+3; j<m_size*m_size; j++) {
-			double e = contactEnergy(p[i], p[j]);
+			double e = contactEnergy(aa_indices[i], aa_indices[j]);
 			if (e < min_cont) {
 				min_cont = e;
 			}
@@ -865,10 +1070,12 @@ bool CompactLatticeFolder::isFoldedBelowThreshold( const Protein& p, const int s
 {
 	assert( m_num_structures > 0 );
 
-	double kT = 0.6;
+	double kT = m_kT;
 	double Zu = 0;
 
-	double Ef = getEnergy(p, structID);
+	vector<unsigned int> aa_indices(p.size());
+	getAminoAcidIndices(p, aa_indices);
+	double Ef = calcEnergy(aa_indices, structID);
 	double Zf = exp(-Ef/kT);
 	double Zcutoff = Zf*exp(cutoff/kT);
 
@@ -882,7 +1089,7 @@ bool CompactLatticeFolder::isFoldedBelowThreshold( const Protein& p, const int s
 		if (ci != structID) {
 			rep_count++;
 			// calculate binding energy of this fold
-			double E = getEnergy(p, ci);
+			double E = calcEnergy(aa_indices, ci);
 			// bail out if structID is not the minimum-energy structure.
 			if (E<=Ef) {
 				//cout << "E <= Ef" << endl;
@@ -941,5 +1148,33 @@ void CompactLatticeFolder::printStructure( int id, ostream& os, const char* pref
 	if ( id < 0 || id >= m_num_structures )
 		return;
 
-	m_structures[id]->draw(os, prefix);
+	if ( m_structures.empty() )
+		LatticeStructure( m_contact_table.getRecord( id ), m_size ).draw(os, prefix);
+	else
+		m_structures[id]->draw(os, prefix);
+}
+
+LatticeStructure* CompactLatticeFolder::getStructure( StructureID sid ) const
+{
+	if ( sid < 0 || sid >= m_num_structures )
+		return NULL;
+	if ( !m_structures.empty() )
+		return m_structures[sid];
+
+	// build the structure from the drawing stored with the shared contact table
+	pthread_mutex_lock( &m_shared_structures_mutex );
+	if ( m_shared_structures.empty() )
+		m_shared_structures.assign( m_num_structures, 0 );
+	if ( !m_shared_structures[sid] )
+		m_shared_structures[sid] = new LatticeStructure( m_contact_table.getRecord( sid ), m_size );
+	LatticeStructure* structure = m_shared_structures[sid];
+	pthread_mutex_unlock( &m_shared_structures_mutex );
+	return structure;
+}
+
+vector<int> CompactLatticeFolder::getSurface( int id ) const
+{
+	if ( m_structures.empty() )
+		return LatticeStructure( m_contact_table.getRecord( id ), m_size ).getSurface();
+	return m_structures[id]->getSurface();
 }
@@ -25,9 +25,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include <vector>
 #include <cstring>
 #include <iostream>
+#include <pthread.h>
 
 #include "folder.hh"
 #include "protein-contact-energies.hh"
+#include "contact-table.hh"
 
 // uncomment next line for older versions of gcc
 //#include < unordered_map>
@@ -153,6 +155,19 @@ struct eqstr {
 	}
 };
 
+/**
+ * Needed for the structure map in StructureBank. Hashes the contents
+ * of the string, not the pointer.
+ **/
+struct hashstr {
+	size_t operator()(const char* s) const {
+		size_t h = 0;
+		for ( ; *s; s++ )
+			h = 5*h + *s;
+		return h;
+	}
+};
+
 /**
  * Needed for the structure map in StructureBank.
  **/
@@ -166,20 +181,26 @@ struct ltstr {
 class CompactLatticeFolder : public DGCutoffFolder {
 private:
 	// some useful typedefs
-	typedef  unordered_map<const char*, int, hash<const char*>, eqstr> StructureMap;
-	typedef  unordered_map<const char*, int, hash<const char*>, eqstr>::iterator StructureMapIterator;
-	typedef  unordered_map<const char*, int, hash<const char*>, eqstr>::const_iterator StructureMapConstIterator;
+	typedef  unordered_map<const char*, int, hashstr, eqstr> StructureMap;
+	typedef  unordered_map<const char*, int, hashstr, eqstr>::iterator StructureMapIterator;
+	typedef  unordered_map<const char*, int, hashstr, eqstr>::const_iterator StructureMapConstIterator;
 
 	// the contact energies between residues
 //	static const double contactEnergies[20][20];
 	// the size of the square lattice (protein length is size^2)
 	const int m_size;
-	// the number of proteins folded
+	// the temperature (in units of the contact energies)
+	const double m_kT;
+	// the number of proteins folded; incremented atomically, so that proteins can be folded concurrently
 	mutable int m_num_folded;
 
 	int m_num_structures; // total number of structures
-	vector<LatticeStructure *> m_structures; // list of all potential structures
+	vector<LatticeStructure *> m_structures; // list of all potential structures (empty if the contact table is shared)
+	mutable vector<LatticeStructure *> m_shared_structures; // structures built from the shared contact table by getStructure(), or NULL
+	mutable pthread_mutex_t m_shared_structures_mutex; // protects m_shared_structures
 	StructureMap m_structure_map; // lookup table for structures
+	ContactTable m_contact_table; // the contacts of all structures, used for folding
+	vector<vector<vector<unsigned int> > > m_site_partners; // for each site, the distinct sets of sites it contacts in some structure
 
 	char * m_ffw_struct;  // variable used by findFillingWalk();
 	char * m_ss_struct; // variable used by storeStructure();
@@ -193,6 +214,17 @@ protected:
 	bool findStructure( const char*s );
 	void storeStructure( const char* s );
 	void enumerateStructures();
+	void buildContactTable();
+	void releaseStructures();
+	void findSitePartners();
+	/**
+	* Calculates the contact energy of a sequence in one structure.
+	*
+	* @param aa_indices The amino-acid indices of the sequence.
+	* @param sid The structure ID.
+	* @return The contact energy.
+	**/
+	double calcEnergy( const vector<unsigned int>& aa_indices, StructureID sid ) const;
 	/**
 	* Wrapper function to encapsulate the lookup of the
 	* contact energy from a table.
@@ -207,14 +239,30 @@ protected:
 	//return ProteinContactEnergies::MJ85TableVI[residue1][residue2]; }
 
 public:
-	CompactLatticeFolder( int size, double deltaG_cutoff = 0, StructureID target_sid = -1 );
+	// Constants
+	static double BAD_ENERGY;
+
+	/**
+	 * Creates a folder for proteins of length size*size.
+	 *
+	 * @param size The side length of the lattice.
+	 * @param deltaG_cutoff The DeltaG cutoff, as in \ref DGCutoffFolder.
+	 * @param target_sid The target structure ID, as in \ref DGCutoffFolder.
+	 * @param kT The temperature at which proteins are folded.
+	 * @param shared_table If not empty, the name of a shared-memory segment or file
+	 * (see \ref SharedSegment) in which the table of structures is shared with other
+	 * processes. The first process to use the name enumerates the structures and
+	 * stores them there; all other processes attach to the table read-only and skip
+	 * the enumeration. The segment is not removed when the folder is destroyed.
+	 **/
+	CompactLatticeFolder( int size, double deltaG_cutoff = 0, StructureID target_sid = -1, double kT = 0.6, const string& shared_table = "" );
 	virtual ~CompactLatticeFolder();
 
 	/**
 	This function assesses whether the folder has been properly initialized.
 	@return True if the folder is in good working order, False otherwise.
 	 **/
-	virtual bool good() const { return m_structures.size() > 0; }
+	virtual bool good() const { return m_contact_table.getNumStructures() > 0; }
 
 	/**
 	 * Folds a protein. See Folder::fold() for details.
@@ -223,36 +271,76 @@ public:
 	 * @return The folding information (of type DecoyFoldInfo).
 	 **/
 	virtual FoldInfo* fold( const Protein& p ) const;
+
+	/**
+	 * Folds a protein at several temperatures at once. The energies of all
+	 * structures are calculated only once, and the partition sums for all
+	 * temperatures are accumulated in a single pass over them. The temperature
+	 * the folder was created with is not used.
+	 *
+	 * @param p The sequence to be folded.
+	 * @param kTs The temperatures.
+	 * @param deltaGs Set to the free energies of folding, one per temperature.
+	 * @return The minimum-energy structure, or -1 if the sequence cannot be folded
+	 * (in which case all free energies are set to 9999).
+	 **/
+	StructureID foldAtTemperatures( const Protein& p, const vector<double>& kTs, vector<double>& deltaGs ) const;
 	bool isFoldedBelowThreshold( const Protein &s, const int structID, double cutoff) const;
 	void getMinMaxPartitionContributions(const Protein& s, const int ci, double& cmin, double& cmax) const;
 	/**
 	 * @param s The sequence whose energy is sought.
 	 * @param sid The structure ID of the target conformation.
-	 * @return The contact energy of a sequence in the target conformation.
+	 * @return The contact energy of a sequence in the target conformation, or
+	 * \ref BAD_ENERGY if sid is out of range.
 	 **/
 	virtual double getEnergy(const Protein& s, StructureID sid) const;
+	/**
+	 * Calculates the contact energies of a protein in several structures.
+	 * See \ref DGCutoffFolder::getEnergies() for details. Structure IDs out of
+	 * range yield \ref BAD_ENERGY.
+	 **/
+	virtual bool getEnergies(const Protein& p, const vector<StructureID>& sids, double* energies) const;
+	virtual bool getEnergies(const Protein& p, double* energies) const;
+	/**
+	 * Calculates the energy changes of all single substitutions in one pass over the
+	 * contacts of the structure. See \ref DGCutoffFolder::getSubstitutionEnergies().
+	 **/
+	virtual bool getSubstitutionEnergies(const Protein& p, StructureID sid, vector<double>& deltas) const;
+
+	/**
+	 * Bounds G_sid(p) = E_sid(p) + kT log( sum over all structures k != sid of exp(-E_k(p)/kT) ),
+	 * which is the DeltaG of \ref fold() if sid is the minimum-energy structure, and
+	 * at least max(0, -DeltaG) otherwise. For a cutoff <= 0, p folds into sid with a
+	 * DeltaG below the cutoff exactly when G_sid(p) is below it. The bounds allow for
+	 * the rounding errors of the partition sum in fold(). See
+	 * \ref ProteinFolder::boundStructureFreeEnergy() for details.
+	 * @return False for positive cutoffs, and for cutoffs so low that fold() can't decide
+	 * them reliably.
+	 **/
+	virtual bool boundStructureFreeEnergy( const FoldInfo& fi, StructureID sid, double cutoff, double& lo, double& hi ) const;
+	/**
+	 * Bounds the change of G_sid(p) (see \ref boundStructureFreeEnergy()) when one
+	 * residue of p is changed. The energy of p in a structure changes by an amount
+	 * that depends only on the sites that contact the changed one there, so the
+	 * bounds follow from the distinct sets of such sites, without a pass over all
+	 * structures. See \ref ProteinFolder::boundResidueChange() for details.
+	 **/
+	virtual bool boundResidueChange( const Protein& p, unsigned int site, char new_aa, StructureID sid, double& lo, double& hi ) const;
 
 	void printContactEnergyTable( ostream &s ) const;
 	void printStructure( int id, ostream& os, const char* prefix ) const;
-	vector<int> getSurface( int id ) const
-	{
-		return m_structures[id]->getSurface();
-	}
+	vector<int> getSurface( int id ) const;
 
 	/**
 	Provides access to the LatticeStructure corresponding to a given StructureID .
         \warning Usage of the returned pointer is potentially unsafe, because
         the pointer will become invalid upon destruction of the CompactLatticeFolder object.
-	\return A pointer to the corresponding LatticeStructure.
+	If the folder uses a shared table of structures, the structure is built from its
+	record in the table the first time it is asked for, and kept until the folder
+	is destroyed. Can be called concurrently.
+	\return A pointer to the corresponding LatticeStructure, or NULL if sid is out of range.
 	*/
-	LatticeStructure* getStructure( StructureID sid ) const {
-		if (sid >= 0 && sid < m_num_structures) {
-			return m_structures[sid];
-		}
-		else {
-			return NULL;
-		}
-	}
+	LatticeStructure* getStructure( StructureID sid ) const;
 
 	/**
 	@return The number of proteins that have been folded so far with this Folder instance.
@@ -260,10 +348,16 @@ public:
 	uint getNumFolded() const {
 		return m_num_folded;
 	}
+	/**
+	 @return The temperature at which proteins are folded.
+	 **/
+	double getkT() const {
+		return m_kT;
+	}
 	/**
 	 @return The number of structures into which sequences can fold.
 	 **/
-	uint getNumStructures() const {
+	virtual uint getNumStructures() const {
 		return m_num_structures;
 	}
 };
@@ -0,0 +1,216 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "contact-table.hh"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+
+// Header of the serialized table. All sizes are in units of elements.
+struct ContactTableHeader {
+	char magic[8];
+	unsigned int key;
+	unsigned int num_structures;
+	unsigned int record_size;
+	unsigned int reserved;
+	unsigned long long num_contacts;
+};
+
+static const char* CONTACT_TABLE_MAGIC = "EVCTAB01";
+
+
+ContactTable::ContactTable( unsigned int key, unsigned int record_size )
+	: m_offsets( 0 ), m_contacts( 0 ), m_records( 0 ), m_num_structures( 0 ),
+	m_record_size( record_size ), m_key( key ), m_segment( 0 )
+{
+	clear();
+}
+
+ContactTable::~ContactTable()
+{
+	delete m_segment;
+}
+
+void ContactTable::updatePointers()
+{
+	m_offsets = &m_offset_store[0];
+	m_contacts = m_contact_store.empty() ? 0 : &m_contact_store[0];
+	m_records = m_record_store.empty() ? 0 : &m_record_store[0];
+	m_num_structures = m_offset_store.size() - 1;
+}
+
+void ContactTable::clear()
+{
+	vector<unsigned int>( 1, 0 ).swap( m_offset_store );
+	vector<Entry>().swap( m_contact_store );
+	vector<char>().swap( m_record_store );
+	updatePointers();
+}
+
+bool ContactTable::addStructure( const vector<Contact>& contacts, int offset, const char* record )
+{
+	assert( !isShared() );
+	bool ok = true;
+	vector<Contact>::const_iterator it = contacts.begin();
+	for ( ; it != contacts.end(); it++ ) {
+		int r1 = (*it).first - offset;
+		int r2 = (*it).second - offset;
+		if ( r1 < 0 || r2 < 0 || r1 > 65535 || r2 > 65535 ) {
+			ok = false;
+			continue;
+		}
+		Entry e;
+		e.first = r1;
+		e.second = r2;
+		m_contact_store.push_back( e );
+	}
+	m_offset_store.push_back( m_contact_store.size() );
+	if ( m_record_size > 0 ) {
+		size_t pos = m_record_store.size();
+		m_record_store.resize( pos + m_record_size, 0 );
+		if ( record )
+			memcpy( &m_record_store[pos], record, m_record_size );
+	}
+	updatePointers();
+	return ok;
+}
+
+size_t ContactTable::getSerializedSize() const
+{
+	return sizeof( ContactTableHeader ) + ( m_num_structures + 1 )*sizeof( unsigned int )
+		+ getNumContacts()*sizeof( Entry ) + (size_t) m_num_structures*m_record_size;
+}
+
+void ContactTable::serialize( char* dest ) const
+{
+	ContactTableHeader h;
+	memcpy( h.magic, CONTACT_TABLE_MAGIC, 8 );
+	h.key = m_key;
+	h.num_structures = m_num_structures;
+	h.record_size = m_record_size;
+	h.reserved = 0;
+	h.num_contacts = getNumContacts();
+	memcpy( dest, &h, sizeof( h ) );
+	dest += sizeof( h );
+	memcpy( dest, m_offsets, ( m_num_structures + 1 )*sizeof( unsigned int ) );
+	dest += ( m_num_structures + 1 )*sizeof( unsigned int );
+	memcpy( dest, m_contacts, getNumContacts()*sizeof( Entry ) );
+	dest += getNumContacts()*sizeof( Entry );
+	memcpy( dest, m_records, (size_t) m_num_structures*m_record_size );
+}
+
+bool ContactTable::attach( const char* src, size_t size )
+{
+	if ( size < sizeof( ContactTableHeader ) )
+		return false;
+	ContactTableHeader h;
+	memcpy( &h, src, sizeof( h ) );
+	if ( memcmp( h.magic, CONTACT_TABLE_MAGIC, 8 ) != 0 || h.key != m_key || h.record_size != m_record_size )
+		return false;
+	size_t expected = sizeof( h ) + ( h.num_structures + 1 )*sizeof( unsigned int )
+		+ h.num_contacts*sizeof( Entry ) + (size_t) h.num_structures*h.record_size;
+	if ( expected != size )
+		return false;
+
+	vector<unsigned int>().swap( m_offset_store );
+	vector<Entry>().swap( m_contact_store );
+	vector<char>().swap( m_record_store );
+	src += sizeof( h );
+	m_offsets = (const unsigned int*) src;
+	src += ( h.num_structures + 1 )*sizeof( unsigned int );
+	m_contacts = (const Entry*) src;
+	src += h.num_contacts*sizeof( Entry );
+	m_records = src;
+	m_num_structures = h.num_structures;
+	return true;
+}
+
+ContactTable::SharedState ContactTable::openShared( const string& name )
+{
+	delete m_segment;
+	m_segment = new SharedSegment();
+	m_shared_name = name;
+	bool attached = m_segment->attach( name );
+	if ( !attached && m_segment->removeStale( name ) )
+		cout << "# Warning: removed shared table " << name << ", which a process that exited left unfinished." << endl;
+	if ( !attached ) {
+		if ( m_segment->create( name ) )
+			return MUST_BUILD;
+		// another process created the segment in the meantime
+		attached = m_segment->attach( name );
+	}
+	if ( attached && attach( m_segment->data(), m_segment->size() ) )
+		return ATTACHED;
+
+	if ( attached )
+		cout << "# Warning: shared table " << name << " was built for a different problem; using a private table." << endl;
+	else
+		cout << "# Warning: cannot open shared table " << name << "; using a private table." << endl;
+	delete m_segment;
+	m_segment = 0;
+	clear();
+	return UNSHARED;
+}
+
+bool ContactTable::publishShared()
+{
+	assert( m_segment && !m_segment->good() );
+	size_t size = getSerializedSize();
+	char* p = m_segment->allocate( size );
+	if ( !p ) {
+		cout << "# Warning: cannot write shared table " << m_shared_name << "; using a private table." << endl;
+		// remove the empty segment, so that waiting processes don't block
+		SharedSegment::remove( m_shared_name );
+		delete m_segment;
+		m_segment = 0;
+		return false;
+	}
+	serialize( p );
+	m_segment->publish();
+	bool ok = attach( m_segment->data(), m_segment->size() );
+	assert( ok );
+	return ok;
+}
+
+bool ContactTable::writeFile( const string& filename ) const
+{
+	vector<char> buffer( getSerializedSize() );
+	serialize( &buffer[0] );
+	ofstream fout( filename.c_str(), ios::binary );
+	fout.write( &buffer[0], buffer.size() );
+	return fout.good();
+}
+
+bool ContactTable::mapFile( const string& filename )
+{
+	delete m_segment;
+	m_segment = new SharedSegment();
+	m_shared_name = filename;
+	if ( m_segment->mapFile( filename ) && attach( m_segment->data(), m_segment->size() ) )
+		return true;
+
+	cout << "# Warning: cannot map contact table " << filename << endl;
+	delete m_segment;
+	m_segment = 0;
+	clear();
+	return false;
+}
@@ -0,0 +1,167 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#ifndef CONTACT_TABLE_HH
+#define CONTACT_TABLE_HH
+
+#include <vector>
+#include <string>
+
+#include "folder.hh"
+#include "shared-segment.hh"
+
+using namespace std;
+
+/** \brief A flat, read-only table of the contacts of a set of structures.
+
+The contacts of structure i are the entries begin(i) to end(i)-1, stored as pairs
+of 0-based residue indices. Optionally, each structure carries a fixed-size record
+of additional data (e.g., the drawing of a lattice structure).
+
+The table either owns its storage, or it refers to memory owned by a
+\ref SharedSegment, so that several processes can fold with the same physical copy
+of the table. The serialized form (see \ref serialize()) is position-independent:
+a header, the per-structure offsets, the contact pairs, and the records.
+*/
+class ContactTable {
+public:
+	/**
+	A contact between two residues, as 0-based residue indices.
+	*/
+	struct Entry {
+		unsigned short first;
+		unsigned short second;
+	};
+
+	/**
+	Result of \ref openShared().
+	*/
+	enum SharedState {
+		ATTACHED, ///< The table now refers to an existing shared segment.
+		MUST_BUILD, ///< This process created the segment; build the table and call \ref publishShared().
+		UNSHARED ///< Sharing failed; build a private table.
+	};
+
+private:
+	vector<unsigned int> m_offset_store;
+	vector<Entry> m_contact_store;
+	vector<char> m_record_store;
+
+	const unsigned int* m_offsets;
+	const Entry* m_contacts;
+	const char* m_records;
+	unsigned int m_num_structures;
+	unsigned int m_record_size;
+	unsigned int m_key;
+
+	SharedSegment* m_segment;
+	string m_shared_name;
+
+	ContactTable( const ContactTable & );
+	const ContactTable & operator=( const ContactTable & );
+
+	void updatePointers();
+
+public:
+	/**
+	@param key A number that identifies the problem the table was built for (e.g.,
+	the lattice size). Tables with different keys are never attached to each other.
+	@param record_size Number of bytes of additional data per structure.
+	*/
+	ContactTable( unsigned int key = 0, unsigned int record_size = 0 );
+	~ContactTable();
+
+	/**
+	Appends a structure to a privately owned table.
+	@param contacts The contacts of the structure.
+	@param offset Number that is subtracted from each residue number, to make it 0-based.
+	@param record Additional data of the structure (record_size bytes), or NULL.
+	@return False if a residue number does not fit into the table.
+	*/
+	bool addStructure( const vector<Contact>& contacts, int offset = 0, const char* record = 0 );
+
+	/**
+	Releases all structures.
+	*/
+	void clear();
+
+	unsigned int getNumStructures() const { return m_num_structures; }
+	size_t getNumContacts() const { return m_num_structures ? m_offsets[m_num_structures] : 0; }
+	unsigned int getKey() const { return m_key; }
+
+	const Entry* begin( unsigned int sid ) const { return m_contacts + m_offsets[sid]; }
+	const Entry* end( unsigned int sid ) const { return m_contacts + m_offsets[sid+1]; }
+	const char* getRecord( unsigned int sid ) const { return m_records + (size_t) sid*m_record_size; }
+
+	/**
+	@return True if the table refers to memory of a shared segment or a mapped file.
+	*/
+	bool isShared() const { return m_segment != 0 && m_segment->good(); }
+
+	/**
+	@return Number of bytes needed by \ref serialize().
+	*/
+	size_t getSerializedSize() const;
+
+	/**
+	Writes the table into a block of getSerializedSize() bytes.
+	*/
+	void serialize( char* dest ) const;
+
+	/**
+	Makes the table refer to a serialized table, without copying. The memory must
+	remain valid for the lifetime of the table.
+	@return False if the memory does not hold a valid table with matching key and record size.
+	*/
+	bool attach( const char* src, size_t size );
+
+	/**
+	Attaches to the shared segment of the given name, or creates it if no
+	other process has done so yet. A segment left unpublished by a creator that
+	exited is removed and created anew. The segment outlives this process; see
+	\ref SharedSegment for the naming rules and for how segments are removed.
+	*/
+	SharedState openShared( const string& name );
+
+	/**
+	Copies a privately built table into the segment created by \ref openShared(),
+	publishes the segment and releases the private copy.
+	@return False if the segment could not be written; the private table is kept.
+	*/
+	bool publishShared();
+
+	/**
+	Writes the serialized table to a file (see \ref serialize()), which can later
+	be mapped with \ref mapFile().
+	@return False if the file could not be written.
+	*/
+	bool writeFile( const string& filename ) const;
+
+	/**
+	Makes the table refer to a file written by \ref writeFile(), mapped read-only
+	into memory. Nothing is parsed or copied, and processes that map the same file
+	share its pages.
+	@return False if the file could not be mapped or does not hold a matching table;
+	the table is then empty.
+	*/
+	bool mapFile( const string& filename );
+};
+
+#endif // CONTACT_TABLE_HH
@@ -22,10 +22,38 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "decoy-contact-folder.hh"
 #include <fstream>
 #include <cmath>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/time.h>
 #include "genetic-code.hh"
 
 double DecoyContactFolder::BAD_ENERGY = 999999.0;
 
+// number of consecutive decoys that are evaluated together; results depend on it
+#define DECOY_CHUNK_SIZE 512
+
+
+/**
+ * Evaluates the chunks of decoys of one fold on a thread pool.
+ **/
+class DecoyContactFolder::EnergyTask : public ThreadTask {
+private:
+	const DecoyContactFolder& m_folder;
+	const vector<unsigned int>& m_aa_indices;
+	vector<EnergyStats>& m_stats;
+	double* m_energies;
+	const unsigned int* m_chunks; ///< The chunk of each item, or NULL if items are chunks.
+
+public:
+	EnergyTask( const DecoyContactFolder& folder, const vector<unsigned int>& aa_indices, vector<EnergyStats>& stats, double* energies, const unsigned int* chunks = 0 )
+		: m_folder( folder ), m_aa_indices( aa_indices ), m_stats( stats ), m_energies( energies ), m_chunks( chunks ) {}
+
+	void run( unsigned int item ) {
+		unsigned int chunk = m_chunks ? m_chunks[item] : item;
+		m_folder.calcChunk( m_aa_indices, chunk, m_stats[chunk], m_energies );
+	}
+};
+
 void DecoyContactStructure::read(istream& fin) {
 	int r1, r2;
 	string r1aa, r2aa;
@@ -53,149 +81,673 @@ int DecoyContactStructure::getMaxResidueNumber() {
 	return max_res;
 }
 
-DecoyContactFolder::DecoyContactFolder(int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaGCutoff, StructureID targetSID)
-	: DGCutoffFolder( deltaGCutoff, targetSID )
+DecoyContactFolder::DecoyContactFolder(int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaGCutoff, StructureID targetSID, double kT)
+	: DGCutoffFolder( deltaGCutoff, targetSID ), m_kT( kT ), m_contact_table( length ),
+	m_thread_pool( 0 )
 {
 	m_length = length;
 	m_structures = structs;
+	double start = ContactMapUtil::getWallTime();
+	buildContactTable( m_structures );
+	indexDecoys();
+	m_load_times.build = ContactMapUtil::getWallTime() - start;
 	m_log_num_conformations = log_num_confs;
 	m_num_folded = 0;
 }
 
-DecoyContactFolder::DecoyContactFolder(int length, double log_num_confs, ifstream& fin, const string& dir, double deltaGCutoff, StructureID targetSID )
-	: DGCutoffFolder( deltaGCutoff, targetSID ), m_structures(0)
+DecoyContactFolder::DecoyContactFolder(int length, double log_num_confs, ifstream& fin, const string& dir, double deltaGCutoff, StructureID targetSID, double kT, const string& shared_table, unsigned int num_threads )
+	: DGCutoffFolder( deltaGCutoff, targetSID ), m_kT( kT ), m_contact_table( length ),
+	m_thread_pool( 0 )
 {
 	m_length = length;
 	m_log_num_conformations = log_num_confs;
-	ContactMapUtil::readContactMapsFromFile(fin, dir, m_structures);
-	//cout << "# structures = " << m_structures.size() << endl;
+
+	ContactTable::SharedState state = ContactTable::UNSHARED;
+	if ( !shared_table.empty() )
+		state = m_contact_table.openShared( shared_table );
+
+	vector<DecoyContactStructure*> structs;
+	if ( state != ContactTable::ATTACHED )
+		ContactMapUtil::readContactMapsFromFile(fin, dir, structs, num_threads, &m_load_times);
+	double start = ContactMapUtil::getWallTime();
+	if ( state != ContactTable::ATTACHED ) {
+		buildContactTable( structs );
+		if ( state == ContactTable::MUST_BUILD )
+			m_contact_table.publishShared();
+	}
+	// the contact table holds all contacts that are needed
+	vector<DecoyContactStructure*>::iterator it = structs.begin();
+	for ( ; it != structs.end(); it++)
+		delete *it;
+	indexDecoys();
+	m_load_times.build = ContactMapUtil::getWallTime() - start;
+	//cout << "# structures = " << m_contact_table.getNumStructures() << endl;
 	//cout << "# lognumconfs = " << log_num_confs << endl;
 	m_num_folded = 0;
 }
 
+DecoyContactFolder::DecoyContactFolder(int length, double log_num_confs, const string& packed_file, double deltaGCutoff, StructureID targetSID, double kT )
+	: DGCutoffFolder( deltaGCutoff, targetSID ), m_kT( kT ), m_contact_table( length ),
+	m_thread_pool( 0 )
+{
+	m_length = length;
+	m_log_num_conformations = log_num_confs;
+	double start = ContactMapUtil::getWallTime();
+	m_contact_table.mapFile( packed_file );
+	indexDecoys();
+	m_load_times.build = ContactMapUtil::getWallTime() - start;
+	m_num_folded = 0;
+}
+
 DecoyContactFolder::~DecoyContactFolder() {
+	delete m_thread_pool;
 	vector<DecoyContactStructure*>::iterator it = m_structures.begin();
 	for ( ; it != m_structures.end(); it++) {
 		delete *it;
 	}
 }
 
+void DecoyContactFolder::buildContactTable( const vector<DecoyContactStructure*>& structs ) {
+	m_contact_table.clear();
+	vector<Contact> contacts;
+	vector<DecoyContactStructure*>::const_iterator it = structs.begin();
+	for ( ; it != structs.end(); it++) {
+		// contacts beyond the end of the protein never contribute to the energy
+		contacts.clear();
+		const vector<Contact>& all = (*it)->getContacts();
+		vector<Contact>::const_iterator cit = all.begin();
+		for ( ; cit != all.end(); cit++ ) {
+			if ( (*cit).first < m_length && (*cit).second < m_length )
+				contacts.push_back( *cit );
+		}
+		if ( !m_contact_table.addStructure( contacts ) )
+			cout << "# Warning: residue number out of range in contact map; contact ignored." << endl;
+	}
+}
+
+void DecoyContactFolder::indexDecoys() {
+	m_nonempty_sids.clear();
+	for ( unsigned int sid = 0; sid < m_contact_table.getNumStructures(); sid++) {
+		if ( m_contact_table.begin( sid ) != m_contact_table.end( sid ) )
+			m_nonempty_sids.push_back( sid );
+	}
+	m_chunk_nonempty.assign( 1, 0 );
+	for ( unsigned int c = 0; c < getNumChunks(); c++ ) {
+		StructureID end = ( c+1 )*DECOY_CHUNK_SIZE;
+		m_chunk_nonempty.push_back( lower_bound( m_nonempty_sids.begin(), m_nonempty_sids.end(), end ) - m_nonempty_sids.begin() );
+	}
+
+	// count the decoys of each residue, then fill them in decoy order
+	m_residue_offsets.assign( m_length+1, 0 );
+	vector<int> last( m_length, -1 );
+	for ( unsigned int sid = 0; sid < m_contact_table.getNumStructures(); sid++) {
+		for ( const ContactTable::Entry* it = m_contact_table.begin( sid ); it != m_contact_table.end( sid ); it++ ) {
+			unsigned int residues[2] = { it->first, it->second };
+			for ( int r = 0; r < 2; r++ ) {
+				if ( last[residues[r]] != (int) sid ) {
+					last[residues[r]] = sid;
+					m_residue_offsets[residues[r]+1] += 1;
+				}
+			}
+		}
+	}
+	for ( int i=0; i<m_length; i++ )
+		m_residue_offsets[i+1] += m_residue_offsets[i];
+	m_residue_decoys.resize( m_residue_offsets[m_length] );
+	vector<unsigned int> fill( m_residue_offsets.begin(), m_residue_offsets.end()-1 );
+	last.assign( m_length, -1 );
+	for ( unsigned int sid = 0; sid < m_contact_table.getNumStructures(); sid++) {
+		for ( const ContactTable::Entry* it = m_contact_table.begin( sid ); it != m_contact_table.end( sid ); it++ ) {
+			unsigned int residues[2] = { it->first, it->second };
+			for ( int r = 0; r < 2; r++ ) {
+				if ( last[residues[r]] != (int) sid ) {
+					last[residues[r]] = sid;
+					m_residue_decoys[fill[residues[r]]++] = sid;
+				}
+			}
+		}
+	}
+
+	// count the contact partners of each residue in each of its decoys, then fill
+	// them in; slot[i] is the entry of the current decoy of residue i
+	m_partner_offsets.assign( m_residue_decoys.size()+1, 0 );
+	vector<unsigned int> slot( m_length );
+	for ( int pass = 0; pass < 2; pass++ ) {
+		copy( m_residue_offsets.begin(), m_residue_offsets.end()-1, slot.begin() );
+		for ( unsigned int sid = 0; sid < m_contact_table.getNumStructures(); sid++) {
+			for ( const ContactTable::Entry* it = m_contact_table.begin( sid ); it != m_contact_table.end( sid ); it++ ) {
+				unsigned int residues[2] = { it->first, it->second };
+				for ( int r = 0; r < ( it->first == it->second ? 1 : 2 ); r++ ) {
+					unsigned int& k = slot[residues[r]];
+					if ( m_residue_decoys[k] != (StructureID) sid )
+						k++;
+					if ( pass == 0 )
+						m_partner_offsets[k+1] += 1;
+					else
+						m_residue_partners[fill[k]++] = residues[1-r];
+				}
+			}
+		}
+		if ( pass == 0 ) {
+			for ( unsigned int k=0; k<m_residue_decoys.size(); k++ )
+				m_partner_offsets[k+1] += m_partner_offsets[k];
+			m_residue_partners.resize( m_partner_offsets.back() );
+			fill.assign( m_partner_offsets.begin(), m_partner_offsets.end()-1 );
+		}
+	}
+}
+
 bool DecoyContactFolder::good() const {
-	return m_structures.size() > 0;
+	return m_contact_table.getNumStructures() > 0;
 }
 
 
 
-double DecoyContactFolder::getEnergy(const Protein& s, StructureID sid) const {
+double DecoyContactFolder::calcEnergy( const vector<unsigned int>& aa_indices, StructureID sid ) const {
 	double G = 0;
-	if (sid >= m_structures.size()) {
+	const ContactTable::Entry* it = m_contact_table.begin( sid );
+	const ContactTable::Entry* end = m_contact_table.end( sid );
+	for ( ; it!=end; it++ )
+		G += contactEnergy( aa_indices[it->first], aa_indices[it->second] );
+	return G;
+}
+
+double DecoyContactFolder::getEnergy(const Protein& s, StructureID sid) const {
+	if (sid < 0 || sid >= (StructureID) m_contact_table.getNumStructures()) {
 		return DecoyContactFolder::BAD_ENERGY;
 	}
 	vector<unsigned int> aa_indices(s.size());
 	getAminoAcidIndices(s, aa_indices);
-	const vector<Contact> &pair_list = m_structures[sid]->getContacts();
-	vector<Contact>::const_iterator it=pair_list.begin();
-	for ( ; it!=pair_list.end(); it++ )	{
-		int s1 = (*it).first;
-		int s2 = (*it).second;
-		if (s1 < m_length && s2 < m_length) {
-			double contact_G = contactEnergy( aa_indices[s1], aa_indices[s2] );
-			G += contact_G;
-			//cout << "(" << s1 << ", " << s2 << ") -> " << GeneticCodeUtil::residues[s[s1]] 
-			//	 << ":" << GeneticCodeUtil::residues[s[s2]] << " " << contact_G << " " << G << endl << flush;
+	return calcEnergy( aa_indices, sid );
+}
+
+bool DecoyContactFolder::getEnergies(const Protein& p, const vector<StructureID>& sids, double* energies) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	for ( unsigned int i=0; i<sids.size(); i++ ) {
+		if ( sids[i] < 0 || sids[i] >= (StructureID) m_contact_table.getNumStructures() )
+			energies[i] = DecoyContactFolder::BAD_ENERGY;
+		else
+			energies[i] = calcEnergy( aa_indices, sids[i] );
+	}
+	return true;
+}
+
+bool DecoyContactFolder::getEnergies(const Protein& p, double* energies) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	for ( unsigned int sid = 0; sid < m_contact_table.getNumStructures(); sid++)
+		energies[sid] = calcEnergy( aa_indices, sid );
+	return true;
+}
+
+bool DecoyContactFolder::getSubstitutionEnergies(const Protein& p, StructureID sid, vector<double>& deltas) const {
+	vector<unsigned int> aa_indices(p.size());
+	if ( sid < 0 || sid >= (StructureID) m_contact_table.getNumStructures() || !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	deltas.assign( 20*p.size(), 0. );
+	const ContactTable::Entry* it = m_contact_table.begin( sid );
+	const ContactTable::Entry* end = m_contact_table.end( sid );
+	for ( ; it!=end; it++ ) {
+		unsigned int aa1 = aa_indices[it->first];
+		unsigned int aa2 = aa_indices[it->second];
+		double E = contactEnergy( aa1, aa2 );
+		double* d1 = &deltas[20*it->first];
+		double* d2 = &deltas[20*it->second];
+		for ( unsigned int a=0; a<20; a++ ) {
+			d1[a] += contactEnergy( a, aa2 ) - E;
+			d2[a] += contactEnergy( aa1, a ) - E;
 		}
 	}
-	return G;
+	return true;
 }
 
-/**
- * Fold the protein and return folding information (structure, free energy).
- **/
-DecoyFoldInfo* DecoyContactFolder::fold(const Protein& s) const {
-	double kT = 0.6;
+void DecoyContactFolder::setNumThreads( unsigned int num_threads ) {
+	delete m_thread_pool;
+	m_thread_pool = 0;
+	if ( num_threads > 1 )
+		m_thread_pool = new ThreadPool( num_threads );
+}
+
+unsigned int DecoyContactFolder::getNumChunks() const {
+	return ( m_contact_table.getNumStructures() + DECOY_CHUNK_SIZE - 1 )/DECOY_CHUNK_SIZE;
+}
+
+void DecoyContactFolder::calcChunk( const vector<unsigned int>& aa_indices, unsigned int chunk, EnergyStats& stats, double* energies ) const {
+	unsigned int next = chunk*DECOY_CHUNK_SIZE;
+	unsigned int last = min( next + DECOY_CHUNK_SIZE, m_contact_table.getNumStructures() );
+
+	stats.reset();
+	for ( unsigned int i = m_chunk_nonempty[chunk]; i <= m_chunk_nonempty[chunk+1]; i++ ) {
+		unsigned int sid = i < m_chunk_nonempty[chunk+1] ? m_nonempty_sids[i] : last;
+		// the empty decoys before this one have energy zero; zeros don't change
+		// the sums, and only the first two can change the two lowest energies
+		for ( unsigned int empty = next; empty < sid; empty++ ) {
+			if ( energies )
+				energies[empty] = 0.;
+			if ( empty < next + 2 )
+				stats.add( empty, 0. );
+		}
+		if ( sid == last )
+			break;
+		// calculate binding energy of this fold
+		double G = calcEnergy( aa_indices, sid );
+		if ( energies )
+			energies[sid] = G;
+		stats.add( sid, G );
+		next = sid + 1;
+	}
+}
+
+void DecoyContactFolder::calcEnergies( const vector<unsigned int>& aa_indices, vector<EnergyStats>& stats, double* energies ) const {
+	stats.resize( getNumChunks() );
+	if ( m_thread_pool ) {
+		EnergyTask task( *this, aa_indices, stats, energies );
+		m_thread_pool->run( task, stats.size() );
+	}
+	else {
+		for ( unsigned int c = 0; c < stats.size(); c++ )
+			calcChunk( aa_indices, c, stats[c], energies );
+	}
+}
+
+void DecoyContactFolder::calcEnergies( const vector<unsigned int>& aa_indices, vector<double>& energies ) const {
+	vector<EnergyStats> stats;
+	energies.resize( m_contact_table.getNumStructures() );
+	calcEnergies( aa_indices, stats, &energies[0] );
+}
+
+void DecoyContactFolder::calcChunks( const vector<unsigned int>& aa_indices, const unsigned int* chunks, unsigned int num_chunks, vector<EnergyStats>& stats, double* energies ) const {
+	if ( m_thread_pool ) {
+		EnergyTask task( *this, aa_indices, stats, energies, chunks );
+		m_thread_pool->run( task, num_chunks );
+	}
+	else {
+		for ( unsigned int i = 0; i < num_chunks; i++ )
+			calcChunk( aa_indices, chunks[i], stats[chunks[i]], energies );
+	}
+}
+
+double DecoyContactFolder::calcFreeEnergyBound( double min_G, double sum, double sum_sq, unsigned int num_evaluated ) const {
+	unsigned int num_confs = m_contact_table.getNumStructures() -1;
+	unsigned int num_remaining = num_confs - num_evaluated;
+	// the common energy of the remaining decoys that minimizes the free energy
+	double G = max( ( ( num_confs - 1.0 )*m_kT + sum )/num_evaluated, min_G );
+	sum += num_remaining*G;
+	sum_sq += num_remaining*G*G;
+	double mean_G = sum/num_confs;
+	double var_G = (sum_sq - (sum*sum)/num_confs)/(num_confs-1.0);
+	return calcFreeEnergy( min_G, mean_G, var_G, m_kT );
+}
+
+double DecoyContactFolder::calcFreeEnergy( const vector<EnergyStats>& stats, StructureID& min_index, double& min_G, double& mean_G, double& var_G, double& energy_gap ) const {
 	double minG = 1e50;
+	double secondG = 1e50;
 	int minIndex = -1;
 
 	double sumG = 0.0;
 	double sumsqG = 0.0;
 
+	// combine the chunks in order; earlier chunks win ties
+	for ( unsigned int c = 0; c < stats.size(); c++ ) {
+		if ( stats[c].min_G < minG ) {
+			secondG = min( minG, stats[c].second_G );
+			minG = stats[c].min_G;
+			minIndex = stats[c].min_index;
+		}
+		else if ( stats[c].min_G < secondG )
+			secondG = stats[c].min_G;
+		sumG += stats[c].sum;
+		sumsqG += stats[c].sum_sq;
+	}
+
+	// remove min. energy
+	sumG -= minG;
+	sumsqG -= minG*minG;
+
+	unsigned int num_confs = m_contact_table.getNumStructures() -1;
+	mean_G = sumG/num_confs;
+	var_G = (sumsqG - (sumG*sumG)/num_confs)/(num_confs-1.0);
+	min_G = minG;
+	min_index = minIndex;
+	energy_gap = secondG - minG;
+	// calculate free energy of folding
+	return calcFreeEnergy( min_G, mean_G, var_G, m_kT );
+}
+
+/**
+ * Fold the protein and return folding information (structure, free energy).
+ **/
+DecoyFoldInfo* DecoyContactFolder::fold(const Protein& s) const {
+	StructureID minIndex;
+	double dG, minG, mean_G, var_G, gap;
+	vector<EnergyStats> stats;
+
 	vector<unsigned int> aa_indices(s.size());
 	bool valid = getAminoAcidIndices(s, aa_indices);
 	if (!valid) {
 		return new DecoyFoldInfo(false, false, 9999, -1, 9999, 9999, 9999);
 	}
 
-	for ( unsigned int sid = 0; sid < m_structures.size(); sid++) {
-		double G = 0;
-		// calculate binding energy of this fold
-		const vector<Contact> &pair_list = m_structures[sid]->getContacts();
-		vector<Contact>::const_iterator it=pair_list.begin();
-		int num_contacts = 0;
-		for ( ; it!=pair_list.end(); it++ )	{
-			int s1 = (*it).first;
-			int s2 = (*it).second;
-			if (s1 < m_length && s2 < m_length) {
-				double contact_G = contactEnergy( aa_indices[s1], aa_indices[s2] );
-				G += contact_G;
-				num_contacts++;
-			}
-		}
-		// check if binding energy is lower than any previously calculated one
-		if ( G < minG )
-		{
-			minG = G;
-			minIndex = sid;
+	calcEnergies( aa_indices, stats );
+	dG = calcFreeEnergy( stats, minIndex, minG, mean_G, var_G, gap );
+
+	// increment folded count
+	__sync_fetch_and_add( &m_num_folded, 1 );
+	return new DecoyFoldInfo(dG<m_deltaG_cutoff, minIndex==m_target_sid, dG, minIndex, mean_G, var_G, minG);
+}
+
+bool DecoyContactFolder::foldsInto( const Protein& p, StructureID sid, double max_deltaG ) const {
+	unsigned int num_structures = m_contact_table.getNumStructures();
+	if ( num_structures < 3 )
+		return DGCutoffFolder::foldsInto( p, sid, max_deltaG );
+	if ( sid < 0 || (unsigned int) sid >= num_structures )
+		return false;
+
+	vector<unsigned int> aa_indices(p.size());
+	if ( !getAminoAcidIndices(p, aa_indices) )
+		return false;
+	__sync_fetch_and_add( &m_num_folded, 1 );
+
+	// the chunk of the structure first; within a chunk, ties go to the lowest structure ID
+	vector<EnergyStats> stats( getNumChunks() );
+	unsigned int sid_chunk = sid/DECOY_CHUNK_SIZE;
+	calcChunk( aa_indices, sid_chunk, stats[sid_chunk], 0 );
+	if ( stats[sid_chunk].min_index != sid )
+		return false;
+	double min_G = stats[sid_chunk].min_G;
+	double sum = stats[sid_chunk].sum - min_G;
+	double sum_sq = stats[sid_chunk].sum_sq - min_G*min_G;
+	unsigned int num_evaluated = min( ( sid_chunk + 1 )*DECOY_CHUNK_SIZE, num_structures ) - sid_chunk*DECOY_CHUNK_SIZE - 1;
+
+	vector<unsigned int> chunks;
+	for ( unsigned int c = 0; c < stats.size(); c++ )
+		if ( c != sid_chunk )
+			chunks.push_back( c );
+	unsigned int batch = getNumThreads();
+	for ( unsigned int i = 0; i < chunks.size(); i += batch ) {
+		unsigned int num_chunks = min( batch, (unsigned int) chunks.size() - i );
+		calcChunks( aa_indices, &chunks[i], num_chunks, stats );
+		for ( unsigned int j = i; j < i + num_chunks; j++ ) {
+			const EnergyStats& s = stats[chunks[j]];
+			// earlier chunks win ties, as in calcFreeEnergy()
+			if ( s.min_G < min_G || ( s.min_G == min_G && chunks[j] < sid_chunk ) )
+				return false;
+			sum += s.sum;
+			sum_sq += s.sum_sq;
+			num_evaluated += min( ( chunks[j] + 1 )*DECOY_CHUNK_SIZE, num_structures ) - chunks[j]*DECOY_CHUNK_SIZE;
 		}
-		// add energy to partition sum
-		sumG += G;
-		sumsqG += G*G;
+		// the bound is summed differently from the free energy, hence the margin
+		if ( i + num_chunks < chunks.size() && num_evaluated > 0 &&
+			calcFreeEnergyBound( min_G, sum, sum_sq, num_evaluated ) > max_deltaG + 1e-9*( 1 + fabs( max_deltaG ) ) )
+			return false;
 	}
 
-	// remove min. energy
-	sumG -= minG;
-	sumsqG -= minG*minG;
+	StructureID min_index;
+	double mean_G, var_G, gap;
+	double dG = calcFreeEnergy( stats, min_index, min_G, mean_G, var_G, gap );
+	return dG <= max_deltaG && min_index == sid;
+}
+
+StructureID DecoyContactFolder::foldAtTemperatures(const Protein& s, const vector<double>& kTs, vector<double>& deltaGs) const {
+	StructureID minIndex;
+	double minG, mean_G, var_G, gap;
+	vector<EnergyStats> stats;
+
+	deltaGs.assign( kTs.size(), 9999 );
+	vector<unsigned int> aa_indices(s.size());
+	if ( !getAminoAcidIndices(s, aa_indices) )
+		return -1;
+
+	calcEnergies( aa_indices, stats );
+	calcFreeEnergy( stats, minIndex, minG, mean_G, var_G, gap );
+	for ( unsigned int t=0; t<kTs.size(); t++ )
+		deltaGs[t] = calcFreeEnergy( minG, mean_G, var_G, kTs[t] );
 
-	unsigned int num_confs = m_structures.size() -1;
-	double mean_G = sumG/num_confs;
-	double var_G = (sumsqG - (sumG*sumG)/num_confs)/(num_confs-1.0);
-	// calculate free energy of folding
-	double dG = minG + (var_G - 2*kT*mean_G)/(2*kT) + kT * m_log_num_conformations;
-
-	/*cout << "minG:" << minG << endl;
-	cout << "mean_G:" << mean_G << endl;
-	cout << "var_G:" << var_G << endl;
-	cout << "dG:" << dG << endl;
-	cout << "(var_G - 2*kT*mean_G)/(2.0*kT): " << ((var_G - 2*kT*mean_G)/(2.0*kT)) << endl;
-	cout << "kT ln N: " << kT * m_log_num_conformations << endl;
-	*/
-	
 	// increment folded count
-	m_num_folded += 1;
-	return new DecoyFoldInfo(dG<m_deltaG_cutoff, minIndex==m_target_sid, dG, minIndex, mean_G, var_G, minG);
+	__sync_fetch_and_add( &m_num_folded, 1 );
+	return minIndex;
 }
 
 
-void ContactMapUtil::readContactMapsFromFile(ifstream& fin, const string& dir, vector<DecoyContactStructure*>& structs) {
+DecoyParentEnergies* DecoyContactFolder::prepareMutants( const Protein& parent ) const {
+	DecoyParentEnergies* state = new DecoyParentEnergies;
+	state->aa_indices.resize( parent.size() );
+	if ( !getAminoAcidIndices( parent, state->aa_indices ) ) {
+		delete state;
+		return 0;
+	}
+	vector<EnergyStats> stats;
+	state->energies.resize( m_contact_table.getNumStructures() );
+	calcEnergies( state->aa_indices, stats, &state->energies[0] );
+	state->sum = 0.;
+	state->sum_sq = 0.;
+	for ( unsigned int c = 0; c < stats.size(); c++ ) {
+		state->sum += stats[c].sum;
+		state->sum_sq += stats[c].sum_sq;
+	}
+	return state;
+}
+
+DecoyFoldInfo* DecoyContactFolder::foldMutant( const DecoyParentEnergies& parent, unsigned int site, char new_aa ) const {
+	vector<FoldInfo*> fold_data;
+	foldSiteMutants( parent, site, string( 1, new_aa ), fold_data );
+	return static_cast<DecoyFoldInfo*>( fold_data[0] );
+}
+
+void DecoyContactFolder::foldSiteMutants( const DecoyParentEnergies& parent, unsigned int site, const string& new_aas, vector<FoldInfo*>& fold_data ) const {
+	// the decoys with contacts at the site, in increasing order
+	unsigned int first = 0;
+	unsigned int num_decoys = 0;
+	if ( (int) site < m_length && !m_residue_decoys.empty() ) {
+		first = m_residue_offsets[site];
+		num_decoys = m_residue_offsets[site+1] - first;
+	}
+	const StructureID* sids = num_decoys ? &m_residue_decoys[first] : 0;
+	unsigned int num_structures = parent.energies.size();
+
+	// the two lowest energies of the other decoys, which the mutation doesn't change
+	EnergyStats untouched;
+	untouched.reset();
+	for ( unsigned int sid = 0, d = 0; sid < num_structures; sid++ ) {
+		if ( d < num_decoys && (unsigned int) sids[d] == sid )
+			d++;
+		else
+			untouched.add( sid, parent.energies[sid] );
+	}
+
+	// the change of the energy of each decoy for every amino acid at the site:
+	// the residues in contact with the site, counted by amino acid, times the
+	// change of the contact energy with each of them
+	unsigned int old_aa = parent.aa_indices[site];
+	double table[20][20];
+	double self[20];
+	for ( unsigned int a=0; a<20; a++ ) {
+		for ( unsigned int b=0; b<20; b++ )
+			table[b][a] = contactEnergy( a, b ) - contactEnergy( old_aa, b );
+		self[a] = contactEnergy( a, a ) - contactEnergy( old_aa, old_aa );
+	}
+	vector<double> deltas( 20*num_decoys, 0. );
+	for ( unsigned int d = 0; d < num_decoys; d++ ) {
+		unsigned int counts[20] = { 0 };
+		unsigned int num_self = 0;
+		for ( unsigned int k = m_partner_offsets[first+d]; k < m_partner_offsets[first+d+1]; k++ ) {
+			if ( m_residue_partners[k] == site )
+				num_self++;
+			else
+				counts[parent.aa_indices[m_residue_partners[k]]]++;
+		}
+		double* delta = &deltas[20*d];
+		for ( unsigned int b=0; b<20; b++ ) {
+			if ( counts[b] == 0 )
+				continue;
+			for ( unsigned int a=0; a<20; a++ )
+				delta[a] += counts[b]*table[b][a];
+		}
+		if ( num_self > 0 )
+			for ( unsigned int a=0; a<20; a++ )
+				delta[a] += num_self*self[a];
+	}
+
+	unsigned int num_confs = num_structures - 1;
+	fold_data.assign( new_aas.size(), 0 );
+	for ( unsigned int k = 0; k < new_aas.size(); k++ ) {
+		int new_index = GeneticCodeUtil::aminoAcidLetterToIndex( new_aas[k] );
+		if ( new_index < 0 ) {
+			fold_data[k] = new DecoyFoldInfo(false, false, 9999, -1, 9999, 9999, 9999);
+			continue;
+		}
+
+		// the decoys of the site, in decoy order
+		EnergyStats touched;
+		touched.reset();
+		double sum = parent.sum;
+		double sum_sq = parent.sum_sq;
+		for ( unsigned int d = 0; d < num_decoys; d++ ) {
+			double E = parent.energies[sids[d]];
+			double delta = deltas[20*d + new_index];
+			touched.add( sids[d], E + delta );
+			sum += delta;
+			sum_sq += delta*( 2*E + delta );
+		}
+
+		// combine with the other decoys; the lower structure ID wins ties
+		const EnergyStats& low = ( touched.min_G < untouched.min_G ||
+			( touched.min_G == untouched.min_G && touched.min_index < untouched.min_index ) ) ? touched : untouched;
+		const EnergyStats& high = &low == &touched ? untouched : touched;
+		StructureID minIndex = low.min_index;
+		double minG = low.min_G;
+		double gap = min( low.second_G, high.min_G ) - minG;
+		sum -= minG;
+		sum_sq -= minG*minG;
+		double mean_G = sum/num_confs;
+		double var_G = (sum_sq - (sum*sum)/num_confs)/(num_confs-1.0);
+		double dG = calcFreeEnergy( minG, mean_G, var_G, m_kT );
+
+		// too close to call; fold the mutant in full, as fold() does
+		if ( needsExactEvaluation( dG, gap ) ) {
+			vector<unsigned int> mutant_aa( parent.aa_indices );
+			mutant_aa[site] = new_index;
+			vector<EnergyStats> stats;
+			calcEnergies( mutant_aa, stats );
+			dG = calcFreeEnergy( stats, minIndex, minG, mean_G, var_G, gap );
+		}
+
+		// increment folded count
+		__sync_fetch_and_add( &m_num_folded, 1 );
+		fold_data[k] = new DecoyFoldInfo(dG<m_deltaG_cutoff, minIndex==m_target_sid, dG, minIndex, mean_G, var_G, minG);
+	}
+}
+
+DecoyFoldInfo* DecoyContactFolder::foldMutant( const ParentFoldState* parent, const Protein& mutant, unsigned int site ) const {
+	if ( !parent )
+		return fold( mutant );
+	return foldMutant( *static_cast<const DecoyParentEnergies*>( parent ), site, mutant[site] );
+}
+
+void DecoyContactFolder::foldSiteMutants( const ParentFoldState* parent, const Protein& p, unsigned int site, const string& new_aas, vector<FoldInfo*>& fold_data ) const {
+	if ( !parent )
+		ProteinFolder::foldSiteMutants( parent, p, site, new_aas, fold_data );
+	else
+		foldSiteMutants( *static_cast<const DecoyParentEnergies*>( parent ), site, new_aas, fold_data );
+}
+
+
+/**
+ * Parses contact map files into the slots of a vector.
+ **/
+class ContactMapReadTask : public ThreadTask {
+private:
+	const string& m_dir;
+	const vector<string>& m_filenames;
+	vector<DecoyContactStructure*>& m_structs;
+
+public:
+	ContactMapReadTask( const string& dir, const vector<string>& filenames, vector<DecoyContactStructure*>& structs )
+		: m_dir( dir ), m_filenames( filenames ), m_structs( structs ) {}
+
+	void run( unsigned int item ) {
+		string path = m_dir + m_filenames[item];
+		ifstream cfile(path.c_str());
+		if (cfile.good()) {
+			m_structs[item] = new DecoyContactStructure();
+			m_structs[item]->read(cfile);
+		}
+	}
+};
+
+void ContactMapUtil::readContactMapsFromFile(ifstream& fin, const string& dir, vector<DecoyContactStructure*>& structs, unsigned int num_threads, ContactMapLoadTimes* times) {
 	string filename;
 	if ( !fin.good() ){
 		cout << "# Warning: cannot read from stream in ContactMapUtil::readContactMapsFromFile" << endl;
 		return;
 	}
+	double start = getWallTime();
+	vector<string> filenames;
 	do {
 		fin >> filename;
-		if (!fin.eof()) {
-			string path = dir + filename;
-			ifstream cfile(path.c_str());
-			//cout << path << endl;
-			if (cfile.good()) {
-				DecoyContactStructure* cstruct = new DecoyContactStructure();
-				cstruct->read(cfile);
-				cfile.close();
-				structs.push_back(cstruct);
-			}
-			else {
-				cout << "# Warning: bad file in ContactMapUtil::readContactMapsFromFile: " << path << endl;
-			}
-		}
+		if (!fin.eof())
+			filenames.push_back(filename);
 	} while (!fin.eof());
+	double mid = getWallTime();
+	readContactMaps(dir, filenames, structs, num_threads);
+	if ( times ) {
+		times->enumerate = mid - start;
+		times->parse = getWallTime() - mid;
+	}
+}
+
+bool ContactMapUtil::readContactMapsFromDirectory(const string& dir, vector<DecoyContactStructure*>& structs, unsigned int num_threads, ContactMapLoadTimes* times) {
+	double start = getWallTime();
+	vector<string> filenames;
+	if ( !listContactMaps(dir, filenames) )
+		return false;
+	double mid = getWallTime();
+	readContactMaps(dir, filenames, structs, num_threads);
+	if ( times ) {
+		times->enumerate = mid - start;
+		times->parse = getWallTime() - mid;
+	}
+	return true;
+}
+
+bool ContactMapUtil::listContactMaps(const string& dir, vector<string>& filenames) {
+	filenames.clear();
+	DIR* d = opendir(dir.c_str());
+	if ( !d ) {
+		cout << "# Warning: cannot read directory in ContactMapUtil::listContactMaps: " << dir << endl;
+		return false;
+	}
+	const string extension = ".cmap";
+	struct dirent* entry;
+	while ( ( entry = readdir(d) ) != 0 ) {
+		string name = entry->d_name;
+		if ( name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0 )
+			filenames.push_back(name);
+	}
+	closedir(d);
+	sort(filenames.begin(), filenames.end());
+	return true;
+}
+
+void ContactMapUtil::readContactMaps(const string& dir, const vector<string>& filenames, vector<DecoyContactStructure*>& structs, unsigned int num_threads) {
+	vector<DecoyContactStructure*> read(filenames.size(), (DecoyContactStructure*) 0);
+	ContactMapReadTask task(dir, filenames, read);
+	ThreadPool pool(max(num_threads, 1U));
+	pool.run(task, filenames.size());
+	// warnings and results in list order
+	for ( unsigned int i=0; i<filenames.size(); i++ ) {
+		if ( read[i] )
+			structs.push_back(read[i]);
+		else
+			cout << "# Warning: bad file in ContactMapUtil::readContactMaps: " << dir + filenames[i] << endl;
+	}
+}
+
+double ContactMapUtil::getWallTime() {
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + 1e-6*tv.tv_usec;
 }
@@ -29,9 +29,22 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 
 #include "folder.hh"
 #include "protein-contact-energies.hh"
+#include "contact-table.hh"
+#include "thread-pool.hh"
 
 using namespace std;
 
+/**
+ * Wall-clock times of the phases of loading contact maps from disk, in seconds.
+ **/
+struct ContactMapLoadTimes {
+	double enumerate; ///< Finding the contact map files (listing the directory or reading the list file).
+	double parse; ///< Reading and parsing the contact map files.
+	double build; ///< Building the contact table and indices of the folder.
+
+	ContactMapLoadTimes() : enumerate( 0 ), parse( 0 ), build( 0 ) {}
+};
+
 /**
  * Stores folding information.
  **/
@@ -56,6 +69,18 @@ public:
 	double getMinEnergy() const { return m_min_G; }
 };
 
+/**
+ * The energies of a protein in all decoys, from which \ref DecoyContactFolder
+ * folds point mutants of the protein.
+ **/
+class DecoyParentEnergies : public ParentFoldState {
+public:
+	vector<unsigned int> aa_indices; ///< The amino-acid indices of the protein.
+	vector<double> energies; ///< The energies, indexed by structure ID.
+	double sum; ///< The sum of the energies, in decoy order.
+	double sum_sq; ///< The sum of the squared energies, in decoy order.
+};
+
 
 /**
  * Stores a contact structure: a list of contacts.
@@ -65,6 +90,7 @@ protected:
 	vector<Contact> m_contacts;
 public:
 	DecoyContactStructure() {}
+	DecoyContactStructure( const vector<Contact>& contacts ) : m_contacts( contacts ) {}
 	virtual ~DecoyContactStructure() {}
 
 	/**
@@ -114,9 +140,57 @@ private:
 protected:
 	int m_length; ///< Length of the proteins to fold.
 	double m_log_num_conformations; ///< Fudge factor for the folding process.
-	vector<DecoyContactStructure*> m_structures; ///< Vector of the contact maps used as decoys.
+	double m_kT; ///< The temperature at which proteins are folded.
+	ContactTable m_contact_table; ///< The contact maps used as decoys, without contacts beyond the protein length.
+	vector<DecoyContactStructure*> m_structures; ///< The structures passed to the constructor, which are deleted with the folder.
+	vector<StructureID> m_nonempty_sids; ///< The decoys that have at least one contact.
+	vector<unsigned int> m_chunk_nonempty; ///< The nonempty decoys of chunk c are m_nonempty_sids[m_chunk_nonempty[c]] to m_nonempty_sids[m_chunk_nonempty[c+1]-1].
+	vector<unsigned int> m_residue_offsets; ///< The decoys with contacts of residue i are m_residue_decoys[m_residue_offsets[i]] to m_residue_decoys[m_residue_offsets[i+1]-1].
+	vector<StructureID> m_residue_decoys; ///< The decoys with contacts of each residue, in increasing order.
+	vector<unsigned int> m_partner_offsets; ///< The residues in contact with residue i in decoy m_residue_decoys[k] are m_residue_partners[m_partner_offsets[k]] to m_residue_partners[m_partner_offsets[k+1]-1], where k is in the range of residue i.
+	vector<unsigned short> m_residue_partners; ///< The contact partners of each residue in each of its decoys; a residue in contact with itself is listed once.
+
 //	static const double DecoyContactFolder::contactEnergies [20][20]; ///< Table of contact energies.
-	mutable int m_num_folded; ///< Number of proteins folded since creation of the folder object.
+	mutable int m_num_folded; ///< Number of proteins folded since creation of the folder object. Incremented atomically.
+	ThreadPool* m_thread_pool; ///< Evaluates chunks of decoys in parallel, or NULL.
+	ContactMapLoadTimes m_load_times; ///< Time spent loading the decoys.
+
+	/**
+	 * Energy statistics of a chunk of consecutive decoys.
+	 **/
+	struct EnergyStats {
+		double min_G; ///< The lowest energy.
+		double second_G; ///< The second-lowest energy.
+		StructureID min_index; ///< The first decoy with the lowest energy.
+		double sum; ///< The sum of the energies, in decoy order.
+		double sum_sq; ///< The sum of the squared energies, in decoy order.
+
+		void reset() {
+			min_G = 1e50;
+			second_G = 1e50;
+			min_index = -1;
+			sum = 0.0;
+			sum_sq = 0.0;
+		}
+
+		/**
+		 * Adds the energy of the next decoy of the chunk.
+		 **/
+		void add( StructureID sid, double G ) {
+			// check if binding energy is lower than any previously calculated one
+			if ( G < min_G ) {
+				second_G = min_G;
+				min_G = G;
+				min_index = sid;
+			}
+			else if ( G < second_G )
+				second_G = G;
+			// add energy to partition sum
+			sum += G;
+			sum_sq += G*G;
+		}
+	};
+	class EnergyTask;
 
 	/**
 	* Wrapper function to encapsulate the lookup of the
@@ -131,6 +205,112 @@ protected:
 		return ProteinContactEnergies::ProteinContactEnergies::WilliamsPLoSCB2006[residue1][residue2]; }
 	//=MJ85TableVI[residue1][residue2]; }
 
+	/**
+	 * Calculates the contact energy of a sequence in one decoy structure.
+	 *
+	 * @param aa_indices The amino-acid indices of the sequence.
+	 * @param sid The structure ID.
+	 * @return The contact energy.
+	 **/
+	double calcEnergy( const vector<unsigned int>& aa_indices, StructureID sid ) const;
+
+	/**
+	 * @return The number of chunks of decoys that are evaluated independently.
+	 **/
+	unsigned int getNumChunks() const;
+
+	/**
+	 * Calculates the statistics of the contact energies of a sequence in one chunk
+	 * of decoys, in a single pass over the decoys. Only the nonempty decoys are
+	 * summed; the empty ones have energy zero.
+	 *
+	 * @param aa_indices The amino-acid indices of the sequence.
+	 * @param chunk The chunk.
+	 * @param stats Set to the statistics of the chunk.
+	 * @param energies If not NULL, the energies are stored here, indexed by structure ID. Only those of the chunk are set.
+	 **/
+	void calcChunk( const vector<unsigned int>& aa_indices, unsigned int chunk, EnergyStats& stats, double* energies ) const;
+
+	/**
+	 * Calculates the statistics of the contact energies of a sequence in all decoy
+	 * structures. The decoys are evaluated in chunks, in parallel if threads are
+	 * enabled (see \ref setNumThreads()).
+	 *
+	 * @param aa_indices The amino-acid indices of the sequence.
+	 * @param stats Set to the statistics of each chunk.
+	 * @param energies If not NULL, the energies are stored here, indexed by structure ID.
+	 **/
+	void calcEnergies( const vector<unsigned int>& aa_indices, vector<EnergyStats>& stats, double* energies = 0 ) const;
+
+	/**
+	 * Calculates the contact energies of a sequence in all decoy structures.
+	 *
+	 * @param aa_indices The amino-acid indices of the sequence.
+	 * @param energies The energies, indexed by structure ID.
+	 **/
+	void calcEnergies( const vector<unsigned int>& aa_indices, vector<double>& energies ) const;
+
+	/**
+	 * Calculates the contact energies of a sequence in some chunks of decoys, in
+	 * parallel if threads are enabled.
+	 *
+	 * @param aa_indices The amino-acid indices of the sequence.
+	 * @param chunks The chunks.
+	 * @param num_chunks The number of chunks.
+	 * @param stats The statistics of each chunk, indexed by chunk. Must have one entry per chunk.
+	 * @param energies If not NULL, the energies are stored here, indexed by structure ID.
+	 **/
+	void calcChunks( const vector<unsigned int>& aa_indices, const unsigned int* chunks, unsigned int num_chunks, vector<EnergyStats>& stats, double* energies = 0 ) const;
+
+	/**
+	 * Calculates a lower bound on the free energy of folding into the minimum-energy
+	 * structure, when only some of the other decoys have been evaluated. Given the
+	 * sum and the sum of squares of their energies, the free energy is smallest if
+	 * all remaining decoys have the same energy (the free energy is convex in
+	 * these energies), which has to be at least the minimum energy.
+	 *
+	 * @param min_G The minimum energy.
+	 * @param sum The sum of the energies of the evaluated decoys, except the minimum.
+	 * @param sum_sq The sum of their squared energies.
+	 * @param num_evaluated The number of evaluated decoys, except the minimum.
+	 * @return The lower bound.
+	 **/
+	double calcFreeEnergyBound( double min_G, double sum, double sum_sq, unsigned int num_evaluated ) const;
+
+	/**
+	 * Calculates the free energy of folding from the energy statistics of all
+	 * chunks. The chunks are combined in order, so the result doesn't depend on
+	 * the number of threads that calculated them.
+	 *
+	 * @param stats The statistics of each chunk.
+	 * @param min_index Set to the ID of the minimum-energy structure.
+	 * @param min_G Set to the minimum energy.
+	 * @param mean_G Set to the mean energy of the remaining structures.
+	 * @param var_G Set to the energy variance of the remaining structures.
+	 * @param energy_gap Set to the difference between the second-lowest and the lowest energy.
+	 * @return The free energy of folding.
+	 **/
+	double calcFreeEnergy( const vector<EnergyStats>& stats, StructureID& min_index, double& min_G, double& mean_G, double& var_G, double& energy_gap ) const;
+
+	/**
+	 * @return The free energy of folding at temperature kT, given the minimum energy
+	 * and the mean and variance of the energies of the remaining structures.
+	 **/
+	double calcFreeEnergy( double min_G, double mean_G, double var_G, double kT ) const {
+		return min_G + (var_G - 2*kT*mean_G)/(2*kT) + kT * m_log_num_conformations; }
+
+	/**
+	 * Copies the contact maps into the contact table.
+	 **/
+	void buildContactTable( const vector<DecoyContactStructure*>& structs );
+
+	/**
+	 * Lists the nonempty decoys of each chunk, and the decoys in which each residue
+	 * has contacts together with its contact partners there, which are needed by
+	 * \ref foldMutant().
+	 **/
+	void indexDecoys();
+
 public:
 	// Constants
 	static double BAD_ENERGY;
@@ -141,11 +321,13 @@ public:
 	 * @param length Length of the proteins to fold.
 	 * @param log_num_confs A numerical fudge-factor; use log(10^160).
 	 * @param structs A vector of pointers to contact structures. The folder object
-	 * assumes ownership over these structures and will delete them upon exit.
+	 * assumes ownership over these structures and will delete them upon exit. The
+	 * contacts are copied into the contact table; the structures are not used again.
 	 * @param deltaG_cutoff The DeltaG cutoff, as in \ref DGCutoffFolder.
 	 * @param target_sid The target structure ID, as in \ref DGCutoffFolder.
+	 * @param kT The temperature at which proteins are folded.
 	 **/
-	DecoyContactFolder(int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaG_cutoff = 0., StructureID target_sid = -1 );
+	DecoyContactFolder(int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6 );
 	/**
 	 * Create DecoyContactFolder; structures are read from disk.
 	 *
@@ -155,11 +337,47 @@ public:
 	 * @param dir Directory in which contact maps are stored (must end with "/" or platform-appropriate directory separator)
 	 * @param deltaG_cutoff The DeltaG cutoff, as in \ref DGCutoffFolder.
 	 * @param target_sid The target structure ID, as in \ref DGCutoffFolder.
+	 * @param kT The temperature at which proteins are folded.
+	 * @param shared_table If not empty, the name of a shared-memory segment or file
+	 * (see \ref SharedSegment) in which the contact maps are shared with other
+	 * processes. The first process to use the name reads the contact maps and stores
+	 * them there; all other processes attach to the maps read-only and don't read
+	 * any files. The name has to identify the set of contact maps; the segment is not
+	 * removed when the folder is destroyed. Shared maps hold only the contacts within
+	 * the protein length, so folders for other lengths don't attach to them.
+	 * @param num_threads The number of threads that parse the contact map files
+	 * (see \ref ContactMapUtil::readContactMaps()). Doesn't affect folding; see
+	 * \ref setNumThreads().
+	 **/
+	DecoyContactFolder(int length, double log_num_confs, ifstream& fin, const string& dir, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6, const string& shared_table = "", unsigned int num_threads = 1 );
+
+	/**
+	 * Create DecoyContactFolder from a packed file of contact maps (see \ref writePackedMaps()).
+	 * The file is mapped into memory read-only; nothing is parsed or copied, and all
+	 * processes that use the same file share one copy of the contact maps.
+	 *
+	 * @param length Length of the proteins to fold. Must be the length the file was written for.
+	 * @param log_num_confs A numerical fudge-factor; use log(10^160).
+	 * @param packed_file The packed contact maps.
+	 * @param deltaG_cutoff The DeltaG cutoff, as in \ref DGCutoffFolder.
+	 * @param target_sid The target structure ID, as in \ref DGCutoffFolder.
+	 * @param kT The temperature at which proteins are folded.
 	 **/
-	DecoyContactFolder(int length, double log_num_confs, ifstream& fin, const string& dir, double deltaG_cutoff = 0., StructureID target_sid = -1 );
+	DecoyContactFolder(int length, double log_num_confs, const string& packed_file, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6 );
 
 	~DecoyContactFolder();
 
+	/**
+	 * Writes the contact maps in packed binary form: a header, the offsets of the
+	 * contact maps, and the contacts as pairs of 16-bit residue numbers. Packed files
+	 * load much faster than the text contact maps. Like the folder, they contain only
+	 * the contacts within the protein length, and can only be used for that length.
+	 *
+	 * @param filename The file to write.
+	 * @return False if the file could not be written.
+	 **/
+	bool writePackedMaps( const string& filename ) const { return m_contact_table.writeFile( filename ); }
+
 	/**
 	 * Folds a protein. See Folder::fold() for details.
 	 *
@@ -168,6 +386,104 @@ public:
 	 **/
 	virtual DecoyFoldInfo* fold(const Protein& p) const;
 
+	/**
+	 * Folds a protein at several temperatures at once. The energies of all
+	 * decoys are calculated only once; since the free energy depends on the
+	 * decoy energies only through their minimum, mean, and variance, all
+	 * temperatures are evaluated from a single pass over them. The temperature
+	 * the folder was created with is not used.
+	 *
+	 * @param p The sequence to be folded.
+	 * @param kTs The temperatures.
+	 * @param deltaGs Set to the free energies of folding, one per temperature.
+	 * @return The minimum-energy structure, or -1 if the sequence cannot be folded
+	 * (in which case all free energies are set to 9999).
+	 **/
+	StructureID foldAtTemperatures(const Protein& p, const vector<double>& kTs, vector<double>& deltaGs) const;
+
+	/**
+	 * Calculates the energies of a protein in all decoys, for folding its point
+	 * mutants with \ref foldMutant().
+	 *
+	 * @param parent The protein.
+	 * @return The energies, or NULL if the protein contains a stop (mutants are
+	 * then folded with \ref fold()). The caller takes ownership.
+	 **/
+	virtual DecoyParentEnergies* prepareMutants( const Protein& parent ) const;
+
+	/**
+	 * Folds a point mutant of a protein. Only the decoys in which the mutated
+	 * site has contacts change their energy, by the contacts of the site alone;
+	 * the minimum, mean, and variance of the energies are updated from those of
+	 * the parent. The mutant costs time proportional to the number of decoys of
+	 * the site, instead of the contacts of all decoys.
+	 *
+	 * The free energy agrees with that of \ref fold() up to rounding. If the two
+	 * lowest energies or the free energy and the cutoff are closer than the
+	 * precision margin (see \ref DGCutoffFolder::needsExactEvaluation()), the
+	 * mutant is folded with \ref fold() instead, so the structure and the
+	 * decision at the cutoff are always those of \ref fold().
+	 *
+	 * @param parent The energies of the parent, from \ref prepareMutants().
+	 * @param site The mutated site.
+	 * @param new_aa The amino acid at the site in the mutant.
+	 * @return The folding information, as in \ref fold().
+	 **/
+	DecoyFoldInfo* foldMutant( const DecoyParentEnergies& parent, unsigned int site, char new_aa ) const;
+
+	/**
+	 * Folds a point mutant of a protein; see \ref ProteinFolder::foldMutant().
+	 * The parent state must come from this folder.
+	 **/
+	virtual DecoyFoldInfo* foldMutant( const ParentFoldState* parent, const Protein& mutant, unsigned int site ) const;
+
+	/**
+	 * Folds several point mutants of a protein at one site, as \ref foldMutant()
+	 * would fold each of them. For each decoy of the site, the residues in contact
+	 * with the site are counted by amino acid once; the energy changes of all
+	 * substitutions are then the product of these counts with the 20x20 table of
+	 * changes of the contact energy.
+	 *
+	 * @param parent The energies of the parent, from \ref prepareMutants().
+	 * @param site The mutated site.
+	 * @param new_aas The amino acids at the site in the mutants.
+	 * @param fold_data Set to the folding information of the mutants, in the order of new_aas. The caller takes ownership.
+	 **/
+	void foldSiteMutants( const DecoyParentEnergies& parent, unsigned int site, const string& new_aas, vector<FoldInfo*>& fold_data ) const;
+
+	/**
+	 * Folds several point mutants of a protein at one site; see
+	 * \ref ProteinFolder::foldSiteMutants(). The parent state must come from this folder.
+	 **/
+	virtual void foldSiteMutants( const ParentFoldState* parent, const Protein& p, unsigned int site, const string& new_aas, vector<FoldInfo*>& fold_data ) const;
+
+	/**
+	 * Decides whether a protein folds into a structure with a free energy of at
+	 * most max_deltaG; see \ref ProteinFolder::foldsInto(). The chunk of decoys
+	 * that contains the structure is evaluated first. The other chunks follow in
+	 * order, one chunk per thread at a time, and the evaluation stops as soon as
+	 * a decoy undercuts the energy of the structure, or a lower bound on the free
+	 * energy (see \ref calcFreeEnergyBound()) exceeds max_deltaG. Only proteins
+	 * that fold are evaluated in full.
+	 **/
+	virtual bool foldsInto( const Protein& p, StructureID sid, double max_deltaG ) const;
+
+	/**
+	 * Sets the number of threads that evaluate the decoys in fold() and
+	 * \ref foldAtTemperatures(). The decoys are split into chunks of fixed size,
+	 * whose statistics are combined in order, so results are identical for any
+	 * number of threads. Sets with fewer decoys than one chunk are always
+	 * evaluated in the calling thread.
+	 *
+	 * @param num_threads The number of threads, including the calling thread.
+	 **/
+	void setNumThreads( unsigned int num_threads );
+
+	/**
+	 * @return The number of threads that evaluate the decoys.
+	 **/
+	unsigned int getNumThreads() const { return m_thread_pool ? m_thread_pool->getNumThreads() : 1; }
+
 	/**
 	 * @param s The sequence whose energy is sought.
 	 * @param sid The structure ID of the target conformation.
@@ -175,15 +491,51 @@ public:
 	 **/ 
 	double getEnergy(const Protein& s, StructureID sid) const;
 
+	/**
+	 * Calculates the contact energies of a protein in several structures.
+	 * See \ref DGCutoffFolder::getEnergies() for details. Structure IDs out of
+	 * range yield \ref BAD_ENERGY.
+	 **/
+	bool getEnergies(const Protein& p, const vector<StructureID>& sids, double* energies) const;
+
+	/**
+	 * Calculates the contact energies of a protein in all structures.
+	 * See \ref DGCutoffFolder::getEnergies() for details.
+	 **/
+	bool getEnergies(const Protein& p, double* energies) const;
+
+	/**
+	 * Calculates the energy changes of all single substitutions in one pass over the
+	 * contacts of the decoy. See \ref DGCutoffFolder::getSubstitutionEnergies().
+	 * A structure ID out of range yields false.
+	 **/
+	bool getSubstitutionEnergies(const Protein& p, StructureID sid, vector<double>& deltas) const;
+
 	/**
 	@return The number of proteins that have been folded so far with this Folder instance.
 	*/
 	uint getNumFolded() const { return m_num_folded; }
 
+	/**
+	@return The temperature at which proteins are folded.
+	*/
+	double getkT() const { return m_kT; }
+
+	/**
+	@return The logarithm of the number of conformations, which enters the free energy of folding.
+	*/
+	double getLogNumConformations() const { return m_log_num_conformations; }
+
+	/**
+	@return The time spent loading the decoys in the constructor. Phases that didn't
+	take place (e.g., parsing, when the maps are attached from shared memory) are zero.
+	*/
+	const ContactMapLoadTimes& getLoadTimes() const { return m_load_times; }
+
 	/**
 	@return The number of structures into which proteins can fold.
 	*/
-	uint getNumStructures() const { return m_structures.size(); }
+	virtual uint getNumStructures() const { return m_contact_table.getNumStructures(); }
 
 	/**
 	This function assesses whether the folder has been properly initialized.
@@ -194,7 +546,48 @@ public:
 };
 
 struct ContactMapUtil {
-	static void readContactMapsFromFile(ifstream& fin, const string& dir, vector<DecoyContactStructure*>& structs);
+	/**
+	 * Reads the contact maps listed in a file, in the order of the list.
+	 *
+	 * @param fin A stream with the filenames of the contact maps.
+	 * @param dir The directory of the contact maps (must end with "/").
+	 * @param structs The contact maps are appended to this vector. The caller takes ownership.
+	 * @param num_threads The number of threads that parse the files.
+	 * @param times If not null, the time spent reading the list is stored as
+	 * enumeration time, and the time spent parsing as parse time.
+	 **/
+	static void readContactMapsFromFile(ifstream& fin, const string& dir, vector<DecoyContactStructure*>& structs, unsigned int num_threads = 1, ContactMapLoadTimes* times = 0);
+
+	/**
+	 * Reads all files with the extension ".cmap" in a directory, sorted by
+	 * filename, so that structure IDs don't depend on the order in which the
+	 * file system lists the files or on the number of threads.
+	 *
+	 * @param dir The directory (must end with "/").
+	 * @param structs The contact maps are appended to this vector. The caller takes ownership.
+	 * @param num_threads The number of threads that parse the files.
+	 * @param times If not null, the times of the enumeration and parse phases are stored here.
+	 * @return False if the directory can't be read.
+	 **/
+	static bool readContactMapsFromDirectory(const string& dir, vector<DecoyContactStructure*>& structs, unsigned int num_threads = 1, ContactMapLoadTimes* times = 0);
+
+	/**
+	 * Lists the files with the extension ".cmap" in a directory, sorted by filename.
+	 *
+	 * @return False if the directory can't be read.
+	 **/
+	static bool listContactMaps(const string& dir, vector<string>& filenames);
+
+	/**
+	 * Reads contact map files concurrently. The maps are appended in the order
+	 * of the filenames; files that can't be read are skipped with a warning.
+	 **/
+	static void readContactMaps(const string& dir, const vector<string>& filenames, vector<DecoyContactStructure*>& structs, unsigned int num_threads = 1);
+
+	/**
+	 * @return The wall-clock time in seconds, for timing the load phases.
+	 **/
+	static double getWallTime();
 };
 
 #endif // DECOY_CONTACT_FOLDER_HH
@@ -0,0 +1,72 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "folder-factory.hh"
+
+#include <iostream>
+
+
+FolderFactory::FolderFactory()
+	: m_num_threads( 1 )
+{
+}
+
+CompactLatticeFolder* FolderFactory::createLatticeFolder( int size, double deltaG_cutoff, StructureID target_sid, double kT, const string& shared_table, const string& backend ) const
+{
+	CompactLatticeFolder* folder = new CompactLatticeFolder( size, deltaG_cutoff, target_sid, kT, shared_table );
+	if ( folder->good() )
+		selectBackend( *folder, backend );
+	return folder;
+}
+
+DecoyContactFolder* FolderFactory::createDecoyFolder( int length, double log_num_confs, ifstream& fin, const string& dir, double deltaG_cutoff, StructureID target_sid, double kT, const string& shared_table, const string& backend ) const
+{
+	DecoyContactFolder* folder = new DecoyContactFolder( length, log_num_confs, fin, dir, deltaG_cutoff, target_sid, kT, shared_table, m_num_threads );
+	selectDecoyBackend( *folder, backend );
+	return folder;
+}
+
+DecoyContactFolder* FolderFactory::createDecoyFolder( int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaG_cutoff, StructureID target_sid, double kT, const string& backend ) const
+{
+	DecoyContactFolder* folder = new DecoyContactFolder( length, log_num_confs, structs, deltaG_cutoff, target_sid, kT );
+	selectDecoyBackend( *folder, backend );
+	return folder;
+}
+
+DecoyContactFolder* FolderFactory::createDecoyFolder( int length, double log_num_confs, const string& packed_file, double deltaG_cutoff, StructureID target_sid, double kT, const string& backend ) const
+{
+	DecoyContactFolder* folder = new DecoyContactFolder( length, log_num_confs, packed_file, deltaG_cutoff, target_sid, kT );
+	selectDecoyBackend( *folder, backend );
+	return folder;
+}
+
+void FolderFactory::selectDecoyBackend( DecoyContactFolder& folder, const string& backend ) const
+{
+	folder.setNumThreads( m_num_threads );
+	if ( folder.good() )
+		selectBackend( folder, backend );
+}
+
+string FolderFactory::selectBackend( DGCutoffFolder& folder, const string& backend ) const
+{
+	if ( backend != "auto" && !folder.setBackend( backend ) )
+		cout << "# Warning: fold backend " << backend << " not supported; using " << folder.getBackend() << "." << endl;
+	return folder.getBackend();
+}
@@ -0,0 +1,116 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#ifndef FOLDER_FACTORY_HH
+#define FOLDER_FACTORY_HH
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include "folder.hh"
+#include "compact-lattice-folder.hh"
+#include "decoy-contact-folder.hh"
+
+using namespace std;
+
+/** \brief Creates folders and selects their fold backend.
+
+Folders may offer several interchangeable implementations of fold() (see
+\ref DGCutoffFolder::getBackends()). The factory creates a folder, sets up its
+threads, and selects the backend asked for by name. The backend "auto" leaves
+the default backend of the folder, "double", in place. The drivers take the
+backend name from the command line, so a run can always name its backend
+explicitly.
+
+Example:
+\code
+FolderFactory factory;
+auto_ptr<CompactLatticeFolder> folder( factory.createLatticeFolder( 5 ) );
+cout << "# fold backend: " << folder->getBackend() << endl;
+\endcode
+*/
+class FolderFactory {
+private:
+	unsigned int m_num_threads;
+
+	FolderFactory( const FolderFactory & );
+	const FolderFactory & operator=( const FolderFactory & );
+
+	void selectDecoyBackend( DecoyContactFolder& folder, const string& backend ) const;
+
+public:
+	FolderFactory();
+
+	/**
+	Sets the number of threads of the decoy folders created from now on (see
+	\ref DecoyContactFolder::setNumThreads()). Folders that read their structures
+	from disk also parse the contact map files with that number of threads.
+	@param num_threads The number of threads; the default is 1.
+	*/
+	void setNumThreads( unsigned int num_threads ) { m_num_threads = num_threads; }
+
+	/**
+	Creates a \ref CompactLatticeFolder and selects its backend. The first five
+	parameters are as in the constructor of \ref CompactLatticeFolder.
+	@param backend The name of the backend, or "auto" for the default one (see \ref selectBackend()).
+	@return The new folder. The caller takes ownership.
+	*/
+	CompactLatticeFolder* createLatticeFolder( int size, double deltaG_cutoff = 0, StructureID target_sid = -1, double kT = 0.6, const string& shared_table = "", const string& backend = "auto" ) const;
+
+	/**
+	Creates a \ref DecoyContactFolder that reads its structures from disk, and selects
+	its backend. The first eight parameters are as in the corresponding constructor
+	of \ref DecoyContactFolder.
+	@param backend The name of the backend, or "auto" for the default one (see \ref selectBackend()).
+	@return The new folder. The caller takes ownership.
+	*/
+	DecoyContactFolder* createDecoyFolder( int length, double log_num_confs, ifstream& fin, const string& dir, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6, const string& shared_table = "", const string& backend = "auto" ) const;
+
+	/**
+	Creates a \ref DecoyContactFolder from ready-made structures (e.g., from
+	\ref ContactMapUtil::readContactMapsFromDirectory()), and selects its backend.
+	The first six parameters are as in the corresponding constructor of
+	\ref DecoyContactFolder.
+	@param backend The name of the backend, or "auto" for the default one (see \ref selectBackend()).
+	@return The new folder. The caller takes ownership.
+	*/
+	DecoyContactFolder* createDecoyFolder( int length, double log_num_confs, vector<DecoyContactStructure*>& structs, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6, const string& backend = "auto" ) const;
+
+	/**
+	Creates a \ref DecoyContactFolder from a packed file of contact maps, and selects
+	its backend. The first six parameters are as in the corresponding constructor
+	of \ref DecoyContactFolder.
+	@param backend The name of the backend, or "auto" for the default one (see \ref selectBackend()).
+	@return The new folder. The caller takes ownership.
+	*/
+	DecoyContactFolder* createDecoyFolder( int length, double log_num_confs, const string& packed_file, double deltaG_cutoff = 0., StructureID target_sid = -1, double kT = 0.6, const string& backend = "auto" ) const;
+
+	/**
+	Selects the backend of an existing folder. If the folder doesn't support the
+	backend, a warning is printed and the current backend is kept.
+	@param folder The folder.
+	@param backend The name of the backend, or "auto" for the default one.
+	@return The name of the selected backend.
+	*/
+	string selectBackend( DGCutoffFolder& folder, const string& backend = "auto" ) const;
+};
+
+#endif // FOLDER_FACTORY_HH
@@ -25,13 +25,452 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "coding-sequence.hh"
 #include "folder.hh"
 #include "mutator.hh"
+#include "thread-pool.hh"
+#include "random.hh"
 
 #include <algorithm>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <set>
 
 using namespace std;
 
+/**
+ * Bounds on the free energies of the point mutants of a protein in its structure
+ * (see \ref ProteinFolder::boundStructureFreeEnergy()), which
+ * \ref FolderUtil::calcNeutralityProfile() collects if the folder provides them.
+ * They let \ref FolderUtil::updateNeutralityProfile() carry the folding outcomes
+ * over to a point mutant of the protein.
+ **/
+class NeutralityBounds {
+public:
+	StructureID structure; ///< The structure of the protein.
+	double cutoff; ///< The free energy cutoff of the neutrality.
+	vector<double> lo; ///< Lower bound for the mutant with amino acid a at site i, at 20*i+a; for the protein itself at its own amino acids. Empty if the folder provides no bounds.
+	vector<double> hi; ///< Upper bound, indexed as lo.
+
+	bool empty() const { return lo.empty(); }
+};
+
+/**
+ * Counts the neutral point mutants at each site of a protein; see
+ * \ref FolderUtil::calcNeutralityProfile(). If the bounds of a parent protein
+ * that differs from the protein at one site are given, mutants whose outcome
+ * follows from them are not folded; see \ref FolderUtil::updateNeutralityProfile().
+ **/
+class NeutralityTask : public ThreadTask {
+private:
+	const Folder& m_folder;
+	const ProteinFolder* m_protein_folder;
+	const ParentFoldState* m_parent;
+	const Protein& m_protein;
+	StructureID m_structure_id;
+	double m_cutoff;
+	double m_tolerance; ///< Outcomes of bounded free energies closer than this to the cutoff are folded.
+	vector<int>& m_counts;
+	NeutralityBounds* m_bounds; ///< Set to the bounds of the mutants, or NULL.
+	const Protein* m_parent_protein;
+	const NeutralityBounds* m_parent_bounds; ///< The bounds of the parent protein, or NULL.
+	unsigned int m_changed_site; ///< The site at which the protein differs from the parent.
+
+	/**
+	 * Bounds the free energy of a mutant from the one of the same mutant of the parent.
+	 **/
+	void boundFromParent( Protein& parent_mutant, unsigned int site, unsigned int k, double& lo, double& hi ) const {
+		double parent_lo = m_parent_bounds->lo[k];
+		double parent_hi = m_parent_bounds->hi[k];
+		// at the changed site, the mutants are the parent and its own mutants
+		if ( site == m_changed_site ) {
+			lo = parent_lo;
+			hi = parent_hi;
+			return;
+		}
+		double delta_lo, delta_hi;
+		if ( m_protein_folder->boundResidueChange( parent_mutant, m_changed_site, m_protein[m_changed_site], m_structure_id, delta_lo, delta_hi ) ) {
+			lo = parent_lo + delta_lo;
+			hi = parent_hi + delta_hi;
+		}
+	}
+
+public:
+	NeutralityTask( const Folder& b, const ProteinFolder* pf, const ParentFoldState* parent, const Protein& p, StructureID structure_id, double cutoff, vector<int>& counts,
+		NeutralityBounds* bounds = 0, const Protein* parent_protein = 0, const NeutralityBounds* parent_bounds = 0, unsigned int changed_site = 0 )
+		: m_folder( b ), m_protein_folder( pf ), m_parent( parent ), m_protein( p ), m_structure_id( structure_id ), m_cutoff( cutoff ),
+		m_tolerance( 1e-6*( 1 + fabs( cutoff ) ) ), m_counts( counts ), m_bounds( bounds ),
+		m_parent_protein( parent_protein ), m_parent_bounds( parent_bounds ), m_changed_site( changed_site ) {}
+
+	void run( unsigned int site ) {
+		Protein p( m_protein );
+		Protein parent_mutant( m_parent_bounds ? *m_parent_protein : m_protein );
+		char oldaa = p[site];
+		int count = 0;
+		// go through all possible point mutations
+		for (int j=0; j<20; j++) {
+			char newaa = GeneticCodeUtil::AMINO_ACIDS[j];
+			if (newaa == oldaa)
+				continue;
+			p[site] = newaa;
+			parent_mutant[site] = newaa;
+			unsigned int k = 20*site + GeneticCodeUtil::aminoAcidLetterToIndex( newaa );
+			double lo = -HUGE_VAL;
+			double hi = HUGE_VAL;
+			if ( m_parent_bounds )
+				boundFromParent( parent_mutant, site, k, lo, hi );
+			bool folds;
+			if ( hi < m_cutoff - m_tolerance )
+				folds = true;
+			else if ( lo >= m_cutoff + m_tolerance )
+				folds = false;
+			else {
+				// sequence folds into correct structure with low free energy?
+				auto_ptr<FoldInfo> fold_data( m_parent ? m_protein_folder->foldMutant( m_parent, p, site ) : m_folder.fold(p) );
+				folds = fold_data->getStructure() == m_structure_id && fold_data->getDeltaG() < m_cutoff;
+				if ( !m_bounds || !m_protein_folder->boundStructureFreeEnergy( *fold_data, m_structure_id, m_cutoff, lo, hi ) ) {
+					lo = -HUGE_VAL;
+					hi = HUGE_VAL;
+				}
+			}
+			if ( m_bounds ) {
+				m_bounds->lo[k] = lo;
+				m_bounds->hi[k] = hi;
+			}
+			if ( folds )
+				count += 1;
+		}
+		m_counts[site] = count;
+	}
+};
+
+/**
+ * Runs independent restarts of the sequence design of
+ * \ref FolderUtil::getSequencesForStructure(). Restart r draws from random
+ * stream r, so its outcome doesn't depend on the thread that runs it. A
+ * restart gives up as soon as enough distinct designs have been found by
+ * restarts with lower numbers, because its design can't be used anyway.
+ **/
+class DesignTask : public ThreadTask {
+private:
+	const Folder& m_folder;
+	unsigned int m_gene_length;
+	double m_cutoff;
+	int m_struct_id;
+	unsigned int m_num_designs;
+	uint m_seed;
+	unsigned int m_first_restart; ///< The restart number of item 0.
+	pthread_mutex_t m_mutex; ///< Protects m_designs.
+	map<unsigned int, CodingDNA> m_designs; ///< The designs of the successful restarts, by restart number.
+
+	DesignTask( const DesignTask & );
+	const DesignTask & operator=( const DesignTask & );
+
+	bool accepts( const FoldInfo& fi, double max_deltaG ) const {
+		return ( m_struct_id < 0 || fi.getStructure() == m_struct_id ) && fi.getDeltaG() <= max_deltaG;
+	}
+
+	/**
+	 * @return The number of distinct proteins among the designs of restarts
+	 * before the given one, up to the number of designs sought.
+	 **/
+	unsigned int countDesignsBefore( unsigned int restart ) {
+		set<string> proteins;
+		pthread_mutex_lock( &m_mutex );
+		map<unsigned int, CodingDNA>::const_iterator it = m_designs.begin();
+		for ( ; it != m_designs.end() && it->first < restart && proteins.size() < m_num_designs; it++ )
+			proteins.insert( it->second.translate() );
+		pthread_mutex_unlock( &m_mutex );
+		return proteins.size();
+	}
+
+	bool isCancelled( unsigned int restart ) { return countDesignsBefore( restart ) >= m_num_designs; }
+
+	/**
+	 * One restart: a random sequence that folds into the structure with a free
+	 * energy of at most max(300, cutoff) is optimized for stability by point
+	 * mutations, until its free energy is below the cutoff or 50000 mutations in
+	 * a row (1000000 in total) have failed to improve it.
+	 **/
+	bool runRestart( unsigned int restart, CodingDNA& g ) {
+		RandomStream rng( m_seed, restart );
+		SimpleMutator mut( 1.0/m_gene_length );
+		double min_free_energy_for_starting = max( 300.0, m_cutoff );
+		double G;
+
+		bool found = false;
+		do {
+			if ( isCancelled( restart ) )
+				return false;
+			g = CodingDNA::createRandomNoStops( m_gene_length, rng );
+			auto_ptr<FoldInfo> fdata( m_folder.fold( g.translate() ) );
+			found = accepts( *fdata, min_free_energy_for_starting );
+			G = fdata->getDeltaG();
+		} while ( !found );
+
+		int fail_count = 0;
+		int total_fail_count = 0;
+		for ( int step = 1; G > m_cutoff; step++ ) {
+			if ( fail_count > 50000 || total_fail_count > 1e6 )
+				return false;
+			if ( step % 100 == 0 && isCancelled( restart ) )
+				return false;
+			CodingDNA g2 = g;
+			while ( !mut.mutate( g2, rng ) ) ;
+			bool improved = false;
+			if ( g2.encodesFullLength() ) {
+				auto_ptr<FoldInfo> fdata( m_folder.fold( g2.translate() ) );
+				if ( accepts( *fdata, G-0.001 ) ) {
+					g = g2;
+					G = fdata->getDeltaG();
+					improved = true;
+				}
+			}
+			if ( improved )
+				fail_count = 0;
+			else {
+				fail_count++;
+				total_fail_count++;
+			}
+		}
+		return true;
+	}
+
+public:
+	DesignTask( const Folder& b, unsigned int gene_length, double deltag_cutoff, int struct_id, unsigned int num_designs, uint seed )
+		: m_folder( b ), m_gene_length( gene_length ), m_cutoff( deltag_cutoff ), m_struct_id( struct_id ),
+		m_num_designs( num_designs ), m_seed( seed ), m_first_restart( 0 ) {
+		pthread_mutex_init( &m_mutex, 0 );
+	}
+
+	~DesignTask() { pthread_mutex_destroy( &m_mutex ); }
+
+	void run( unsigned int item ) {
+		unsigned int restart = m_first_restart + item;
+		CodingDNA g;
+		if ( runRestart( restart, g ) ) {
+			pthread_mutex_lock( &m_mutex );
+			m_designs[restart] = g;
+			pthread_mutex_unlock( &m_mutex );
+		}
+	}
+
+	/**
+	 * Numbers the items of the next run after those of the previous one.
+	 * @param num_items The number of items of the previous run.
+	 **/
+	void nextRun( unsigned int num_items ) { m_first_restart += num_items; }
+
+	/**
+	 * Collects the designs of the successful restarts in the order of their
+	 * restart numbers, skipping those that encode a protein found before.
+	 * @return True if the number of designs sought has been found.
+	 **/
+	bool getDesigns( vector<CodingDNA>& designs ) const {
+		designs.clear();
+		set<string> proteins;
+		map<unsigned int, CodingDNA>::const_iterator it = m_designs.begin();
+		for ( ; it != m_designs.end() && designs.size() < m_num_designs; it++ ) {
+			if ( proteins.insert( it->second.translate() ).second )
+				designs.push_back( it->second );
+		}
+		return designs.size() >= m_num_designs;
+	}
+};
+
+/**
+ * Designs a sequence for a structure guided by the energy changes of all single
+ * substitutions in that structure (see \ref DGCutoffFolder::getSubstitutionEnergies()),
+ * rather than by randomly proposed mutations; see \ref FolderUtil::getSequenceByDescent().
+ *
+ * A restart begins with a random protein. While the protein doesn't yet fold into the
+ * structure, its energy in the structure is lowered by substitutions that are applied
+ * without folding the mutant, and only the result is folded to check whether the
+ * structure has become the minimum free energy structure. Afterwards, the free energy
+ * of folding is lowered by substitutions that are confirmed by a full fold.
+ *
+ * At zero move temperature, both phases are steepest descents: the first applies the
+ * substitution that lowers the energy in the structure the most, and the second tries
+ * the substitutions in the order of their energy changes and accepts the first one
+ * that lowers the free energy while keeping the structure. At a positive move
+ * temperature T, both phases are Metropolis samplers with uniformly proposed
+ * substitutions. The first accepts a substitution with probability min(1, exp(-dE/T)),
+ * dE being the change of the energy in the structure; the second accepts a mutant that
+ * keeps the structure with probability min(1, exp(-dG/T)), dG being the change of the
+ * free energy of folding. A restart gives up when the first phase takes too many steps
+ * or rejects too many proposals in a row, or the second phase takes too many steps.
+ **/
+class DescentDesign {
+private:
+	const DGCutoffFolder& m_folder;
+	unsigned int m_length; ///< The protein length.
+	double m_cutoff;
+	StructureID m_struct_id;
+	double m_temperature; ///< The move temperature; zero for steepest descent.
+	unsigned int m_max_rejections; ///< Rejected proposals after which the first phase of a restart gives up, and the limit on its steps.
+	unsigned int m_max_steps; ///< Proposals after which the second phase of a sampled restart gives up.
+
+	DescentDesign( const DescentDesign & );
+	const DescentDesign & operator=( const DescentDesign & );
+
+	/**
+	 * Lists the moves (20*site + amino-acid index) that lower the energy in the
+	 * structure, best first.
+	 **/
+	static void sortMoves( const vector<double>& deltas, vector<unsigned int>& moves ) {
+		moves.clear();
+		vector<pair<double, unsigned int> > sorted;
+		for ( unsigned int m=0; m<deltas.size(); m++ )
+			if ( deltas[m] < 0 )
+				sorted.push_back( pair<double, unsigned int>( deltas[m], m ) );
+		sort( sorted.begin(), sorted.end() );
+		for ( unsigned int k=0; k<sorted.size(); k++ )
+			moves.push_back( sorted[k].second );
+	}
+
+	/**
+	 * Chooses the next move (20*site + amino-acid index) of the first phase, by steepest
+	 * descent or by a Metropolis step in the energy in the structure.
+	 * @return False if no move lowers the energy (steepest descent), or m_max_rejections
+	 * proposals in a row have been rejected.
+	 **/
+	bool chooseMove( const vector<double>& deltas, const vector<unsigned int>& aa, RandomStream& rng, unsigned int& move ) const {
+		if ( m_temperature <= 0 ) {
+			move = min_element( deltas.begin(), deltas.end() ) - deltas.begin();
+			return deltas[move] < 0;
+		}
+		for ( unsigned int k=0; k<m_max_rejections; k++ ) {
+			move = rng.rint( deltas.size() );
+			if ( move % 20 == aa[move/20] )
+				continue;
+			if ( deltas[move] <= 0 || rng.runif() < exp( -deltas[move]/m_temperature ) )
+				return true;
+		}
+		return false;
+	}
+
+	static Protein toProtein( const vector<unsigned int>& aa ) {
+		Protein p( aa.size() );
+		for ( unsigned int i=0; i<aa.size(); i++ )
+			p[i] = GeneticCodeUtil::indexToAminoAcidLetter( aa[i] );
+		return p;
+	}
+
+	/**
+	 * The second phase at zero move temperature.
+	 **/
+	bool descend( vector<unsigned int>& aa, Protein& p, double G ) const {
+		vector<double> deltas;
+		vector<unsigned int> moves;
+		while ( G > m_cutoff ) {
+			if ( !m_folder.getSubstitutionEnergies( p, m_struct_id, deltas ) )
+				return false;
+			sortMoves( deltas, moves );
+			auto_ptr<ParentFoldState> parent( m_folder.prepareMutants( p ) );
+			bool improved = false;
+			for ( unsigned int k=0; k<moves.size() && !improved; k++ ) {
+				unsigned int site = moves[k]/20;
+				Protein mutant( p );
+				mutant[site] = GeneticCodeUtil::indexToAminoAcidLetter( moves[k] % 20 );
+				auto_ptr<FoldInfo> fi( m_folder.foldMutant( parent.get(), mutant, site ) );
+				if ( fi->getStructure() == m_struct_id && fi->getDeltaG() <= G-0.001 ) {
+					p = mutant;
+					aa[site] = moves[k] % 20;
+					G = fi->getDeltaG();
+					improved = true;
+				}
+			}
+			if ( !improved )
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * The second phase at a positive move temperature.
+	 **/
+	bool sample( RandomStream& rng, vector<unsigned int>& aa, Protein& p, double G ) const {
+		auto_ptr<ParentFoldState> parent( m_folder.prepareMutants( p ) );
+		for ( unsigned int step=0; G > m_cutoff; step++ ) {
+			if ( step >= m_max_steps )
+				return false;
+			unsigned int m = rng.rint( 20*m_length );
+			unsigned int site = m/20;
+			if ( m % 20 == aa[site] )
+				continue;
+			Protein mutant( p );
+			mutant[site] = GeneticCodeUtil::indexToAminoAcidLetter( m % 20 );
+			auto_ptr<FoldInfo> fi( m_folder.foldMutant( parent.get(), mutant, site ) );
+			if ( fi->getStructure() != m_struct_id )
+				continue;
+			if ( fi->getDeltaG() <= G || rng.runif() < exp( -( fi->getDeltaG() - G )/m_temperature ) ) {
+				p = mutant;
+				aa[site] = m % 20;
+				G = fi->getDeltaG();
+				parent.reset( m_folder.prepareMutants( p ) );
+			}
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * @param b The folder.
+	 * @param length The protein length.
+	 * @param deltag_cutoff The largest acceptable free energy of folding.
+	 * @param struct_id The structure into which the protein has to fold.
+	 * @param temperature The move temperature; zero for steepest descent.
+	 **/
+	DescentDesign( const DGCutoffFolder& b, unsigned int length, double deltag_cutoff, StructureID struct_id, double temperature )
+		: m_folder( b ), m_length( length ), m_cutoff( deltag_cutoff ), m_struct_id( struct_id ),
+		m_temperature( temperature ), m_max_rejections( 20*length ), m_max_steps( 200*length ) {}
+
+	/**
+	 * Runs one restart.
+	 * @param rng The random stream of the restart.
+	 * @param p Set to the designed protein.
+	 * @return True if a protein with free energy at most the cutoff has been found.
+	 **/
+	bool run( RandomStream& rng, Protein& p ) const {
+		vector<unsigned int> aa( m_length );
+		for ( unsigned int i=0; i<m_length; i++ )
+			aa[i] = rng.rint( 20 );
+		p = toProtein( aa );
+		vector<double> deltas;
+
+		// lower the energy in the structure until it is the minimum free energy structure
+		double G;
+		for ( unsigned int step=0; ; step++ ) {
+			auto_ptr<FoldInfo> fi( m_folder.fold( p ) );
+			if ( fi->getStructure() == m_struct_id ) {
+				G = fi->getDeltaG();
+				break;
+			}
+			unsigned int move;
+			if ( step >= m_max_rejections || !m_folder.getSubstitutionEnergies( p, m_struct_id, deltas ) ||
+				!chooseMove( deltas, aa, rng, move ) )
+				return false;
+			aa[move/20] = move % 20;
+			p[move/20] = GeneticCodeUtil::indexToAminoAcidLetter( move % 20 );
+		}
+
+		// then lower the free energy of folding, confirmed by full folds
+		if ( m_temperature > 0 )
+			return sample( rng, aa, p, G );
+		return descend( aa, p, G );
+	}
+
+	/**
+	 * Encodes a protein with codons drawn at random.
+	 **/
+	static CodingDNA reverseTranslate( const Protein& p, RandomStream& rng ) {
+		CodingDNA g( 3*p.size() );
+		for ( unsigned int i=0; i<p.size(); i++ ) {
+			const int* codons = GeneticCodeUtil::residueToAllCodonsTable[GeneticCodeUtil::aminoAcidLetterToIndex( p[i] )];
+			g.setCodon( i, Codon::indexToCodon( codons[1 + rng.rint( codons[0] )], false ) );
+		}
+		return g;
+	}
+};
+
 class FolderUtil
 {
 public:
@@ -39,34 +478,122 @@ public:
 	 * Calculates the neutrality of the given protein. Cutoff is the free energy cutoff
 	 * below which the protein folds.
 	 **/
-	static double calcNeutrality( const Folder &b, Protein p, double cutoff )
+	static double calcNeutrality( const Folder &b, const Protein& p, double cutoff )
+	{
+		vector<double> site_neutrality;
+		return calcNeutralityProfile( b, p, cutoff, site_neutrality );
+	}
+
+	/**
+	 * Calculates the neutrality of the given protein, like \ref calcNeutrality(),
+	 * and the neutrality of each of its sites. The sites are processed in parallel;
+	 * the folder must therefore allow concurrent calls of fold() and
+	 * \ref ProteinFolder::foldMutant(), as the folders of this library do.
+	 *
+	 * @param b The folder.
+	 * @param p The protein.
+	 * @param cutoff The free energy cutoff below which the protein folds.
+	 * @param site_neutrality Set to the fraction of the 19 point mutants at each
+	 * site that fold into the structure of p, with a free energy below the cutoff.
+	 * All zero if p itself doesn't fold.
+	 * @param num_threads The number of threads that fold the mutants.
+	 * @param bounds If not NULL, set to the bounds on the free energies of the mutants,
+	 * for \ref updateNeutralityProfile(); empty if the folder provides none.
+	 * @return The fraction of all point mutants that fold, i.e., the mean of the site neutralities.
+	 **/
+	static double calcNeutralityProfile( const Folder &b, const Protein& p, double cutoff, vector<double>& site_neutrality, unsigned int num_threads = 1, NeutralityBounds* bounds = 0 )
 	{
+		return runNeutralityTask( b, p, cutoff, site_neutrality, num_threads, bounds, 0, 0, 0 );
+	}
+
+	/**
+	 * Calculates the neutrality of a point mutant of a protein, like
+	 * \ref calcNeutralityProfile(), from the bounds collected for the protein.
+	 * Only the mutants whose outcome doesn't follow from the bounds are folded
+	 * (see \ref ProteinFolder::boundResidueChange()); the results are exactly
+	 * those of \ref calcNeutralityProfile(). If p is not a point mutant of the
+	 * parent, or the bounds are empty or for another cutoff, all mutants are folded.
+	 *
+	 * @param b The folder.
+	 * @param parent The protein whose bounds are given.
+	 * @param parent_bounds The bounds collected by calcNeutralityProfile() for parent.
+	 * @param p The protein.
+	 * @param cutoff The free energy cutoff below which the protein folds.
+	 * @param site_neutrality As in calcNeutralityProfile().
+	 * @param num_threads The number of threads that fold the mutants.
+	 * @param bounds If not NULL, set to the bounds for p, for later updates.
+	 * @return The neutrality.
+	 **/
+	static double updateNeutralityProfile( const Folder &b, const Protein& parent, const NeutralityBounds& parent_bounds, const Protein& p, double cutoff,
+		vector<double>& site_neutrality, unsigned int num_threads = 1, NeutralityBounds* bounds = 0 )
+	{
+		unsigned int changed_site = p.length();
+		unsigned int num_changes = 0;
+		if ( parent.length() == p.length() && !parent_bounds.empty() && parent_bounds.cutoff == cutoff ) {
+			for ( unsigned int i=0; i<p.length() && num_changes < 2; i++ ) {
+				if ( parent[i] != p[i] ) {
+					changed_site = i;
+					num_changes++;
+				}
+			}
+		}
+		if ( num_changes != 1 )
+			return calcNeutralityProfile( b, p, cutoff, site_neutrality, num_threads, bounds );
+		return runNeutralityTask( b, p, cutoff, site_neutrality, num_threads, bounds, &parent, &parent_bounds, changed_site );
+	}
+
+private:
+	/**
+	 * Calculates the neutrality profile, using the bounds of a parent protein that
+	 * differs from p at changed_site if they are given (i.e., parent_bounds isn't NULL).
+	 **/
+	static double runNeutralityTask( const Folder &b, const Protein& p, double cutoff, vector<double>& site_neutrality, unsigned int num_threads,
+		NeutralityBounds* bounds, const Protein* parent, const NeutralityBounds* parent_bounds, unsigned int changed_site )
+	{
+		site_neutrality.assign( p.length(), 0. );
+		if ( bounds ) {
+			bounds->lo.clear();
+			bounds->hi.clear();
+		}
 		auto_ptr<FoldInfo> fold_data( b.fold(p) );
 		if ( fold_data->getDeltaG() > cutoff )
 			return 0;
-		int structure_id = fold_data->getStructure();
+		StructureID structure = fold_data->getStructure();
 
-		int count = 0;
-		// go through all positions in the protein
-		for ( unsigned int i=0; i<p.length(); i++ )	{
-			// go through all possible point mutations
-			char oldaa = p[i];
-			for (int j=0; j<20; j++) {
-				char newaa = GeneticCodeUtil::AMINO_ACIDS[j];
-				if (newaa == oldaa)
-					continue;
-				p[i] = newaa;
-				// sequence folds into correct structure with low free energy?
-				fold_data = auto_ptr<FoldInfo>( b.fold(p) );
-				if (fold_data->getStructure() == structure_id && fold_data->getDeltaG() < cutoff) {
-					count += 1;
-				}
+		// all sequences folded by the task are point mutants of p
+		const ProteinFolder* pf = dynamic_cast<const ProteinFolder*>( &b );
+		auto_ptr<ParentFoldState> parent_state( pf ? pf->prepareMutants( p ) : 0 );
+
+		// the bounds of p itself are needed when p is the parent of a later update
+		double lo, hi;
+		if ( bounds && pf && pf->boundStructureFreeEnergy( *fold_data, structure, cutoff, lo, hi ) ) {
+			bounds->structure = structure;
+			bounds->cutoff = cutoff;
+			bounds->lo.assign( 20*p.length(), -HUGE_VAL );
+			bounds->hi.assign( 20*p.length(), HUGE_VAL );
+			for ( unsigned int i=0; i<p.length(); i++ ) {
+				bounds->lo[20*i + GeneticCodeUtil::aminoAcidLetterToIndex( p[i] )] = lo;
+				bounds->hi[20*i + GeneticCodeUtil::aminoAcidLetterToIndex( p[i] )] = hi;
 			}
-			p[i] = oldaa;
+		}
+		if ( parent_bounds && ( !pf || parent_bounds->structure != structure ) )
+			parent_bounds = 0;
+
+		vector<int> counts( p.length(), 0 );
+		NeutralityTask task( b, pf, parent_state.get(), p, structure, cutoff, counts,
+			bounds && !bounds->empty() ? bounds : 0, parent, parent_bounds, changed_site );
+		ThreadPool pool( max( num_threads, 1U ) );
+		pool.run( task, p.length() );
+
+		int count = 0;
+		for ( unsigned int i=0; i<p.length(); i++ ) {
+			site_neutrality[i] = counts[i] / 19.0;
+			count += counts[i];
 		}
 		return count / (19.0*p.length());
 	}
 
+public:
 	/**
 	 * Finds a random sequence with folding energy smaller than cutoff and structure given by struct_id
 	 */
@@ -211,6 +738,87 @@ public:
 		return g;
 	}
 
+	/**
+	 * Finds several sequences with folding energy at most deltag_cutoff, like
+	 * \ref getSequenceForStructure(), by independent restarts that run
+	 * concurrently (see \ref DesignTask). The designs are those of the
+	 * lowest-numbered successful restarts that encode distinct proteins, so they
+	 * depend only on the seed, not on the number of threads; the state of
+	 * \ref Random is not used. The folder must allow concurrent calls of fold().
+	 *
+	 * @param b The folder.
+	 * @param gene_length The length of the genes, in nucleotides.
+	 * @param deltag_cutoff The largest acceptable free energy of folding.
+	 * @param struct_id The structure into which the proteins have to fold, or -1 for any structure.
+	 * @param num_designs The number of distinct designs sought.
+	 * @param designs Set to the designs.
+	 * @param num_threads The number of threads.
+	 * @param seed The seed of the random streams of the restarts.
+	 **/
+	static void getSequencesForStructure( const Folder &b, unsigned int gene_length, double deltag_cutoff, int struct_id, unsigned int num_designs, vector<CodingDNA>& designs, unsigned int num_threads, uint seed )
+	{
+		DesignTask task( b, gene_length, deltag_cutoff, struct_id, num_designs, seed );
+		ThreadPool pool( max( num_threads, 1U ) );
+		// a few restarts per thread at a time, so that threads rarely wait for each other
+		unsigned int num_restarts = 4*pool.getNumThreads();
+		while ( !task.getDesigns( designs ) ) {
+			pool.run( task, num_restarts );
+			task.nextRun( num_restarts );
+		}
+	}
+
+	/**
+	 * Finds a sequence with folding energy at most deltag_cutoff and structure struct_id,
+	 * like \ref getSequenceForStructure(), but guided by the energy changes of all
+	 * single substitutions in the structure (see \ref DescentDesign), so that far fewer
+	 * proteins are folded. Restart r draws from random stream r of the seed; the state
+	 * of \ref Random is not used.
+	 *
+	 * @param b The folder.
+	 * @param gene_length The length of the gene, in nucleotides.
+	 * @param deltag_cutoff The largest acceptable free energy of folding.
+	 * @param struct_id The structure into which the protein has to fold.
+	 * @param seed The seed of the random streams of the restarts.
+	 * @param move_temperature Zero for steepest descent; otherwise, the temperature of
+	 * the Metropolis sampling of the substitutions.
+	 * @param max_restarts The number of restarts after which the search gives up.
+	 * @return The gene, with codons drawn at random for the designed protein, or an
+	 * empty gene if no restart has found one.
+	 **/
+	static CodingDNA getSequenceByDescent( const DGCutoffFolder &b, unsigned int gene_length, double deltag_cutoff, StructureID struct_id, uint seed, double move_temperature = 0, unsigned int max_restarts = 100 )
+	{
+		DescentDesign design( b, gene_length/3, deltag_cutoff, struct_id, move_temperature );
+		Protein p;
+		for ( unsigned int restart = 0; restart < max_restarts; restart++ ) {
+			RandomStream rng( seed, restart );
+			if ( design.run( rng, p ) )
+				return DescentDesign::reverseTranslate( p, rng );
+		}
+		return CodingDNA();
+	}
+
+	/**
+	 * As \ref getSequenceForStructure(), but with concurrent restarts; see
+	 * \ref getSequencesForStructure(). The first successful restart cancels
+	 * all later ones.
+	 **/
+	static CodingDNA getSequenceForStructure( const Folder &b, unsigned int gene_length, double deltag_cutoff, const int struct_id, unsigned int num_threads, uint seed )
+	{
+		vector<CodingDNA> designs;
+		getSequencesForStructure( b, gene_length, deltag_cutoff, struct_id, 1, designs, num_threads, seed );
+		return designs[0];
+	}
+
+	/**
+	 * As \ref getSequence(), but with concurrent restarts; see
+	 * \ref getSequencesForStructure().
+	 **/
+	static CodingDNA getSequence( const Folder &b, unsigned int length, double free_energy_cutoff, unsigned int num_threads, uint seed )
+	{
+		vector<CodingDNA> designs;
+		getSequencesForStructure( b, length, free_energy_cutoff, -1, 1, designs, num_threads, seed );
+		return designs[0];
+	}
 };
 
 
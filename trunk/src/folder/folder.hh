@@ -23,8 +23,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #define FOLDER_HH
 
 #include <vector>
+#include <string>
 #include <cstring>
+#include <cmath>
 #include <iostream>
+#include <memory>
 #include "sequence.hh"
 #include "genetic-code.hh" // this is possibly a bad dependence
 
@@ -128,6 +131,16 @@ StructureID sid = fi->getStructure(); // assign structure ID to variable sid
 	virtual uint getNumFolded() const = 0;
 };
 
+/**
+\brief The folding state of a protein, which a \ref ProteinFolder keeps to fold point mutants of the protein quickly.
+
+See \ref ProteinFolder::prepareMutants().
+*/
+class ParentFoldState {
+public:
+	virtual ~ParentFoldState() {}
+};
+
 /**
 \brief Abstract base class for a class that can fold a protein sequence into a structure.
 */
@@ -185,6 +198,88 @@ StructureID sid = fi->getStructure(); // assign structure ID to variable sid
 	the folding information.
 	*/
 	virtual FoldInfo* fold(const Protein& p) const = 0;
+
+	/**
+	Prepares the folding of point mutants of a protein. Folders that can fold a
+	point mutant faster than an unrelated sequence return their state for the
+	parent protein, to be passed to \ref foldMutant(). The caller takes ownership.
+	@param parent The protein whose point mutants will be folded.
+	@return The state, or NULL if the folder gains nothing from it (the default).
+	*/
+	virtual ParentFoldState* prepareMutants( const Protein& ) const { return 0; }
+
+	/**
+	Folds a point mutant of a protein. The default folds the mutant from scratch.
+	@param parent The state returned by \ref prepareMutants() for the parent protein, or NULL.
+	@param mutant The mutant. It must not differ from the parent except at the given site.
+	@param site The mutated site.
+	@return As in \ref fold().
+	*/
+	virtual FoldInfo* foldMutant( const ParentFoldState*, const Protein& mutant, unsigned int ) const {
+		return fold( mutant );
+	}
+
+	/**
+	Folds several point mutants of a protein that differ from it at the same site.
+	The default calls \ref foldMutant() for each; folders that can share work
+	between the mutants of a site override this function.
+	@param parent The state returned by \ref prepareMutants() for the parent protein, or NULL.
+	@param p The parent protein.
+	@param site The mutated site.
+	@param new_aas The amino acids at the site in the mutants.
+	@param fold_data Set to the results of \ref foldMutant() for the mutants, in the order of new_aas. The caller takes ownership.
+	*/
+	virtual void foldSiteMutants( const ParentFoldState* parent, const Protein& p, unsigned int site, const string& new_aas, vector<FoldInfo*>& fold_data ) const {
+		fold_data.resize( new_aas.size() );
+		Protein mutant( p );
+		for ( unsigned int k=0; k<new_aas.size(); k++ ) {
+			mutant[site] = new_aas[k];
+			fold_data[k] = foldMutant( parent, mutant, site );
+		}
+	}
+
+	/**
+	Decides whether a protein folds into a given structure with a free energy of
+	at most a given value. The decision is the same as the one derived from
+	\ref fold(). The default folds the protein; folders that can reject most
+	proteins without a full fold override this function.
+	@param p The protein.
+	@param sid The structure into which the protein has to fold.
+	@param max_deltaG The largest acceptable free energy of folding.
+	@return True if the minimum free energy structure of p is sid, and its free energy is at most max_deltaG.
+	*/
+	virtual bool foldsInto( const Protein& p, StructureID sid, double max_deltaG ) const {
+		auto_ptr<FoldInfo> fi( fold( p ) );
+		return fi->getDeltaG() <= max_deltaG && fi->getStructure() == sid;
+	}
+
+	/**
+	Bounds the free energy G_sid(p) of a protein in a structure. G_sid is defined by the
+	folder such that \ref fold() reports sid with a DeltaG below the cutoff if
+	G_sid(p) < cutoff - 1e-6*(1+|cutoff|), and doesn't if G_sid(p) >= cutoff + 1e-6*(1+|cutoff|).
+	Together with \ref boundResidueChange(), this lets the folding outcomes of the point
+	mutants of a protein be carried over to a point mutant of the protein
+	(see \ref FolderUtil::updateNeutralityProfile()).
+	@param fi The result of \ref fold() for the protein.
+	@param sid The structure.
+	@param cutoff The DeltaG cutoff.
+	@param lo Set to a lower bound on G_sid(p).
+	@param hi Set to an upper bound on G_sid(p), which may be infinite.
+	@return False if the folder can't bound G_sid for this cutoff (the default).
+	*/
+	virtual bool boundStructureFreeEnergy( const FoldInfo&, StructureID, double, double&, double& ) const { return false; }
+
+	/**
+	Bounds the change of G_sid(p) (see \ref boundStructureFreeEnergy()) when one residue of p is changed.
+	@param p The protein.
+	@param site The changed site.
+	@param new_aa The new amino acid at the site.
+	@param sid The structure.
+	@param lo Set to a lower bound on the change.
+	@param hi Set to an upper bound on the change.
+	@return False if the folder can't bound the change (the default).
+	*/
+	virtual bool boundResidueChange( const Protein&, unsigned int, char, StructureID, double&, double& ) const { return false; }
 };
 
 
@@ -202,10 +297,69 @@ private:
 protected:
 	double m_deltaG_cutoff; //!< The DeltaG cutoff value. The fold is not stable if the DeltaG exceeds this value
 	StructureID m_target_sid; //!< The target structure ID.
+	double m_precision_margin; //!< Approximate results closer than this to a decision boundary are recalculated exactly.
+
+	/**
+	Decides whether a fold whose energies were calculated approximately (e.g., updated
+	from those of another protein, in a different order of summation) has to be
+	calculated again as in \ref fold().
+	@param deltaG The approximate DeltaG.
+	@param energy_gap The approximate difference between the second-lowest and the lowest structure energy.
+	@return True if the fold decision or the minimum-energy structure could differ from the one of \ref fold().
+	*/
+	bool needsExactEvaluation( double deltaG, double energy_gap ) const {
+		return fabs( deltaG - m_deltaG_cutoff ) < m_precision_margin || energy_gap < m_precision_margin;
+	}
 
 public:
 	DGCutoffFolder( double deltaG_cutoff, StructureID target_sid )
-		: m_deltaG_cutoff( deltaG_cutoff ), m_target_sid( target_sid ) {}
+		: m_deltaG_cutoff( deltaG_cutoff ), m_target_sid( target_sid ),
+		m_precision_margin( 0.1 ) {}
+
+	/**
+	Sets the margin for approximate calculations, see \ref needsExactEvaluation(). The default is 0.1.
+	@param margin Width (in energy units) of the region around the DeltaG cutoff, and the smallest
+	energy gap, at which approximate results are recalculated exactly.
+	*/
+	void setPrecisionMargin( double margin ) {
+		m_precision_margin = margin;
+	}
+
+	/**
+	@return The margin around the DeltaG cutoff within which approximate results are recalculated.
+	*/
+	double getPrecisionMargin() const {
+		return m_precision_margin;
+	}
+
+	/**
+	Lists the fold backends of this folder. Backends are interchangeable implementations
+	of fold() that make the same fold decisions but differ in speed, depending on the
+	machine and the problem size. See \ref FolderFactory.
+	The base class offers the reference backend "double", which sums the energies in
+	double precision.
+	@param backends Receives the names of the backends.
+	*/
+	virtual void getBackends( vector<string>& backends ) const {
+		backends.clear();
+		backends.push_back( "double" );
+	}
+
+	/**
+	Selects a fold backend by name.
+	@param backend One of the names returned by \ref getBackends().
+	@return False if the folder does not support the backend; the current backend is then kept.
+	*/
+	virtual bool setBackend( const string& backend ) {
+		return backend == "double";
+	}
+
+	/**
+	@return The name of the current fold backend.
+	*/
+	virtual string getBackend() const {
+		return "double";
+	}
 
 	/**
 	 * This function calculates the contact free energy of a sequence on a give target structure.
@@ -226,6 +380,61 @@ public:
 	 **/ 
 	virtual double getEnergy(const Protein& s, StructureID sid) const = 0;
 
+	/**
+	 * Calculates the contact energies of a protein in several structures. The sequence
+	 * is converted into amino-acid indices only once, so this is much faster than
+	 * repeated calls to \ref getEnergy().
+	 * @param p The protein sequence whose contact energies are sought.
+	 * @param sids The structure IDs of the conformations.
+	 * @param energies Array of at least sids.size() elements that receives the energies, in the order of sids.
+	 * Structure IDs out of range receive the folder's BAD_ENERGY.
+	 * @return False if the sequence contains residues that cannot be folded (e.g., stop codons).
+	 **/
+	virtual bool getEnergies(const Protein& p, const vector<StructureID>& sids, double* energies) const = 0;
+
+	/**
+	 * Calculates the contact energies of a protein in all structures.
+	 * @param p The protein sequence whose contact energies are sought.
+	 * @param energies Array of at least \ref getNumStructures() elements that receives the energies, indexed by structure ID.
+	 * @return False if the sequence contains residues that cannot be folded (e.g., stop codons).
+	 **/
+	virtual bool getEnergies(const Protein& p, double* energies) const = 0;
+
+	/**
+	 * Calculates how the contact energy of a protein in a structure changes under every
+	 * single amino-acid substitution. The default evaluates each point mutant with
+	 * \ref getEnergy(); folders override it with a single pass over the contacts of the structure.
+	 * @param p The protein.
+	 * @param sid The structure ID.
+	 * @param deltas Set to 20 values per site: deltas[20*i+a] is the energy of p with residue i
+	 * replaced by the amino acid of index a (see \ref GeneticCodeUtil::indexToAminoAcidLetter()),
+	 * minus the energy of p. The entry of the residue already present is zero.
+	 * @return False if the sequence contains residues that cannot be folded (e.g., stop codons).
+	 **/
+	virtual bool getSubstitutionEnergies(const Protein& p, StructureID sid, vector<double>& deltas) const {
+		vector<unsigned int> aa_indices(p.size());
+		if ( !getAminoAcidIndices(p, aa_indices) )
+			return false;
+		deltas.assign( 20*p.size(), 0. );
+		double E = getEnergy(p, sid);
+		Protein mutant(p);
+		for ( unsigned int i=0; i<p.size(); i++ ) {
+			for ( unsigned int a=0; a<20; a++ ) {
+				if ( a == aa_indices[i] )
+					continue;
+				mutant[i] = GeneticCodeUtil::indexToAminoAcidLetter(a);
+				deltas[20*i+a] = getEnergy(mutant, sid) - E;
+			}
+			mutant[i] = p[i];
+		}
+		return true;
+	}
+
+	/**
+	 @return The number of structures into which sequences can fold.
+	 **/
+	virtual uint getNumStructures() const = 0;
+
 	/**
 	Gets the DeltaG cutoff.
 	@return The current DeltaG cutoff used in folding.
@@ -0,0 +1,265 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "sequence-bank.hh"
+#include "compact-lattice-folder.hh"
+#include "decoy-contact-folder.hh"
+#include "folder-util.hh"
+#include "random.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+// Header of the bank file.
+struct SequenceBankHeader {
+	char magic[8];
+	unsigned int num_pools;
+	unsigned int reserved;
+};
+
+// Index entry of a pool. The genes of the pool are stored one after the other,
+// without separators, starting at offset.
+struct SequenceBankEntry {
+	char folder_key[64];
+	unsigned int gene_length;
+	int struct_id;
+	double deltaG_cutoff;
+	unsigned long long offset;
+	unsigned int num_sequences;
+	unsigned int reserved;
+};
+
+static const char* SEQUENCE_BANK_MAGIC = "EVSQBK01";
+
+string SequenceBank::s_default_file;
+
+SequenceBank::SequenceBank( const string& filename )
+	: m_filename( filename ), m_good( true )
+{
+	ifstream fin( filename.c_str(), ios::binary );
+	if ( !fin.good() )
+		return; // no bank yet
+
+	SequenceBankHeader header;
+	fin.read( (char*) &header, sizeof( header ) );
+	if ( !fin.good() || strncmp( header.magic, SEQUENCE_BANK_MAGIC, 8 ) != 0 ) {
+		cout << "# Warning: " << filename << " is not a sequence bank" << endl;
+		m_good = false;
+		return;
+	}
+	m_pools.resize( header.num_pools );
+	for ( unsigned int i=0; i<header.num_pools; i++ ) {
+		SequenceBankEntry entry;
+		fin.read( (char*) &entry, sizeof( entry ) );
+		if ( !fin.good() ) {
+			cout << "# Warning: the index of sequence bank " << filename << " is truncated" << endl;
+			m_pools.clear();
+			m_good = false;
+			return;
+		}
+		entry.folder_key[sizeof( entry.folder_key )-1] = 0;
+		Pool& pool = m_pools[i];
+		pool.folder_key = entry.folder_key;
+		pool.gene_length = entry.gene_length;
+		pool.struct_id = entry.struct_id;
+		pool.deltaG_cutoff = entry.deltaG_cutoff;
+		pool.offset = entry.offset;
+		pool.num_sequences = entry.num_sequences;
+	}
+}
+
+int SequenceBank::findPool( const string& folder_key, unsigned int gene_length, StructureID struct_id, double deltaG_cutoff ) const
+{
+	for ( unsigned int i=0; i<m_pools.size(); i++ ) {
+		const Pool& pool = m_pools[i];
+		if ( pool.folder_key == folder_key && pool.gene_length == gene_length && pool.struct_id == struct_id
+			&& fabs( pool.deltaG_cutoff - deltaG_cutoff ) < 1e-9 )
+			return i;
+	}
+	return -1;
+}
+
+bool SequenceBank::readPool( unsigned int pool, vector<CodingDNA>& genes ) const
+{
+	genes.clear();
+	if ( pool >= m_pools.size() )
+		return false;
+	const Pool& entry = m_pools[pool];
+	ifstream fin( m_filename.c_str(), ios::binary );
+	fin.seekg( entry.offset );
+	vector<char> buffer( (size_t) entry.gene_length*entry.num_sequences );
+	if ( !buffer.empty() )
+		fin.read( &buffer[0], buffer.size() );
+	if ( !fin.good() ) {
+		cout << "# Warning: cannot read pool " << pool << " of sequence bank " << m_filename << endl;
+		return false;
+	}
+	genes.clear();
+	genes.reserve( entry.num_sequences );
+	for ( unsigned int i=0; i<entry.num_sequences; i++ )
+		genes.push_back( CodingDNA( string( &buffer[(size_t) i*entry.gene_length], entry.gene_length ) ) );
+	return true;
+}
+
+bool SequenceBank::drawSequence( const Folder& b, unsigned int gene_length, double deltaG_cutoff, StructureID struct_id, CodingDNA& g ) const
+{
+	const ProteinFolder* pf = dynamic_cast<const ProteinFolder*>( &b );
+	if ( !pf || m_pools.empty() )
+		return false;
+	int pool = findPool( getFolderKey( b, gene_length/3 ), gene_length, struct_id, deltaG_cutoff );
+	vector<CodingDNA> genes;
+	if ( pool < 0 || !readPool( pool, genes ) || genes.empty() )
+		return false;
+
+	unsigned int first = Random::rint( genes.size() );
+	for ( unsigned int k=0; k<genes.size(); k++ ) {
+		const CodingDNA& candidate = genes[(first+k) % genes.size()];
+		if ( candidate.encodesFullLength() && pf->foldsInto( candidate.translate(), struct_id, deltaG_cutoff ) ) {
+			g.assign( candidate );
+			return true;
+		}
+	}
+	return false;
+}
+
+bool SequenceBank::addSequences( const string& filename, const string& folder_key, unsigned int gene_length, StructureID struct_id, double deltaG_cutoff, const vector<CodingDNA>& genes )
+{
+	SequenceBank bank( filename );
+	if ( !bank.good() )
+		return false;
+	if ( folder_key.size() >= sizeof( ((SequenceBankEntry*) 0)->folder_key ) ) {
+		cout << "# Warning: folder key " << folder_key << " is too long for a sequence bank" << endl;
+		return false;
+	}
+
+	// read all pools, and merge the new genes into theirs
+	vector<Pool> pools = bank.getPools();
+	vector<vector<CodingDNA> > contents( pools.size() );
+	for ( unsigned int i=0; i<pools.size(); i++ )
+		if ( !bank.readPool( i, contents[i] ) )
+			return false;
+	int pool = bank.findPool( folder_key, gene_length, struct_id, deltaG_cutoff );
+	if ( pool < 0 ) {
+		Pool entry;
+		entry.folder_key = folder_key;
+		entry.gene_length = gene_length;
+		entry.struct_id = struct_id;
+		entry.deltaG_cutoff = deltaG_cutoff;
+		pools.push_back( entry );
+		contents.push_back( vector<CodingDNA>() );
+		pool = pools.size()-1;
+	}
+	set<string> present( contents[pool].begin(), contents[pool].end() );
+	for ( unsigned int i=0; i<genes.size(); i++ ) {
+		if ( genes[i].length() == gene_length && present.insert( genes[i] ).second )
+			contents[pool].push_back( genes[i] );
+	}
+
+	// write the new bank next to the old one, then replace it
+	string tmp_name = filename + ".tmp";
+	ofstream fout( tmp_name.c_str(), ios::binary );
+	SequenceBankHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, SEQUENCE_BANK_MAGIC, 8 );
+	header.num_pools = pools.size();
+	fout.write( (const char*) &header, sizeof( header ) );
+	unsigned long long offset = sizeof( header ) + pools.size()*sizeof( SequenceBankEntry );
+	for ( unsigned int i=0; i<pools.size(); i++ ) {
+		SequenceBankEntry entry;
+		memset( &entry, 0, sizeof( entry ) );
+		strncpy( entry.folder_key, pools[i].folder_key.c_str(), sizeof( entry.folder_key )-1 );
+		entry.gene_length = pools[i].gene_length;
+		entry.struct_id = pools[i].struct_id;
+		entry.deltaG_cutoff = pools[i].deltaG_cutoff;
+		entry.offset = offset;
+		entry.num_sequences = contents[i].size();
+		fout.write( (const char*) &entry, sizeof( entry ) );
+		offset += (unsigned long long) entry.gene_length*entry.num_sequences;
+	}
+	for ( unsigned int i=0; i<pools.size(); i++ )
+		for ( unsigned int j=0; j<contents[i].size(); j++ )
+			fout.write( contents[i][j].data(), contents[i][j].size() );
+	fout.close();
+	if ( !fout.good() || rename( tmp_name.c_str(), filename.c_str() ) != 0 ) {
+		cout << "# Warning: cannot write sequence bank " << filename << endl;
+		remove( tmp_name.c_str() );
+		return false;
+	}
+	return true;
+}
+
+string SequenceBank::getFolderKey( const Folder& b, unsigned int protein_length )
+{
+	const DGCutoffFolder* folder = dynamic_cast<const DGCutoffFolder*>( &b );
+	if ( !folder )
+		return "";
+
+	// a fixed probe protein that contains all amino acids
+	Protein probe( protein_length );
+	for ( unsigned int i=0; i<protein_length; i++ )
+		probe[i] = GeneticCodeUtil::indexToAminoAcidLetter( (7*i+3) % 20 );
+	vector<double> energies( folder->getNumStructures() );
+	if ( !folder->getEnergies( probe, &energies[0] ) )
+		return "";
+	// the parameters of the free energy; fold() can't be used, because its
+	// result depends slightly on the energy precision of the fold backend
+	const CompactLatticeFolder* lattice = dynamic_cast<const CompactLatticeFolder*>( folder );
+	const DecoyContactFolder* decoys = dynamic_cast<const DecoyContactFolder*>( folder );
+	if ( lattice )
+		energies.push_back( lattice->getkT() );
+	if ( decoys ) {
+		energies.push_back( decoys->getkT() );
+		energies.push_back( decoys->getLogNumConformations() );
+	}
+
+	// 64-bit FNV-1a hash of the values, rounded so that the key doesn't depend
+	// on the last bits of the floating-point results
+	unsigned long long hash = 14695981039346656037ULL;
+	for ( unsigned int i=0; i<energies.size(); i++ ) {
+		long long v = (long long) floor( energies[i]*1e6 + 0.5 );
+		for ( unsigned int k=0; k<8; k++ ) {
+			hash ^= (unsigned long long) ( v >> (8*k) ) & 0xff;
+			hash *= 1099511628211ULL;
+		}
+	}
+	char hex[17];
+	snprintf( hex, sizeof( hex ), "%016llx", hash );
+	stringstream key;
+	key << "structures " << folder->getNumStructures() << " hash " << hex;
+	return key.str();
+}
+
+CodingDNA SequenceBank::getSequenceForStructure( const Folder& b, unsigned int gene_length, double deltaG_cutoff, StructureID struct_id )
+{
+	if ( !s_default_file.empty() ) {
+		SequenceBank bank( s_default_file );
+		CodingDNA g;
+		if ( bank.drawSequence( b, gene_length, deltaG_cutoff, struct_id, g ) )
+			return g;
+		cout << "# Warning: sequence bank " << s_default_file << " has no genes for structure " << struct_id
+			<< " with cutoff " << deltaG_cutoff << "; designing one" << endl;
+	}
+	return FolderUtil::getSequenceForStructure( b, gene_length, deltaG_cutoff, struct_id );
+}
@@ -0,0 +1,162 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#ifndef SEQUENCE_BANK_HH
+#define SEQUENCE_BANK_HH
+
+#include <vector>
+#include <string>
+
+#include "folder.hh"
+#include "coding-sequence.hh"
+
+using namespace std;
+
+/** \brief A file of pre-designed genes that fold stably into given structures.
+
+Designing a gene that folds into a target structure (see
+\ref FolderUtil::getSequenceForStructure()) can take a large share of a short run.
+A sequence bank stores pools of such genes, so that runs can draw a starting gene
+instead of designing one. A pool is identified by the folder (see \ref getFolderKey()),
+the gene length, the structure ID, and the DeltaG cutoff.
+
+The file is binary: a header, an index with one entry per pool, and the nucleotides
+of all pools. Opening a bank reads only the header and the index; a pool is read
+when a gene is drawn from it. Banks are filled with the \c fill-sequence-bank program,
+or with \ref addSequences().
+
+Example:
+\code
+SequenceBank::setDefaultFile( "lattice5.bank" );
+// draws a verified gene from the bank, or designs one if the bank has none
+CodingDNA g = SequenceBank::getSequenceForStructure( folder, 75, -5, 599 );
+\endcode
+*/
+class SequenceBank {
+public:
+	/**
+	An entry of the index of the bank.
+	*/
+	struct Pool {
+		string folder_key; ///< The key of the folder, see \ref getFolderKey().
+		unsigned int gene_length; ///< The length of the genes, in nucleotides.
+		StructureID struct_id; ///< The structure into which the genes fold.
+		double deltaG_cutoff; ///< The largest free energy of folding of the genes.
+		unsigned long long offset; ///< Position of the first gene in the file.
+		unsigned int num_sequences; ///< The number of genes.
+	};
+
+private:
+	string m_filename;
+	vector<Pool> m_pools;
+	bool m_good;
+
+	static string s_default_file;
+
+	SequenceBank( const SequenceBank & );
+	const SequenceBank & operator=( const SequenceBank & );
+
+public:
+	/**
+	Opens a bank and reads its index. A file that doesn't exist is an empty bank.
+	@param filename The name of the bank file.
+	*/
+	SequenceBank( const string& filename );
+
+	/**
+	@return False if the file exists but is not a valid sequence bank.
+	*/
+	bool good() const { return m_good; }
+
+	/**
+	@return The index of the bank.
+	*/
+	const vector<Pool>& getPools() const { return m_pools; }
+
+	/**
+	@return The number of the pool with the given key, gene length, structure, and cutoff, or -1.
+	*/
+	int findPool( const string& folder_key, unsigned int gene_length, StructureID struct_id, double deltaG_cutoff ) const;
+
+	/**
+	Reads the genes of a pool.
+	@param pool The number of the pool.
+	@param genes Set to the genes.
+	@return False if the file could not be read.
+	*/
+	bool readPool( unsigned int pool, vector<CodingDNA>& genes ) const;
+
+	/**
+	Draws a gene at random (with \ref Random) from the pool for the given folder,
+	structure, and cutoff, and checks with a fold that it folds into the structure
+	with a free energy of at most the cutoff. If it doesn't, the following genes of
+	the pool are tried.
+	@param b The folder.
+	@param gene_length The length of the gene, in nucleotides.
+	@param deltaG_cutoff The largest acceptable free energy of folding.
+	@param struct_id The structure into which the gene has to fold.
+	@param g Set to the gene.
+	@return False if the bank has no suitable gene.
+	*/
+	bool drawSequence( const Folder& b, unsigned int gene_length, double deltaG_cutoff, StructureID struct_id, CodingDNA& g ) const;
+
+	/**
+	Adds genes to the pool with the given key, gene length, structure, and cutoff,
+	creating the bank or the pool if necessary. Genes already in the pool are skipped.
+	The bank is rewritten into a temporary file that then replaces the old one, so
+	readers never see a partially written bank; concurrent writers are not supported.
+	@return False if the bank could not be read or written.
+	*/
+	static bool addSequences( const string& filename, const string& folder_key, unsigned int gene_length, StructureID struct_id, double deltaG_cutoff, const vector<CodingDNA>& genes );
+
+	/**
+	Identifies the energy model of a folder. The key consists of the number of
+	structures and a hash of the energies of a fixed probe protein in all structures
+	and of the temperature (and, for decoy folders, the number of conformations),
+	so it distinguishes lattice sizes, decoy sets, and folding parameters, but not
+	fold backends.
+	@param b The folder.
+	@param protein_length The length of the proteins.
+	@return The key, or an empty string if the folder is not a \ref DGCutoffFolder.
+	*/
+	static string getFolderKey( const Folder& b, unsigned int protein_length );
+
+	/**
+	Sets the bank that \ref getSequenceForStructure() draws from. The default is
+	no bank, i.e., genes are always designed.
+	@param filename The name of the bank file, or an empty string for no bank.
+	*/
+	static void setDefaultFile( const string& filename ) { s_default_file = filename; }
+
+	/**
+	@return The bank that \ref getSequenceForStructure() draws from, or an empty string.
+	*/
+	static const string& getDefaultFile() { return s_default_file; }
+
+	/**
+	Finds a gene with folding energy at most deltaG_cutoff and structure struct_id.
+	The gene is drawn from the default bank (see \ref setDefaultFile()) if that has
+	a pool for the folder; otherwise, it is designed with
+	\ref FolderUtil::getSequenceForStructure().
+	*/
+	static CodingDNA getSequenceForStructure( const Folder& b, unsigned int gene_length, double deltaG_cutoff, StructureID struct_id );
+};
+
+#endif // SEQUENCE_BANK_HH
@@ -32,6 +32,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 using namespace std;
 
 class Translator;
+class RandomStream;
 class CodingDNA;
 typedef CodingDNA CodingRNA;
 
@@ -95,6 +96,14 @@ public:
 	*/
 	static CodingDNA createRandomNoStops(unsigned int length);
 
+	/**
+	As @ref createRandomNoStops, but draws from a random stream instead of \ref Random.
+	@param length Length of the desired gene, in nucleotides.
+	@param rng The random stream.
+	@return The random gene.
+	*/
+	static CodingDNA createRandomNoStops(unsigned int length, RandomStream& rng);
+
 	/**
 	Tests whether the DNA sequence contains any stop codons.
 	@return True if there are no stop codons (the entire gene is coding sequence), False otherwise.
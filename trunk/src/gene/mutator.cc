@@ -43,6 +43,33 @@ bool SimpleMutator::mutate(NucleotideSequence& seq) const {
 	return changed;
 }
 
+bool SimpleMutator::mutate(NucleotideSequence& seq, RandomStream& rng) const {
+	bool changed = false;
+	const char* mutA = "CGT";
+	const char* mutC = "GTA";
+	const char* mutG = "TAC";
+	const char* mutT = "ACG";
+	for (unsigned int i=0; i<seq.length(); i++) {
+		if (rng.runif() < m_mutation_rate) {
+			changed = true;
+			int j = rng.rint( 3 );
+			switch( seq[i] ){
+			case 'A':
+				seq[i] = mutA[j]; break;
+			case 'C':
+				seq[i] = mutC[j]; break;
+			case 'G':
+				seq[i] = mutG[j]; break;
+			case 'T':
+				seq[i] = mutT[j]; break;
+			default:
+				assert( false ); // should never get here
+			}
+		}
+	}
+	return changed;
+}
+
 
 
 ////////////////////
@@ -27,6 +27,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 
 using namespace std;
 
+class RandomStream;
+
 /**
  * \brief Implements a simple mutation model in which all point mutations are equally likely.
  **/
@@ -48,6 +50,13 @@ public:
 	 * @return Whether any mutations occurred.
 	 **/
 	virtual bool mutate(NucleotideSequence& dna) const;
+
+	/**
+	 * As \ref mutate(), but draws from a random stream instead of \ref Random,
+	 * so that several threads can mutate sequences concurrently.
+	 * @return Whether any mutations occurred.
+	 **/
+	bool mutate(NucleotideSequence& dna, RandomStream& rng) const;
 };
 
 /**
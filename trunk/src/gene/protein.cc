@@ -83,6 +83,20 @@ CodingDNA CodingDNA::createRandomNoStops(unsigned int length ) {
 	return g;
 }
 
+CodingDNA CodingDNA::createRandomNoStops(unsigned int length, RandomStream& rng ) {
+	assert( length % 3 == 0 );
+	CodingDNA g( length );
+	for (unsigned int j=0; j<length/3; j++) {
+		do {
+			for (unsigned int k=0; k<3; k++) {
+				char nt = GeneticCodeUtil::DNA_NUCLEOTIDES[rng.rint( 4 )];
+				g[3*j+k] = nt;
+			}
+		} while (GeneticCodeUtil::geneticCode(g.getCodon(j)) == GeneticCodeUtil::STOP);
+	}
+	return g;
+}
+
 bool CodingDNA::encodesFullLength(void) const {
 	bool full_length = (length() % 3)==0;
 	CodingRNA rna = transcribe();
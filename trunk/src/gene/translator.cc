@@ -26,6 +26,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "genetic-code.hh"
 #include "protein.hh"
 
+#include <algorithm>
+
 
 Translator::Translator( double mutation_prob)
 		: m_mutation_prob( mutation_prob )
@@ -113,9 +115,30 @@ int Translator::translateWeighted( const CodingRNA &g, Protein& residue_sequence
 	return numErrors;
 }
 
+// Draws from the global random number generator, for translateRelativeWeightedWith().
+struct GlobalRandomStream {
+	double runif() { return Random::runif(); }
+};
+
 int Translator::translateRelativeWeighted( const CodingRNA &g, Protein& residue_sequence, const double error_weight,
 										   const vector<vector<pair<double, char> > >& weights, const double* prefCodons, 
 										   const double nonPrefCodonPenalty, bool& truncated)
+{
+	GlobalRandomStream rng;
+	return translateRelativeWeightedWith( rng, g, residue_sequence, error_weight, weights, prefCodons, nonPrefCodonPenalty, truncated );
+}
+
+int Translator::translateRelativeWeighted( const CodingRNA &g, Protein& residue_sequence, const double error_weight,
+										   const vector<vector<pair<double, char> > >& weights, const double* prefCodons,
+										   const double nonPrefCodonPenalty, bool& truncated, RandomStream& rng) const
+{
+	return translateRelativeWeightedWith( rng, g, residue_sequence, error_weight, weights, prefCodons, nonPrefCodonPenalty, truncated );
+}
+
+template<class RNG>
+int Translator::translateRelativeWeightedWith( RNG& rng, const CodingRNA &g, Protein& residue_sequence, const double error_weight,
+										   const vector<vector<pair<double, char> > >& weights, const double* prefCodons,
+										   const double nonPrefCodonPenalty, bool& truncated) const
 {
 	truncated = false;
 	int numErrors = 0;
@@ -145,10 +168,10 @@ int Translator::translateRelativeWeighted( const CodingRNA &g, Protein& residue_
 
 		// With probability threshold_prob, make a translation error (possibly synonymous).
 		double threshold_prob = m_mutation_prob * site_weight / avg_error_per_site_weight;
-		double rand = Random::runif();
+		double rand = rng.runif();
 		if ( rand < threshold_prob ) {
 			// We've made an error.  Now determine what it is.
-			rand = Random::runif();
+			rand = rng.runif();
 			double targ = 0.0;
 			// The first member of the pair is a cumulative probability; the second is
 			// the residue resulting from the error.
@@ -172,3 +195,120 @@ int Translator::translateRelativeWeighted( const CodingRNA &g, Protein& residue_
 	}
 	return numErrors;
 }
+
+
+struct greater_pair_first
+{
+	bool operator()(const pair<double, int>& p1, const pair<double, int>& p2)
+	{
+		return p1.first > p2.first;
+	}
+};
+
+TranslationWeights::TranslationWeights() {
+	// This weight matrix contains the probability that a given codon will be mistranslated as a given amino acid,
+	// including a stop (at pos 20).
+	//m_weight_matrix.resize( 64 );
+
+	//This weight matrix contains the sorted cumulative probability that
+	//a given codon will be mistranslated as a given amino acid, including a stop.
+	m_cum_weights.resize(64);
+
+	for (int c=0; c<64; c++)
+	{
+		//m_weight_matrix[c].resize( 21 ); // 20 aa's plus stop
+		m_cum_weights[c].resize(21, pair<double,int>(0.0,-2));
+	}
+	vector<vector<double> > codon_to_codon_probabilities(64);
+	for ( int c = 0; c<64; c++ )
+	{
+		codon_to_codon_probabilities[c].resize(64);
+		double total_weight = 0.0;
+		// now loop over all target codons
+		// compute normalization
+		for ( int tc = 0; tc<64; tc++ )
+		{
+			total_weight += calcWeight(c, tc);
+		}
+		// compute probabilities of transitions to each codon
+		for ( int tc = 0; tc<64; tc++ )
+		{
+			double w = calcWeight(c, tc);
+			codon_to_codon_probabilities[c][tc] = w/total_weight;
+		}
+	}
+	// Now compute the codon-to-aa probabilities
+	for ( int c=0; c<64; c++ ) {
+		for (int aa=0; aa<21; aa++)	{
+			if (aa<20) {
+				m_cum_weights[c][aa].second = GeneticCodeUtil::indexToAminoAcidLetter(aa);
+			}
+			else {
+				m_cum_weights[c][aa].second = GeneticCodeUtil::STOP;
+			}
+		}
+		for (int tc=0; tc<64; tc++)	{
+			Codon codon = GeneticCodeUtil::indexToCodon(tc);
+			char aa_char = GeneticCodeUtil::geneticCode(codon);
+			int aa = GeneticCodeUtil::aminoAcidLetterToIndex(aa_char);
+			if (aa < 0)	{
+				aa = 20;
+			}
+
+			//m_weight_matrix[c][aa] += codon_to_codon_probabilities[c][tc];
+			m_cum_weights[c][aa].first += codon_to_codon_probabilities[c][tc];
+		}
+		// Sort the weights in preparation for computing ordered cumulative probabilities
+		vector<pair<double,char> >& v = m_cum_weights[c];
+		sort(v.begin(), v.end(), greater_pair_first());
+		// Calculate the cumulative probabilities.
+		double tot = 0.0;
+		for (unsigned int i=0; i<m_cum_weights[c].size(); i++) {
+			pair<double, char>&p = m_cum_weights[c][i];
+			p.first += tot;
+			tot = p.first;
+		}
+	}
+}
+
+shared_ptr<const TranslationWeights> TranslationWeights::getShared()
+{
+	// built once, on first use; initialization of local statics is thread-safe
+	static shared_ptr<const TranslationWeights> weights( new TranslationWeights() );
+	return weights;
+}
+
+double TranslationWeights::calcWeight( int co, int ct )
+{
+	if ( co == ct )
+		return 0;
+
+	double stop_factor = 1;
+	Codon from_codon = GeneticCodeUtil::indexToCodon(co);
+	Codon to_codon = GeneticCodeUtil::indexToCodon(ct);
+	if ( GeneticCodeUtil::geneticCode(to_codon) == GeneticCodeUtil::STOP ) // does target codon code for stop?
+		stop_factor = 0.33; // then probability is reduced to approx. one third.
+
+	if (from_codon.distance(to_codon) == 1) {
+		if (from_codon[0] != to_codon[0]) {
+			if ( GeneticCodeUtil::isTransition( from_codon[0], to_codon[0] ) )
+				return 1.*stop_factor;
+			else
+				return 0.5*stop_factor;
+		}
+		if (from_codon[1] != to_codon[1]) {
+			if ( GeneticCodeUtil::isTransition( from_codon[1], to_codon[1] ) )
+				return 0.5*stop_factor;
+			else
+				return 0.1*stop_factor;
+		}
+		if (from_codon[2] != to_codon[2]) {
+			if ( GeneticCodeUtil::isTransition( from_codon[2], to_codon[2] ) )
+				return 1.*stop_factor;
+			else
+				return 1.*stop_factor;
+		}
+	}
+
+	return 0;
+}
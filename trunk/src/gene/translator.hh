@@ -22,14 +22,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #define TRANSLATOR_HH
 
 #include <vector>
+#include <memory>
 #include "coding-sequence.hh"
 #include "protein.hh"
+#include "random.hh"
 
 class Translator
 {
 private:
 	double m_mutation_prob;
 
+	template<class RNG>
+	int translateRelativeWeightedWith( RNG& rng, const CodingRNA &g, Protein& residue_sequence, const double relative_gene_weight,
+								   const vector<vector<pair<double, char> > >& weights, const double* prefCodons, const double nonPrefCodonPenalty, bool& truncated) const;
+
 	Translator( const Translator & );
 	Translator& operator=( const Translator & );
 public:
@@ -43,8 +49,53 @@ public:
 						   const double* prefCodons, const double nonPrefCodonPenalty, bool& truncated);
 	int translateRelativeWeighted( const CodingRNA &g, Protein& residue_sequence, const double relative_gene_weight,
 								   const vector<vector<pair<double, char> > >& weights, const double* prefCodons, const double nonPrefCodonPenalty, bool& truncated);
+
+	/**
+	Like the function above, but draws the random numbers from the given stream
+	instead of \ref Random, so that several threads can translate at once.
+	*/
+	int translateRelativeWeighted( const CodingRNA &g, Protein& residue_sequence, const double relative_gene_weight,
+								   const vector<vector<pair<double, char> > >& weights, const double* prefCodons, const double nonPrefCodonPenalty, bool& truncated,
+								   RandomStream& rng) const;
 };
 
 
+/** \brief The probabilities with which each codon is mistranslated as each amino acid.
+
+The probability of misreading a codon as another one depends only on the positions
+and kinds (transition or transversion) of the differing bases, and is reduced for
+stop codons. The tables therefore depend only on the (fixed) genetic code: not on
+the error rate, the accuracy and error weights, or the codon cost table of an
+evaluator such as \ref ErrorproneTranslation, which scale the probability of an
+error at a site, not its outcome. There is a single instance per process, built on
+first use and shared, read-only, by all evaluators and threads (see \ref getShared()).
+*/
+class TranslationWeights
+{
+private:
+	vector<vector<pair<double, char> > > m_cum_weights;
+
+	TranslationWeights();
+	TranslationWeights( const TranslationWeights & );
+	TranslationWeights& operator=( const TranslationWeights & );
+
+	/**
+	@return The relative probability that codon co is read as codon ct.
+	*/
+	static double calcWeight( int co, int ct );
+
+public:
+	/**
+	@return The tables, which are built on first use.
+	*/
+	static shared_ptr<const TranslationWeights> getShared();
+
+	/**
+	For each codon (by index), the possible outcomes of a translation error, most
+	likely first, with the cumulative probability and the resulting amino acid
+	(or \ref GeneticCodeUtil::STOP). This is the format that \ref Translator expects.
+	*/
+	const vector<vector<pair<double, char> > >& getCumulativeWeights() const { return m_cum_weights; }
+};
 
 #endif
@@ -161,6 +161,18 @@ double Random::dpois(NTYPE x, double lb) {
 // end Loader algorithm
 
 
+RandomStream::RandomStream( uint seed, unsigned long long stream )
+{
+	// SplitMix64 of seed and stream number; never zero
+	unsigned long long z = ( ( (unsigned long long) seed << 32 ) ^ stream ) + 0x9E3779B97F4A7C15ULL*( stream + 1 );
+	z = ( z ^ ( z >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+	z = ( z ^ ( z >> 27 ) ) * 0x94D049BB133111EBULL;
+	m_state = z ^ ( z >> 31 );
+	if ( m_state == 0 )
+		m_state = 0x9E3779B97F4A7C15ULL;
+}
+
+
 uint Random::rint()
 {
 	return randomMT();
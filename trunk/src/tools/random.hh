@@ -139,5 +139,53 @@ public:
 };
 
 
+/** \brief An independent stream of random numbers, for use in parallel code.
+
+Unlike \ref Random, which has one global state, every RandomStream object has
+its own state, so different threads can draw random numbers concurrently. A
+stream is determined by a seed and a stream number; streams with different
+numbers are statistically independent. Giving each unit of parallel work (e.g.,
+each generated structure) its own stream number makes results independent of
+how the work is distributed over threads.
+
+The generator is xorshift64* (S. Vigna, ACM Trans. Math. Softw. 42:30, 2016),
+initialized with the SplitMix64 hash of seed and stream number. It is not the
+Mersenne Twister, so the numbers differ from those of \ref Random.
+*/
+class RandomStream
+{
+private:
+	unsigned long long m_state;
+
+public:
+	/**
+	* @param seed The seed.
+	* @param stream The stream number.
+	*/
+	RandomStream( uint seed, unsigned long long stream = 0 );
+
+	/**
+	* @return A random 32 bit unsigned integer on the interval [0, 2^32-1].
+	*/
+	uint rint() {
+		m_state ^= m_state >> 12;
+		m_state ^= m_state << 25;
+		m_state ^= m_state >> 27;
+		return static_cast<uint>( ( m_state * 2685821657736338717ULL ) >> 32 );
+	}
+
+	/**
+	* @param max Upper bound to the random integers.
+	* @return A random 32 bit unsigned integer on the interval [0, max-1].
+	*/
+	uint rint( uint max ) { return static_cast<uint>( max*runif() ); }
+
+	/**
+	* @return A random double chosen from uniform distribution on the interval [0, 1).
+	*/
+	double runif() { return rint() * 2.3283064365386963e-10; }
+};
+
+
 
 #endif
@@ -0,0 +1,259 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "shared-segment.hh"
+
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// The segment starts with a header that tells attaching processes whether
+// the creator has finished writing, and which process the creator is.
+// The payload starts at HEADER_SIZE.
+struct SegmentHeader {
+	unsigned int magic;
+	volatile unsigned int ready;
+	unsigned long long size;
+	int creator; ///< Process ID of the creator.
+};
+
+static const unsigned int SEGMENT_MAGIC = 0x4c4f5645; // "EVOL"
+static const size_t HEADER_SIZE = 64;
+
+// time (in seconds) that a creator may take to write the header after creating the segment
+static const double HEADER_TIMEOUT = 1.;
+
+static double wallTime()
+{
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+
+SharedSegment::SharedSegment()
+	: m_fd( -1 ), m_map( 0 ), m_map_size( 0 ), m_data_offset( 0 ), m_writable( false ),
+	m_stale( false ), m_stale_dev( 0 ), m_stale_ino( 0 )
+{
+}
+
+SharedSegment::~SharedSegment()
+{
+	close();
+}
+
+bool SharedSegment::isSharedMemoryName( const string& name )
+{
+	return name.size() > 1 && name[0] == '/' && name.find( '/', 1 ) == string::npos;
+}
+
+int SharedSegment::openName( const string& name, int flags ) const
+{
+	if ( isSharedMemoryName( name ) )
+		return shm_open( name.c_str(), flags, 0644 );
+	else
+		return open( name.c_str(), flags, 0644 );
+}
+
+void SharedSegment::close()
+{
+	if ( m_map )
+		munmap( m_map, m_map_size );
+	if ( m_fd >= 0 )
+		::close( m_fd );
+	m_map = 0;
+	m_map_size = 0;
+	m_data_offset = 0;
+	m_fd = -1;
+	m_writable = false;
+}
+
+bool SharedSegment::creatorExited( const struct stat& st, double waited ) const
+{
+	SegmentHeader h;
+	if ( (size_t) st.st_size < HEADER_SIZE || pread( m_fd, &h, sizeof( h ), 0 ) != (ssize_t) sizeof( h ) )
+		// the creator writes the header right after creating the segment
+		return waited > HEADER_TIMEOUT;
+	if ( h.magic != SEGMENT_MAGIC || h.ready )
+		return false;
+	// signal 0 only checks whether the process exists
+	return kill( h.creator, 0 ) != 0 && errno == ESRCH;
+}
+
+bool SharedSegment::attach( const string& name, double timeout )
+{
+	close();
+	m_stale = false;
+	double start = wallTime();
+	m_fd = openName( name, O_RDONLY );
+	if ( m_fd < 0 )
+		return false;
+
+	// wait until the creator has published the segment
+	while ( true ) {
+		struct stat st;
+		if ( fstat( m_fd, &st ) == 0 && (size_t) st.st_size >= HEADER_SIZE ) {
+			void* p = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0 );
+			if ( p != MAP_FAILED ) {
+				const SegmentHeader* h = (const SegmentHeader*) p;
+				if ( h->magic == SEGMENT_MAGIC && h->ready && HEADER_SIZE + h->size <= (size_t) st.st_size ) {
+					m_map = (char*) p;
+					m_map_size = st.st_size;
+					m_data_offset = HEADER_SIZE;
+					m_name = name;
+					return true;
+				}
+				munmap( p, st.st_size );
+			}
+		}
+		double waited = wallTime() - start;
+		if ( fstat( m_fd, &st ) == 0 && creatorExited( st, waited ) ) {
+			// the segment will never be published
+			m_stale = true;
+			m_stale_dev = st.st_dev;
+			m_stale_ino = st.st_ino;
+			break;
+		}
+		if ( waited > timeout )
+			break;
+		usleep( 10000 );
+	}
+	close();
+	return false;
+}
+
+bool SharedSegment::removeStale( const string& name )
+{
+	if ( !m_stale )
+		return false;
+	m_stale = false;
+	// another process may have removed the stale segment and created a new one already
+	int fd = openName( name, O_RDONLY );
+	if ( fd < 0 )
+		return false;
+	struct stat st;
+	bool same = fstat( fd, &st ) == 0 && st.st_dev == m_stale_dev && st.st_ino == m_stale_ino;
+	::close( fd );
+	if ( same )
+		remove( name );
+	return same;
+}
+
+bool SharedSegment::create( const string& name )
+{
+	close();
+	m_fd = openName( name, O_RDWR | O_CREAT | O_EXCL );
+	if ( m_fd < 0 )
+		return false;
+	m_name = name;
+	// write the header at once, so that attaching processes can tell whether we are alive
+	SegmentHeader h;
+	h.magic = SEGMENT_MAGIC;
+	h.ready = 0;
+	h.size = 0;
+	h.creator = getpid();
+	if ( ftruncate( m_fd, HEADER_SIZE ) != 0 || pwrite( m_fd, &h, sizeof( h ), 0 ) != (ssize_t) sizeof( h ) ) {
+		close();
+		remove( name );
+		return false;
+	}
+	return true;
+}
+
+char* SharedSegment::allocate( size_t size )
+{
+	assert( m_fd >= 0 && !m_map );
+	m_map_size = HEADER_SIZE + size;
+	if ( ftruncate( m_fd, m_map_size ) != 0 )
+		return 0;
+	void* p = mmap( 0, m_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+	if ( p == MAP_FAILED )
+		return 0;
+	m_map = (char*) p;
+	m_data_offset = HEADER_SIZE;
+	m_writable = true;
+	SegmentHeader* h = (SegmentHeader*) m_map;
+	h->magic = SEGMENT_MAGIC;
+	h->size = size;
+	h->ready = 0;
+	h->creator = getpid();
+	return m_map + HEADER_SIZE;
+}
+
+void SharedSegment::publish()
+{
+	assert( m_map && m_writable );
+	// all payload writes must be visible before the ready flag
+	__sync_synchronize();
+	((SegmentHeader*) m_map)->ready = 1;
+	__sync_synchronize();
+	mprotect( m_map, m_map_size, PROT_READ );
+	m_writable = false;
+}
+
+bool SharedSegment::mapFile( const string& filename )
+{
+	close();
+	m_fd = open( filename.c_str(), O_RDONLY );
+	if ( m_fd < 0 )
+		return false;
+	struct stat st;
+	if ( fstat( m_fd, &st ) != 0 || st.st_size == 0 ) {
+		close();
+		return false;
+	}
+	void* p = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0 );
+	if ( p == MAP_FAILED ) {
+		close();
+		return false;
+	}
+	m_map = (char*) p;
+	m_map_size = st.st_size;
+	m_data_offset = 0;
+	m_name = filename;
+	return true;
+}
+
+void SharedSegment::remove( const string& name )
+{
+	if ( isSharedMemoryName( name ) )
+		shm_unlink( name.c_str() );
+	else
+		unlink( name.c_str() );
+}
+
+const char* SharedSegment::data() const
+{
+	return m_map ? m_map + m_data_offset : 0;
+}
+
+size_t SharedSegment::size() const
+{
+	if ( !m_map )
+		return 0;
+	if ( m_data_offset == 0 ) // a mapped file
+		return m_map_size;
+	return (size_t) ((const SegmentHeader*) m_map)->size;
+}
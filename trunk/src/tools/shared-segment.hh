@@ -0,0 +1,166 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#ifndef SHARED_SEGMENT_HH
+#define SHARED_SEGMENT_HH
+
+#include <string>
+#include <cstddef>
+#include <sys/types.h>
+
+struct stat;
+
+using namespace std;
+
+/** \brief A named block of read-only memory that is shared between processes.
+
+Names of the form "/name" (one leading slash and no other slash) denote POSIX
+shared-memory objects (see shm_open(3)); all other names are interpreted as paths
+of ordinary files, which are mapped into memory with mmap. Exactly one process
+creates the segment, fills it, and publishes it. All other processes attach
+read-only and share the same physical pages. A typical use looks like this:
+\code
+SharedSegment seg;
+if ( seg.attach( name ) ) {
+	// use seg.data()
+}
+else if ( seg.create( name ) ) {
+	char* p = seg.allocate( size );
+	// fill p
+	seg.publish();
+}
+else if ( seg.attach( name ) ) {
+	// another process created the segment in the meantime
+}
+\endcode
+
+The header of a segment records the process ID of its creator. If the creator
+exits before publishing, \ref attach() notices this and fails at once instead of
+waiting for the timeout; \ref removeStale() then removes the orphaned segment, so
+that the next \ref create() can succeed. This check assumes that all processes
+that share a segment run on the same host.
+
+Published segments are never removed automatically: they persist after all
+processes have exited, so that later runs attach without rebuilding them.
+Shared-memory objects live until \ref remove() is called or the host reboots
+(on Linux, they can also be deleted from /dev/shm); files stay until they are
+deleted.
+*/
+class SharedSegment {
+private:
+	string m_name;
+	int m_fd;
+	char* m_map; ///< The mapped memory, including the header.
+	size_t m_map_size;
+	size_t m_data_offset; ///< Start of the payload in the mapped memory.
+	bool m_writable;
+	bool m_stale; ///< True if the last attach() found a segment whose creator exited before publishing it.
+	dev_t m_stale_dev; ///< Device of the stale segment.
+	ino_t m_stale_ino; ///< Inode of the stale segment.
+
+	SharedSegment( const SharedSegment & );
+	const SharedSegment & operator=( const SharedSegment & );
+
+	static bool isSharedMemoryName( const string& name );
+	int openName( const string& name, int flags ) const;
+	void close();
+
+	/**
+	@param st The status of the open, unpublished segment.
+	@param waited The time (in seconds) spent waiting for the segment so far.
+	@return True if the creator of the segment exited without publishing it.
+	*/
+	bool creatorExited( const struct stat& st, double waited ) const;
+
+public:
+	SharedSegment();
+	~SharedSegment();
+
+	/**
+	Attaches read-only to an existing segment. If the segment exists but has not
+	been published yet, waits for the creating process to publish it, unless that
+	process has exited.
+	@param name The name of the segment.
+	@param timeout Maximum time (in seconds) to wait for the segment to be published.
+	@return True if the segment could be attached.
+	*/
+	bool attach( const string& name, double timeout = 600. );
+
+	/**
+	Removes the segment if the last call of \ref attach() failed because its
+	creator exited before publishing it. A segment that another process has
+	created under the same name in the meantime is left alone.
+	@param name The name passed to \ref attach().
+	@return True if a stale segment was removed.
+	*/
+	bool removeStale( const string& name );
+
+	/**
+	Creates a new segment. Fails if a segment of that name exists already.
+	@param name The name of the segment.
+	@return True if this process created the segment and is responsible for publishing it.
+	*/
+	bool create( const string& name );
+
+	/**
+	Sets the size of a newly created segment and maps it writable.
+	@param size The number of bytes required.
+	@return Pointer to the writable memory, or NULL on error.
+	*/
+	char* allocate( size_t size );
+
+	/**
+	Marks a newly created segment as complete, so that waiting processes
+	can attach, and makes the memory of this process read-only.
+	*/
+	void publish();
+
+	/**
+	Maps an ordinary file into memory, read-only. Unlike a segment, the file
+	has no header; its whole content is the payload. Processes that map the
+	same file share its pages.
+	@param filename The path of the file.
+	@return True if the file could be mapped.
+	*/
+	bool mapFile( const string& filename );
+
+	/**
+	Removes a segment of the given name from the system. Processes that are
+	attached to the segment keep their mapping.
+	*/
+	static void remove( const string& name );
+
+	/**
+	@return The shared memory, or NULL if no segment is attached.
+	*/
+	const char* data() const;
+
+	/**
+	@return The number of bytes of shared memory.
+	*/
+	size_t size() const;
+
+	/**
+	@return True if a segment is attached or allocated, or a file is mapped.
+	*/
+	bool good() const { return m_map != 0; }
+};
+
+#endif // SHARED_SEGMENT_HH
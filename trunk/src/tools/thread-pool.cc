@@ -0,0 +1,129 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "thread-pool.hh"
+
+#include <unistd.h>
+#include <iostream>
+
+
+ThreadPool::ThreadPool( unsigned int num_threads )
+	: m_task( 0 ), m_num_items( 0 ), m_next_item( 0 ), m_num_done( 0 ), m_generation( 0 ), m_stop( false )
+{
+	pthread_mutex_init( &m_mutex, 0 );
+	pthread_mutex_init( &m_run_mutex, 0 );
+	pthread_cond_init( &m_work_cond, 0 );
+	pthread_cond_init( &m_done_cond, 0 );
+	for ( unsigned int i=1; i<num_threads; i++ ) {
+		pthread_t thread;
+		if ( pthread_create( &thread, 0, threadMain, this ) != 0 ) {
+			cout << "# Warning: cannot start more than " << i << " threads." << endl;
+			break;
+		}
+		m_threads.push_back( thread );
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	pthread_mutex_lock( &m_mutex );
+	m_stop = true;
+	pthread_cond_broadcast( &m_work_cond );
+	pthread_mutex_unlock( &m_mutex );
+	for ( unsigned int i=0; i<m_threads.size(); i++ )
+		pthread_join( m_threads[i], 0 );
+	pthread_cond_destroy( &m_done_cond );
+	pthread_cond_destroy( &m_work_cond );
+	pthread_mutex_destroy( &m_run_mutex );
+	pthread_mutex_destroy( &m_mutex );
+}
+
+void* ThreadPool::threadMain( void* pool )
+{
+	static_cast<ThreadPool*>( pool )->workerLoop();
+	return 0;
+}
+
+void ThreadPool::workerLoop()
+{
+	unsigned int generation = 0;
+	pthread_mutex_lock( &m_mutex );
+	while ( true ) {
+		while ( !m_stop && m_generation == generation )
+			pthread_cond_wait( &m_work_cond, &m_mutex );
+		if ( m_stop )
+			break;
+		generation = m_generation;
+		pthread_mutex_unlock( &m_mutex );
+		work();
+		pthread_mutex_lock( &m_mutex );
+	}
+	pthread_mutex_unlock( &m_mutex );
+}
+
+void ThreadPool::work()
+{
+	pthread_mutex_lock( &m_mutex );
+	while ( m_task && m_next_item < m_num_items ) {
+		ThreadTask* task = m_task;
+		unsigned int item = m_next_item++;
+		pthread_mutex_unlock( &m_mutex );
+		task->run( item );
+		pthread_mutex_lock( &m_mutex );
+		m_num_done += 1;
+		if ( m_num_done == m_num_items )
+			pthread_cond_broadcast( &m_done_cond );
+	}
+	pthread_mutex_unlock( &m_mutex );
+}
+
+void ThreadPool::run( ThreadTask& task, unsigned int num_items )
+{
+	// without workers, or while the pool is busy, the caller does all the work
+	if ( m_threads.empty() || num_items < 2 || pthread_mutex_trylock( &m_run_mutex ) != 0 ) {
+		for ( unsigned int i=0; i<num_items; i++ )
+			task.run( i );
+		return;
+	}
+
+	pthread_mutex_lock( &m_mutex );
+	m_task = &task;
+	m_num_items = num_items;
+	m_next_item = 0;
+	m_num_done = 0;
+	m_generation += 1;
+	pthread_cond_broadcast( &m_work_cond );
+	pthread_mutex_unlock( &m_mutex );
+
+	work();
+
+	pthread_mutex_lock( &m_mutex );
+	while ( m_num_done < m_num_items )
+		pthread_cond_wait( &m_done_cond, &m_mutex );
+	m_task = 0;
+	pthread_mutex_unlock( &m_mutex );
+	pthread_mutex_unlock( &m_run_mutex );
+}
+
+unsigned int ThreadPool::getNumProcessors()
+{
+	long n = sysconf( _SC_NPROCESSORS_ONLN );
+	return n > 0 ? n : 1;
+}
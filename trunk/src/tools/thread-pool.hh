@@ -0,0 +1,111 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <vector>
+#include <pthread.h>
+
+using namespace std;
+
+/** \brief A unit of work for a \ref ThreadPool: a set of numbered items that can be processed independently.
+*/
+class ThreadTask {
+public:
+	virtual ~ThreadTask() {}
+
+	/**
+	Processes one item. Called concurrently for different items.
+	@param item The number of the item, between 0 and the number of items minus one.
+	*/
+	virtual void run( unsigned int item ) = 0;
+};
+
+/** \brief A fixed set of worker threads that process the items of a \ref ThreadTask in parallel.
+
+The thread that calls \ref run() works on the items as well, so a pool of n
+threads starts n-1 workers. Items are handed out one at a time, in increasing
+order, to whichever thread is free; tasks that need reproducible results must
+therefore not depend on which thread processes which item. If the pool is busy,
+e.g. because \ref run() is called from within a task, the items are processed
+in the calling thread.
+
+Example:
+\code
+class SquareTask : public ThreadTask {
+public:
+	vector<double> x;
+	void run( unsigned int item ) { x[item] *= x[item]; }
+};
+
+ThreadPool pool( 4 );
+SquareTask task;
+task.x.resize( 1000, 2. );
+pool.run( task, task.x.size() );
+\endcode
+*/
+class ThreadPool {
+private:
+	vector<pthread_t> m_threads;
+	pthread_mutex_t m_mutex; ///< Protects all members below.
+	pthread_cond_t m_work_cond; ///< Signals a new task or shutdown to the workers.
+	pthread_cond_t m_done_cond; ///< Signals completion of all items.
+	pthread_mutex_t m_run_mutex; ///< Held for the duration of \ref run().
+	ThreadTask* m_task;
+	unsigned int m_num_items;
+	unsigned int m_next_item;
+	unsigned int m_num_done;
+	unsigned int m_generation; ///< Incremented for every task.
+	bool m_stop;
+
+	ThreadPool( const ThreadPool & );
+	const ThreadPool & operator=( const ThreadPool & );
+
+	static void* threadMain( void* pool );
+	void workerLoop();
+	void work();
+
+public:
+	/**
+	@param num_threads The number of threads that work on a task, including the calling thread.
+	*/
+	ThreadPool( unsigned int num_threads );
+	~ThreadPool();
+
+	/**
+	@return The number of threads that work on a task, including the calling thread.
+	*/
+	unsigned int getNumThreads() const { return m_threads.size() + 1; }
+
+	/**
+	Processes all items of a task and returns when they are done.
+	@param task The task.
+	@param num_items The number of items.
+	*/
+	void run( ThreadTask& task, unsigned int num_items );
+
+	/**
+	@return The number of online processors, or 1 if it cannot be determined.
+	*/
+	static unsigned int getNumProcessors();
+};
+
+#endif // THREAD_POOL_HH
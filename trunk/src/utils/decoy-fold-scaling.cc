@@ -0,0 +1,147 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "decoy-contact-folder.hh"
+#include "coding-sequence.hh"
+#include "thread-pool.hh"
+#include "random.hh"
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <sys/time.h>
+
+
+struct Parameters
+{
+	int num_decoys;
+	int protein_length;
+	int num_proteins;
+	unsigned int max_threads;
+	int random_seed;
+};
+
+
+ostream & operator<<( ostream &s, const Parameters &p )
+{
+	s << "# Parameters:" << endl;
+	s << "#   decoys: " << p.num_decoys << endl;
+	s << "#   protein length: " << p.protein_length << endl;
+	s << "#   proteins: " << p.num_proteins << endl;
+	s << "#   max. threads: " << p.max_threads << endl;
+	s << "#   random seed: " << p.random_seed << endl;
+	s << "#" << endl;
+	return s;
+}
+
+Parameters getParams( int ac, char **av )
+{
+	if ( ac != 6 )
+	{
+		cout << "Start program like this:" << endl;
+		cout << "  " << av[0] << " <num decoys> <prot length> <num proteins> <max threads>|0 <random seed>" << endl;
+		exit (-1);
+	}
+
+	Parameters p;
+	int i = 1;
+	p.num_decoys = atoi( av[i++] );
+	p.protein_length = atoi( av[i++] );
+	p.num_proteins = atoi( av[i++] );
+	p.max_threads = atoi( av[i++] );
+	if ( p.max_threads == 0 )
+		p.max_threads = ThreadPool::getNumProcessors();
+	p.random_seed = atoi( av[i++] );
+
+	return p;
+}
+
+double wallTime()
+{
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+/**
+ * Creates a random decoy with about 2.5 contacts per residue. Contact orders
+ * (sequence separations) are geometric with mean 20, and at least 2.
+ **/
+DecoyContactStructure* createRandomDecoy( int length )
+{
+	vector<Contact> contacts;
+	int num_contacts = 5*length/2;
+	while ( (int) contacts.size() < num_contacts ) {
+		int r1 = Random::rint( length );
+		int r2 = r1 + 2 + (int) ( -18*log( 1 - Random::runif() ) );
+		if ( r2 < length )
+			contacts.push_back( Contact( r1, r2 ) );
+	}
+	return new DecoyContactStructure( contacts );
+}
+
+int main( int ac, char **av)
+{
+	Parameters p = getParams( ac, av );
+	cout << p;
+	Random::seed( p.random_seed );
+
+	double start = wallTime();
+	vector<DecoyContactStructure*> structs;
+	for ( int i=0; i<p.num_decoys; i++ )
+		structs.push_back( createRandomDecoy( p.protein_length ) );
+	DecoyContactFolder folder( p.protein_length, 160.0*log(10.0), structs );
+	vector<Protein> proteins;
+	for ( int i=0; i<p.num_proteins; i++ )
+		proteins.push_back( CodingDNA::createRandomNoStops( 3*p.protein_length ).translate() );
+	cout << "# Setup time: " << wallTime() - start << " s" << endl;
+
+	// fold the same proteins with increasing numbers of threads
+	vector<double> ref_dGs;
+	vector<StructureID> ref_sids;
+	double ref_time = 0;
+	vector<unsigned int> thread_counts;
+	for ( unsigned int threads = 1; threads < p.max_threads; threads *= 2 )
+		thread_counts.push_back( threads );
+	thread_counts.push_back( p.max_threads );
+
+	cout << "threads\ttime\tspeedup\tidentical" << endl;
+	for ( unsigned int k=0; k<thread_counts.size(); k++ ) {
+		unsigned int threads = thread_counts[k];
+		folder.setNumThreads( threads );
+		bool identical = true;
+		start = wallTime();
+		for ( int i=0; i<p.num_proteins; i++ ) {
+			auto_ptr<FoldInfo> fi( folder.fold( proteins[i] ) );
+			if ( threads == 1 ) {
+				ref_dGs.push_back( fi->getDeltaG() );
+				ref_sids.push_back( fi->getStructure() );
+			}
+			else if ( fi->getDeltaG() != ref_dGs[i] || fi->getStructure() != ref_sids[i] )
+				identical = false;
+		}
+		double t = wallTime() - start;
+		if ( threads == 1 )
+			ref_time = t;
+		cout << threads << "\t" << t << "\t" << ref_time/t << "\t" << ( identical ? "yes" : "no" ) << endl;
+	}
+
+	return 0;
+}
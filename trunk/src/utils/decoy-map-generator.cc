@@ -0,0 +1,288 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "decoy-contact-folder.hh"
+#include "thread-pool.hh"
+#include "random.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// number of decoys generated per thread-pool item
+#define DECOYS_PER_ITEM 256
+
+
+struct Parameters
+{
+	string structure_file;
+	string structure_dir;
+	int num_decoys;
+	int protein_length;
+	string output_dir;
+	int random_seed;
+	unsigned int num_threads;
+};
+
+
+ostream & operator<<( ostream &s, const Parameters &p )
+{
+	s << "# Parameters:" << endl;
+	s << "#   native structure file: " << p.structure_file << endl;
+	s << "#   native structure directory: " << p.structure_dir << endl;
+	s << "#   decoys: " << p.num_decoys << endl;
+	s << "#   protein length: " << p.protein_length << endl;
+	s << "#   output directory: " << p.output_dir << endl;
+	s << "#   random seed: " << p.random_seed << endl;
+	s << "#   threads: " << p.num_threads << endl;
+	s << "#" << endl;
+	return s;
+}
+
+Parameters getParams( int ac, char **av )
+{
+	if ( ac != 7 && ac != 8 )
+	{
+		cout << "Start program like this:" << endl;
+		cout << "  " << av[0] << " <native list file> <native dir> <num decoys> <prot length> <output dir> <random seed> [<threads>|0]" << endl;
+		exit (-1);
+	}
+
+	Parameters p;
+	int i = 1;
+	p.structure_file = av[i++];
+	p.structure_dir = av[i++];
+	p.num_decoys = atoi( av[i++] );
+	p.protein_length = atoi( av[i++] );
+	p.output_dir = av[i++];
+	if ( p.output_dir.empty() || p.output_dir[p.output_dir.size()-1] != '/' )
+		p.output_dir += '/';
+	p.random_seed = atoi( av[i++] );
+	p.num_threads = 1;
+	if ( ac == 8 )
+		p.num_threads = atoi( av[i++] );
+	if ( p.num_threads == 0 )
+		p.num_threads = ThreadPool::getNumProcessors();
+
+	return p;
+}
+
+double wallTime()
+{
+	struct timeval tv;
+	gettimeofday( &tv, 0 );
+	return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+
+/**
+Contact statistics of the native structures that the decoys should reproduce.
+*/
+struct MapStatistics
+{
+	double contacts_per_residue;
+	vector<double> order_cdf; ///< order_cdf[s] is the number of contacts of order at most s
+	int max_degree; ///< largest number of contacts of a single residue, ignoring outliers
+};
+
+MapStatistics calcStatistics( const vector<DecoyContactStructure*>& structs, int length )
+{
+	MapStatistics stats;
+	stats.max_degree = 0;
+	vector<double> order_counts( length, 0 );
+	vector<double> degree_counts;
+	double num_residues = 0;
+	double num_contacts = 0;
+	vector<int> degree;
+	for ( unsigned int k=0; k<structs.size(); k++ ) {
+		const vector<Contact>& contacts = structs[k]->getContacts();
+		num_residues += structs[k]->getMaxResidueNumber() + 1;
+		num_contacts += contacts.size();
+		degree.assign( structs[k]->getMaxResidueNumber() + 1, 0 );
+		for ( unsigned int c=0; c<contacts.size(); c++ ) {
+			int s = abs( contacts[c].first - contacts[c].second );
+			// contacts that don't fit into the decoys are left out of the order distribution
+			if ( s < length )
+				order_counts[s] += 1;
+			degree[contacts[c].first] += 1;
+			degree[contacts[c].second] += 1;
+		}
+		for ( unsigned int r=0; r<degree.size(); r++ ) {
+			if ( degree[r] >= (int) degree_counts.size() )
+				degree_counts.resize( degree[r] + 1, 0 );
+			degree_counts[degree[r]] += 1;
+		}
+	}
+	// some native maps contain a residue (e.g., a misnumbered ligand) in contact
+	// with almost everything, so the cap is the 99.9% quantile of the degrees
+	double sum = 0;
+	while ( stats.max_degree < (int) degree_counts.size() && sum < 0.999*num_residues ) {
+		sum += degree_counts[stats.max_degree];
+		stats.max_degree++;
+	}
+	stats.max_degree = max( stats.max_degree - 1, 1 );
+	stats.contacts_per_residue = num_residues > 0 ? num_contacts/num_residues : 0;
+	stats.order_cdf.resize( length );
+	sum = 0;
+	for ( int s=0; s<length; s++ ) {
+		sum += order_counts[s];
+		stats.order_cdf[s] = sum;
+	}
+	return stats;
+}
+
+
+/**
+Generates one decoy: contacts are placed at random, with orders drawn from the
+native order distribution, until the decoy has the native contact density.
+Contacts that would duplicate an existing contact, or give a residue more
+contacts than any native residue has, are rejected.
+*/
+void generateMap( const MapStatistics& stats, int length, RandomStream& rng, vector<char>& occupied, vector<int>& degree, vector<Contact>& contacts )
+{
+	contacts.clear();
+	double total = stats.order_cdf.back();
+	if ( total <= 0 )
+		return;
+	int num_contacts = (int) ( stats.contacts_per_residue*length + 0.5 );
+	int max_attempts = 100*num_contacts;
+	for ( int attempt=0; attempt<max_attempts && (int) contacts.size() < num_contacts; attempt++ ) {
+		double u = total*rng.runif();
+		int s = upper_bound( stats.order_cdf.begin(), stats.order_cdf.end(), u ) - stats.order_cdf.begin();
+		if ( s >= length )
+			continue;
+		int i = rng.rint( length - s );
+		int j = i + s;
+		if ( occupied[i*length + j] || degree[i] >= stats.max_degree || degree[j] >= stats.max_degree )
+			continue;
+		occupied[i*length + j] = 1;
+		degree[i] += 1;
+		degree[j] += 1;
+		contacts.push_back( Contact( i, j ) );
+	}
+	// reset the work arrays for the next decoy
+	for ( unsigned int c=0; c<contacts.size(); c++ ) {
+		occupied[contacts[c].first*length + contacts[c].second] = 0;
+		degree[contacts[c].first] = 0;
+		degree[contacts[c].second] = 0;
+	}
+	sort( contacts.begin(), contacts.end() );
+}
+
+string getMapName( int decoy )
+{
+	char name[32];
+	sprintf( name, "decoy_%06d.cmap", decoy );
+	return name;
+}
+
+
+/**
+Generates and writes blocks of decoys. Decoy d always draws from random stream
+d, so the output does not depend on the number of threads.
+*/
+class GenerateTask : public ThreadTask {
+public:
+	const MapStatistics& m_stats;
+	const Parameters& m_params;
+	vector<int> m_num_contacts;
+	vector<char> m_failed;
+
+	GenerateTask( const MapStatistics& stats, const Parameters& p )
+		: m_stats( stats ), m_params( p ), m_num_contacts( p.num_decoys, 0 ), m_failed( p.num_decoys, 0 ) {}
+
+	void run( unsigned int item ) {
+		int length = m_params.protein_length;
+		vector<char> occupied( length*length, 0 );
+		vector<int> degree( length, 0 );
+		vector<Contact> contacts;
+		int end = min( (int) ( item + 1 )*DECOYS_PER_ITEM, m_params.num_decoys );
+		for ( int d=item*DECOYS_PER_ITEM; d<end; d++ ) {
+			RandomStream rng( m_params.random_seed, d );
+			generateMap( m_stats, length, rng, occupied, degree, contacts );
+			m_num_contacts[d] = contacts.size();
+			string path = m_params.output_dir + getMapName( d );
+			ofstream out( path.c_str() );
+			for ( unsigned int c=0; c<contacts.size(); c++ )
+				out << contacts[c].first << "\tX\t" << contacts[c].second << "\tX\n";
+			out.close();
+			if ( !out )
+				m_failed[d] = 1;
+		}
+	}
+};
+
+
+int main( int ac, char **av)
+{
+	Parameters p = getParams( ac, av );
+	cout << p;
+
+	double start = wallTime();
+	string path = (p.structure_dir+p.structure_file);
+	ifstream fin(path.c_str());
+	if (!fin.good()) { // if we can't read the contact maps file, bail out
+		cerr << "ERROR: can't read contact maps from " << path << endl;
+		return 1;
+	}
+	vector<DecoyContactStructure*> structs;
+	ContactMapUtil::readContactMapsFromFile( fin, p.structure_dir, structs );
+	fin.close();
+	if ( structs.empty() || p.protein_length < 3 || p.num_decoys <= 0 ) {
+		cerr << "ERROR: need native structures, a protein length of at least 3, and at least one decoy." << endl;
+		return 1;
+	}
+	MapStatistics stats = calcStatistics( structs, p.protein_length );
+	for ( unsigned int k=0; k<structs.size(); k++ )
+		delete structs[k];
+	cout << "# natives: " << structs.size() << endl;
+	cout << "# contacts per residue: " << stats.contacts_per_residue << endl;
+	cout << "# max. contacts of a residue: " << stats.max_degree << endl;
+	cout << "# Statistics time: " << wallTime() - start << " s" << endl;
+
+	mkdir( p.output_dir.c_str(), 0755 );
+	start = wallTime();
+	GenerateTask task( stats, p );
+	ThreadPool pool( p.num_threads );
+	pool.run( task, ( p.num_decoys + DECOYS_PER_ITEM - 1 )/DECOYS_PER_ITEM );
+	double t = wallTime() - start;
+
+	path = p.output_dir + "maps.txt";
+	ofstream list( path.c_str() );
+	int num_failed = 0;
+	double num_contacts = 0;
+	for ( int d=0; d<p.num_decoys; d++ ) {
+		list << getMapName( d ) << endl;
+		num_failed += task.m_failed[d];
+		num_contacts += task.m_num_contacts[d];
+	}
+	list.close();
+	if ( num_failed > 0 || !list ) {
+		cerr << "ERROR: couldn't write " << num_failed << " contact maps or the list file to " << p.output_dir << endl;
+		return 1;
+	}
+
+	cout << "# mean contacts per decoy: " << num_contacts/p.num_decoys << endl;
+	cout << "# Generation time: " << t << " s (" << p.num_decoys/t << " decoys/s)" << endl;
+	return 0;
+}
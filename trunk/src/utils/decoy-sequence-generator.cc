@@ -37,6 +37,7 @@ struct Parameters
 	int repetitions;
 	int random_seed;
 	int struct_id;
+	unsigned int num_threads; // 0 for the serial search with the global random number generator
 };
 
 
@@ -48,16 +49,17 @@ ostream & operator<<( ostream &s, const Parameters &p )
 	s << "#   repetitions: " << p.repetitions << endl;
 	s << "#   random seed: " << p.random_seed << endl;
 	s << "#   target structure id: " << p.struct_id << endl;
+	s << "#   threads: " << p.num_threads << endl;
 	s << "#" << endl;
 	return s;
 }
 
 Parameters getParams( int ac, char **av )
 {
-	if ( ac != 8 )
+	if ( ac != 8 && ac != 9 )
 	{
 		cout << "Start program like this:" << endl;
-		cout << "  " << av[0] << " <struct list file> <struct dir> <prot length> <free_energy_cutoff> <repetitions> <random seed> [<struct id>|-1]" << endl;
+		cout << "  " << av[0] << " <struct list file> <struct dir> <prot length> <free_energy_cutoff> <repetitions> <random seed> [<struct id>|-1] [<threads>]" << endl;
 		exit (-1);
 	}
 
@@ -70,6 +72,9 @@ Parameters getParams( int ac, char **av )
 	p.repetitions = atoi( av[i++] );
 	p.random_seed = atoi( av[i++] );
 	p.struct_id = atoi( av[i++] );
+	p.num_threads = 0;
+	if ( ac == 9 )
+		p.num_threads = max( atoi( av[i++] ), 1 );
 
 	return p;
 }
@@ -117,6 +122,17 @@ int main( int ac, char **av)
 	cout << p;
 	cout << "# <sequence> <free energy> <structure id>" << endl;
 
+	// with threads, the repetitions are distinct designs from concurrent restarts
+	if ( p.num_threads > 0 ) {
+		vector<CodingDNA> designs;
+		FolderUtil::getSequencesForStructure( folder, 3*p.protein_length, p.free_energy_cutoff, p.struct_id, p.repetitions, designs, p.num_threads, p.random_seed );
+		for ( unsigned int i=0; i<designs.size(); i++ ) {
+			auto_ptr<FoldInfo> fdata( folder.fold( designs[i].translate() ) );
+			cout << designs[i] << " " << fdata->getDeltaG() << " " << fdata->getStructure() << endl;
+		}
+		return 0;
+	}
+
 	for ( int i=0; i<p.repetitions; i++ )
 	{
 		if (p.struct_id < 0) {
@@ -0,0 +1,201 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+/** \page fill-sequence-bank fill-sequence-bank
+The program \c fill-sequence-bank designs genes that fold stably into a structure and
+adds them to a \ref SequenceBank, from which \c tr-driver and \c tr-decoy-driver draw
+their starting genes (last optional parameter of both). By default, designs run
+concurrently (see \ref FolderUtil::getSequencesForStructure()). With the design method
+\c descent, they are found one after the other by descent in the energies of single
+substitutions (see \ref FolderUtil::getSequenceByDescent()), at the given move
+temperature (default 0, steepest descent); this folds far fewer proteins, and is the
+better choice for the decoy folder. Typical calls are:
+\verbatim
+   ./fill-sequence-bank seqs.bank lattice 5 599 -5 100 111 4
+   ./fill-sequence-bank seqs.bank decoy maps/ 300 230.2 0 -5 100 111 4
+   ./fill-sequence-bank seqs.bank decoy maps/ 300 230.2 0 -5 100 111 1 descent 0.3
+\endverbatim
+The folder parameters have to be those of the runs that use the bank: the side length of
+the lattice, or the contact maps (a directory ending in "/" or a packed file), the protein
+length, and the log of the number of conformations of the decoy folder.
+*/
+
+#include "sequence-bank.hh"
+#include "folder-factory.hh"
+#include "folder-util.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <set>
+
+
+struct Parameters
+{
+	string bank_file;
+	string folder_type;
+	int side_length;
+	string contact_maps;
+	int protein_length;
+	double log_nconf;
+	int struct_id;
+	double free_energy_cutoff;
+	int num_sequences;
+	int random_seed;
+	unsigned int num_threads;
+	string design_method;
+	double move_temperature;
+};
+
+
+ostream & operator<<( ostream &s, const Parameters &p )
+{
+	s << "# Parameters:" << endl;
+	s << "#   sequence bank: " << p.bank_file << endl;
+	if ( p.folder_type == "lattice" )
+		s << "#   lattice side length: " << p.side_length << endl;
+	else {
+		s << "#   contact maps: " << p.contact_maps << endl;
+		s << "#   ln(# of conformations): " << p.log_nconf << endl;
+	}
+	s << "#   protein length: " << p.protein_length << endl;
+	s << "#   structure id: " << p.struct_id << endl;
+	s << "#   free energy cutoff: " << p.free_energy_cutoff << endl;
+	s << "#   sequences: " << p.num_sequences << endl;
+	s << "#   random seed: " << p.random_seed << endl;
+	s << "#   threads: " << p.num_threads << endl;
+	s << "#   design method: " << p.design_method << endl;
+	if ( p.design_method == "descent" )
+		s << "#   move temperature: " << p.move_temperature << endl;
+	s << "#" << endl;
+	return s;
+}
+
+Parameters getParams( int ac, char **av )
+{
+	Parameters p;
+	int i = 1;
+	if ( ac > 2 )
+		p.folder_type = av[2];
+	bool lattice = ( p.folder_type == "lattice" && ac >= 8 && ac <= 11 );
+	bool decoy = ( p.folder_type == "decoy" && ac >= 10 && ac <= 13 );
+	if ( !lattice && !decoy )
+	{
+		cout << "Start program like this:" << endl;
+		cout << "  " << av[0] << " <bank file> lattice <side length> <structure id> <free energy cutoff> <num sequences> <random seed> [<threads> [<design method> [<move temperature>]]]" << endl;
+		cout << "  " << av[0] << " <bank file> decoy <contact map dir/ or packed maps> <prot length> <log num confs> <structure id> <free energy cutoff> <num sequences> <random seed> [<threads> [<design method> [<move temperature>]]]" << endl;
+		cout << "The design method is \"random\" (default) or \"descent\"." << endl;
+		exit (-1);
+	}
+
+	p.bank_file = av[i++];
+	i++;
+	p.side_length = 0;
+	p.log_nconf = 0;
+	if ( lattice ) {
+		p.side_length = atoi( av[i++] );
+		p.protein_length = p.side_length*p.side_length;
+	}
+	else {
+		p.contact_maps = av[i++];
+		p.protein_length = atoi( av[i++] );
+		p.log_nconf = atof( av[i++] );
+	}
+	p.struct_id = atoi( av[i++] );
+	p.free_energy_cutoff = atof( av[i++] );
+	p.num_sequences = atoi( av[i++] );
+	p.random_seed = atoi( av[i++] );
+	p.num_threads = 1;
+	if ( i < ac )
+		p.num_threads = max( atoi( av[i++] ), 1 );
+	p.design_method = "random";
+	if ( i < ac )
+		p.design_method = av[i++];
+	p.move_temperature = 0;
+	if ( i < ac )
+		p.move_temperature = atof( av[i++] );
+	if ( p.design_method != "random" && p.design_method != "descent" ) {
+		cout << "Unknown design method " << p.design_method << "; use \"random\" or \"descent\"." << endl;
+		exit (-1);
+	}
+	if ( p.design_method == "descent" && p.struct_id < 0 ) {
+		cout << "Descent design needs a structure id." << endl;
+		exit (-1);
+	}
+
+	return p;
+}
+
+
+int main( int ac, char **av)
+{
+	Parameters p = getParams( ac, av );
+
+	// the key of the bank doesn't depend on the fold backend
+	FolderFactory factory;
+	auto_ptr<DGCutoffFolder> folder;
+	if ( p.folder_type == "lattice" )
+		folder.reset( factory.createLatticeFolder( p.side_length, 0, -1, 0.6, "", "double" ) );
+	else if ( !p.contact_maps.empty() && p.contact_maps[p.contact_maps.size()-1] == '/' ) {
+		ifstream fin( (p.contact_maps+string("maps.txt")).c_str() );
+		if ( fin.good() )
+			folder.reset( factory.createDecoyFolder( p.protein_length, p.log_nconf, fin, p.contact_maps, 0., -1, 0.6, "", "double" ) );
+		else {
+			vector<DecoyContactStructure*> structs;
+			ContactMapUtil::readContactMapsFromDirectory( p.contact_maps, structs, p.num_threads );
+			folder.reset( factory.createDecoyFolder( p.protein_length, p.log_nconf, structs, 0., -1, 0.6, "double" ) );
+		}
+	}
+	else
+		folder.reset( factory.createDecoyFolder( p.protein_length, p.log_nconf, p.contact_maps, 0., -1, 0.6, "double" ) );
+	if ( !folder->good() ) {
+		cerr << "ERROR: couldn't initialize folder." << endl;
+		return 1;
+	}
+
+	cout << p;
+	string key = SequenceBank::getFolderKey( *folder, p.protein_length );
+	cout << "# Folder key: " << key << endl;
+
+	vector<CodingDNA> designs;
+	if ( p.design_method == "descent" ) {
+		// one search per seed, skipping designs of proteins found before
+		set<string> proteins;
+		for ( int k = 0; (int) designs.size() < p.num_sequences && k < 10*p.num_sequences; k++ ) {
+			CodingDNA g = FolderUtil::getSequenceByDescent( *folder, 3*p.protein_length, p.free_energy_cutoff, p.struct_id, p.random_seed + k, p.move_temperature );
+			if ( g.size() == 0 ) {
+				cerr << "ERROR: descent design found no gene for structure " << p.struct_id << endl;
+				return 1;
+			}
+			if ( proteins.insert( g.translate() ).second )
+				designs.push_back( g );
+		}
+	}
+	else
+		FolderUtil::getSequencesForStructure( *folder, 3*p.protein_length, p.free_energy_cutoff, p.struct_id, p.num_sequences, designs, p.num_threads, p.random_seed );
+	if ( !SequenceBank::addSequences( p.bank_file, key, 3*p.protein_length, p.struct_id, p.free_energy_cutoff, designs ) ) {
+		cerr << "ERROR: couldn't write sequence bank " << p.bank_file << endl;
+		return 1;
+	}
+
+	SequenceBank bank( p.bank_file );
+	int pool = bank.findPool( key, 3*p.protein_length, p.struct_id, p.free_energy_cutoff );
+	cout << "# Pool " << pool << " now holds " << bank.getPools()[pool].num_sequences << " sequences" << endl;
+	return 0;
+}
@@ -72,6 +72,7 @@ struct Params
 	int window_size;
 	int equilibration_time;
 	int coalescent_time;
+	unsigned int num_threads; // threads used to calculate neutralities
 };
 
 
@@ -255,7 +256,8 @@ void printGenebank( CompactLatticeFolder &b, const Params p, const vector<Geneba
 
 		d.w_new = ept->getFitness( d.g );
 		
-		d.nu = FolderUtil::calcNeutrality( b, d.g.translate(), p.free_energy_cutoff );
+		vector<double> site_neutrality;
+		d.nu = FolderUtil::calcNeutralityProfile( b, d.g.translate(), p.free_energy_cutoff, site_neutrality, p.num_threads );
 		d.fop = GeneUtil::calcFop( d.g, ept->getOptimalCodons(false) );
 
 		cout << d.birth_time << " " << d.w_saved << " " << d.w_new << " ";
@@ -442,10 +444,10 @@ cout << "coalescent time: " << p.coalescent_time << endl;
 int main( int ac, char **av)
 {
 
-	if ( ac != 2 )
+	if ( ac != 2 && ac != 3 )
 	{
 		cout << "Start program like this:" << endl;
-		cout << "  " << av[0] << " <genebank file>" << endl;
+		cout << "  " << av[0] << " <genebank file> [<threads>]" << endl;
 		exit (-1);
 	}
 
@@ -464,6 +466,9 @@ int main( int ac, char **av)
 	CompactLatticeFolder b(size);
 
 	Params p;
+	p.num_threads = 1;
+	if ( ac == 3 )
+		p.num_threads = atoi( av[2] );
 	vector<GenebankData> v;
 
 	readGenebank( in, p, v );
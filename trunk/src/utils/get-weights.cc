@@ -33,6 +33,8 @@ The program \c get-weights is needed to determine the correct weights for the pr
 -#  Window time -- number of generations for which to measure random sequence statistics
 -#  Target translational accuracy -- fraction of time a random gene is accurately translated
 -#  Number of replicates -- averaged data will also be provided
+-#  Optional: number of chains -- if given, each replicate runs this many chains from the seed gene, dividing the window time among them, and reports convergence diagnostics
+-#  Optional: number of threads that run the chains (default 1); results don't depend on it
 
 If the sequence file name does not represent a valid file, the program
 will attempt to interpret the name as a sequence identifier
@@ -102,11 +104,13 @@ public:
 	int num_equil;
 	double target_accuracy;
 	int reps;
+	unsigned int num_chains;
+	unsigned int num_threads;
 	bool valid;
 
 
 	Parameters( int ac, char **av ) {
-		if ( ac != 9 )	{
+		if ( ac < 9 || ac > 11 )	{
 			valid = false;
 			return;
 		}
@@ -120,6 +124,12 @@ public:
 		num_equil = atoi( av[i++] );
 		target_accuracy = atof( av[i++] );
 		reps = atoi( av[i++] );
+		num_chains = 0;
+		num_threads = 1;
+		if ( i < ac )
+			num_chains = max( atoi( av[i++] ), 1 );
+		if ( i < ac )
+			num_threads = max( atoi( av[i++] ), 1 );
 		valid = true;
 	}
 };
@@ -136,6 +146,10 @@ ostream & operator<<( ostream &s, const Parameters &p )
 	s << "#   num. gens to measure: " << p.num_to_fold << endl;
 	s << "#   target accuracy: " << p.target_accuracy << endl;
 	s << "#   reps: " << p.reps << endl;
+	if ( p.num_chains > 0 ) {
+		s << "#   chains: " << p.num_chains << endl;
+		s << "#   threads: " << p.num_threads << endl;
+	}
 	s << "#" << endl;
 	return s;
 }
@@ -195,13 +209,27 @@ void getWeightsExperiment(Parameters& p)
 	double m_accuracy_weight;
 	double m_error_weight;
 	Stats er, aw, ew;
-	cout << "error rate\taccuracy weight\terror weight" << endl;
+	if (p.num_chains > 0) {
+		cout << "error rate\taccuracy weight\terror weight\terror rate s.e.\tR-hat accuracy weight\tR-hat error weight" << endl;
+	}
+	else {
+		cout << "error rate\taccuracy weight\terror weight" << endl;
+	}
 	for (int ni=0; ni<p.reps; ni++) {
-	  ept->getWeightsForTargetAccuracy(seed_gene, p.target_accuracy, m_error_rate, m_accuracy_weight, m_error_weight, p.num_equil, p.num_to_fold);	
+	  if (p.num_chains > 0) {
+		ErrorproneTranslation::CalibrationDiagnostics diag;
+		ept->getWeightsForTargetAccuracy(seed_gene, p.target_accuracy, m_error_rate, m_accuracy_weight, m_error_weight, p.num_equil, p.num_to_fold,
+										 p.num_chains, p.num_threads, Random::rint(), &diag);
+		cout << m_error_rate << tab << m_accuracy_weight << tab << m_error_weight << tab
+			 << diag.error_rate_stderror << tab << diag.rhat_accuracy_weight << tab << diag.rhat_error_weight << endl;
+	  }
+	  else {
+		ept->getWeightsForTargetAccuracy(seed_gene, p.target_accuracy, m_error_rate, m_accuracy_weight, m_error_weight, p.num_equil, p.num_to_fold);
+		cout << m_error_rate << tab << m_accuracy_weight << tab << m_error_weight << endl;
+	  }
 	  er += m_error_rate;
 	  ew += m_error_weight;
 	  aw += m_accuracy_weight;
-	  cout << m_error_rate << tab << m_accuracy_weight << tab << m_error_weight << endl;
 	}
 	cout << "# Averages:" << endl;
 	cout << er.getMean() << tab << aw.getMean() << tab << ew.getMean() << endl;
@@ -219,6 +247,6 @@ int main( int ac, char **av)
 	}
 	else {
 		cout << "Start program like this:" << endl;
-		cout << "\t" << av[0] << " <ca cost> <free energy cutoff> <random seed> <gene file name | structure ID> <num. to equil> <num. to measure> <target accuracy> <reps>" << endl;
+		cout << "\t" << av[0] << " <ca cost> <free energy cutoff> <random seed> <gene file name | structure ID> <num. to equil> <num. to measure> <target accuracy> <reps> [<chains> [<threads>]]" << endl;
 	}
 }
@@ -93,11 +93,12 @@ public:
 	string genotype_file_name;
 	int num_to_fold;
 	string out_file_name;
+	unsigned int num_threads;
 	bool valid;
 
 
 	Parameters( int ac, char **av ) {
-		if ( ac != 15 )	{
+		if ( ac != 15 && ac != 16 )	{
 			valid = false;
 			return;
 		}
@@ -117,6 +118,9 @@ public:
 		genotype_file_name = av[i++];
 		num_to_fold = atoi( av[i++] );
 		out_file_name = av[i++];
+		num_threads = 0;
+		if ( i < ac )
+			num_threads = max( atoi( av[i++] ), 1 );
 
 		valid = true;
 	}
@@ -139,6 +143,8 @@ ostream & operator<<( ostream &s, const Parameters &p )
 	s << "#   random seed: " << p.random_seed << endl;
 	s << "#   genotype file: " << p.genotype_file_name << endl;
 	s << "#   output file: " << p.out_file_name << endl;
+	if ( p.num_threads > 0 )
+		s << "#   threads: " << p.num_threads << endl;
 	s << "#" << endl;
 	return s;
 }
@@ -239,7 +245,14 @@ void misfoldDistExperiment(Parameters& p)
 		int numFolded = 0;
 		int numRobust = 0;
 
-		fe->countOutcomes(rec.gene, p.num_to_fold, numAccurate, numRobust, numTruncated, numFolded);
+		if ( p.num_threads > 0 ) {
+			// the seed of the parallel translations comes from the global generator, so the
+			// results depend on the random seed, but not on the number of threads
+			fe->countOutcomes(rec.gene, p.num_to_fold, numAccurate, numRobust, numTruncated, numFolded, p.num_threads, Random::rint());
+		}
+		else {
+			fe->countOutcomes(rec.gene, p.num_to_fold, numAccurate, numRobust, numTruncated, numFolded);
+		}
 
 		double ffold = (double)numFolded/p.num_to_fold;
 		double facc = (double)numAccurate/p.num_to_fold;
@@ -295,7 +308,7 @@ int main( int ac, char **av)
 	}
 	else {
 		cout << "Start program like this:" << endl;
-		cout << "\t" << av[0] << " <eval type> <prot length> <pop size> <ca cost> <error rate> <accuracy weight> <error weight> <structure id> <free energy cutoff> <free energy minimum> <random seed> <gene file name> <num. to fold> <outfile>" << endl;
+		cout << "\t" << av[0] << " <eval type> <prot length> <pop size> <ca cost> <error rate> <accuracy weight> <error weight> <structure id> <free energy cutoff> <free energy minimum> <random seed> <gene file name> <num. to fold> <outfile> [<threads>]" << endl;
 	}
 }
 
@@ -0,0 +1,94 @@
+/*
+This file is part of the evoli project.
+Copyright (C) 2004, 2005, 2006 Claus Wilke <cwilke@mail.utexas.edu>,
+Allan Drummond <dadrummond@gmail.com>
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
+*/
+
+#include "decoy-contact-folder.hh"
+
+#include <fstream>
+#include <cmath>
+#include <cstdlib>
+
+
+struct Parameters
+{
+	string structure_file;
+	string structure_dir;
+	string packed_file;
+	int protein_length;
+};
+
+
+ostream & operator<<( ostream &s, const Parameters &p )
+{
+	s << "# Parameters:" << endl;
+	s << "#   structure file: " << p.structure_file << endl;
+	s << "#   structure dir: " << p.structure_dir << endl;
+	s << "#   packed file: " << p.packed_file << endl;
+	s << "#   protein length: " << p.protein_length << endl;
+	s << "#" << endl;
+	return s;
+}
+
+Parameters getParams( int ac, char **av )
+{
+	if ( ac != 5 )
+	{
+		cout << "Start program like this:" << endl;
+		cout << "  " << av[0] << " <struct list file> <struct dir> <packed file> <prot length>" << endl;
+		exit (-1);
+	}
+
+	Parameters p;
+	int i = 1;
+	p.structure_file = av[i++];
+	p.structure_dir = av[i++];
+	p.packed_file = av[i++];
+	p.protein_length = atoi( av[i++] );
+
+	return p;
+}
+
+int main( int ac, char **av)
+{
+	Parameters p = getParams( ac, av );
+
+	string path = (p.structure_dir+p.structure_file);
+	ifstream fin(path.c_str());
+	if (!fin.good()) {// if we can't read the contact maps file, bail out
+		cerr << "ERROR: can't read contact maps from " << path << endl;
+		return 1;
+	}
+	// contacts beyond the protein length are dropped, so the packed file is specific
+	// to that length; the fudge factor is not stored in the packed file
+	double log_nconf = 160.0*log(10.0);
+	DecoyContactFolder folder(p.protein_length, log_nconf, fin, p.structure_dir);
+	if (!folder.good()) {
+		cerr << "ERROR: couldn't initialize folder." << endl;
+		return 1;
+	}
+
+	cout << p;
+	if (!folder.writePackedMaps(p.packed_file)) {
+		cerr << "ERROR: can't write " << p.packed_file << endl;
+		return 1;
+	}
+	cout << "# Packed " << folder.getNumStructures() << " contact maps." << endl;
+
+	return 0;
+}
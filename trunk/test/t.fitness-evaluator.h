@@ -79,6 +79,8 @@ struct TEST_CLASS( fitness_evaluator_basic )
 	}
 
 	void TEST_FUNCTION( test_automatic_init_EPT_approximation_for_accuracy ) {
+		// the estimate depends on the random genes; don't depend on the tests run before
+		Random::seed(2);
 		CompactLatticeFolder folder(side_length);
 		double target_accuracy = 0.85;
 		double max_dg = -1;
@@ -194,6 +196,188 @@ struct TEST_CLASS( fitness_evaluator_basic )
 		//cout << fitness_fl << " " << fitness_ept << endl;
 		TEST_ASSERT(fitness_fl == fitness_ept);
 	}
+
+	void TEST_FUNCTION( outcome_memo ) {
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 599;
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid);
+		ErrorproneTranslation ept(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.0114735, 57.9439, 102.567);
+		ErrorproneTranslation ept_nomemo(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.0114735, 57.9439, 102.567);
+		ept_nomemo.setOutcomeMemoSize( 0 );
+
+		double facc, frob, ftrunc, ffold, facc2, frob2, ftrunc2, ffold2;
+		for ( unsigned int i=0; i<g.codonLength(); i++ ) {
+			// a synonymous mutant, which is evaluated from the memo
+			Codon c = g.getCodon( i );
+			for ( int j=0; j<64; j++ ) {
+				Codon c2 = GeneticCodeUtil::indexToCodon( j );
+				if ( c2 != c && GeneticCodeUtil::geneticCode( c2 ) == GeneticCodeUtil::geneticCode( c ) ) {
+					g.setCodon( i, c2 );
+					break;
+				}
+			}
+			double fitness = ept.calcOutcomes( g, facc, frob, ftrunc, ffold );
+			double fitness2 = ept_nomemo.calcOutcomes( g, facc2, frob2, ftrunc2, ffold2 );
+			TEST_ASSERT( fitness == fitness2 );
+			TEST_ASSERT( facc == facc2 && frob == frob2 && ftrunc == ftrunc2 && ffold == ffold2 );
+		}
+		TEST_ASSERT( ept.getOutcomeMemoHits() == (unsigned long) g.codonLength()-1 );
+		TEST_ASSERT( ept_nomemo.getOutcomeMemoHits() == 0 );
+
+		// a new target structure invalidates the memo
+		ept.changeStructure( sid+1 );
+		ept_nomemo.changeStructure( sid+1 );
+		TEST_ASSERT( ept.calcOutcomes( g, facc, frob, ftrunc, ffold ) == ept_nomemo.calcOutcomes( g, facc2, frob2, ftrunc2, ffold2 ) );
+		TEST_ASSERT( ept.getOutcomeMemoHits() == (unsigned long) g.codonLength()-1 );
+	}
+
+	void TEST_FUNCTION( parallel_count_outcomes ) {
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 599;
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid);
+		ErrorproneTranslation ept(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05, 57.9439, 102.567);
+
+		// the counts depend on the seed, but not on the number of threads
+		int num_to_fold = 1050;
+		int nacc, nrob, ntrunc, nfold, nacc2, nrob2, ntrunc2, nfold2;
+		double fitness = ept.countOutcomes( g, num_to_fold, nacc, nrob, ntrunc, nfold, 1, 17 );
+		double fitness2 = ept.countOutcomes( g, num_to_fold, nacc2, nrob2, ntrunc2, nfold2, 3, 17 );
+		TEST_ASSERT( fitness == fitness2 );
+		TEST_ASSERT( nacc == nacc2 && nrob == nrob2 && ntrunc == ntrunc2 && nfold == nfold2 );
+		TEST_ASSERT( nacc > 0 && nacc < num_to_fold && nfold >= nacc && nfold <= num_to_fold );
+		ept.countOutcomes( g, num_to_fold, nacc2, nrob2, ntrunc2, nfold2, 3, 18 );
+		TEST_ASSERT( nacc != nacc2 || nrob != nrob2 || ntrunc != ntrunc2 || nfold != nfold2 );
+
+		// RobustnessOnlyTranslation translates and folds with the same error spectrum
+		RobustnessOnlyTranslation rot(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05, 57.9439, 102.567);
+		rot.countOutcomes( g, num_to_fold, nacc2, nrob2, ntrunc2, nfold2, 3, 17 );
+		TEST_ASSERT( nacc == nacc2 && nrob == nrob2 && ntrunc == ntrunc2 && nfold == nfold2 );
+
+		vector<double> ddgs, ddgs2;
+		ept.stabilityOutcomes( g, 250, ddgs, 1, 17 );
+		ept.stabilityOutcomes( g, 250, ddgs2, 4, 17 );
+		TEST_ASSERT( ddgs.size() == 250 );
+		TEST_ASSERT( ddgs == ddgs2 );
+	}
+
+	void TEST_FUNCTION( parallel_calibration ) {
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 599;
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid);
+		ErrorproneTranslation ept(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.1, 0.1, 0.1);
+
+		// the results depend on the seed and the number of chains, but not on the number of threads
+		double error_rate, accuracy_weight, error_weight, error_rate2, accuracy_weight2, error_weight2;
+		ErrorproneTranslation::CalibrationDiagnostics diag, diag2;
+		ept.getWeightsForTargetAccuracy( g, 0.85, error_rate, accuracy_weight, error_weight, 200, 400, 4, 1, 11, &diag );
+		ept.getWeightsForTargetAccuracy( g, 0.85, error_rate2, accuracy_weight2, error_weight2, 200, 400, 4, 3, 11, &diag2 );
+		TEST_ASSERT( error_rate == error_rate2 && accuracy_weight == accuracy_weight2 && error_weight == error_weight2 );
+		TEST_ASSERT( diag.num_chains == 4 && diag.samples_per_chain == 100 );
+		TEST_ASSERT( diag.rhat_accuracy_weight == diag2.rhat_accuracy_weight && diag.rhat_error_weight == diag2.rhat_error_weight );
+		TEST_ASSERT( diag.rhat_accuracy_weight >= 0.9 && diag.rhat_accuracy_weight < 2 );
+		TEST_ASSERT( diag.error_rate_stderror > 0 );
+
+		// the weights agree with those of a single chain
+		ept.getWeightsForTargetAccuracy( g, 0.85, error_rate2, accuracy_weight2, error_weight2, 200, 400 );
+		TEST_ASSERT( fabs( error_weight - error_weight2 ) < 0.2*error_weight2 );
+		TEST_ASSERT( fabs( error_rate - error_rate2 ) < 0.2*error_rate2 );
+		double accuracy = ept.estimateAccuracyFromErrorRate( error_rate, accuracy_weight, error_weight );
+		TEST_ASSERT( fabs( accuracy - 0.85 ) < 1e-6 );
+	}
+
+	void TEST_FUNCTION( neutrality_cache ) {
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 599;
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid);
+		RobustnessOnlyTranslation rot(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05);
+		RobustnessOnlyTranslation rot_nocache(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05);
+		rot_nocache.setNeutralityCacheSize( 0 );
+
+		// a synonymous gene is evaluated from the cache, with the same result
+		CodingDNA g2 = GeneUtil::reverseTranslate( g.translate() );
+		double fitness = rot.getFitness( g );
+		TEST_ASSERT( fitness == rot_nocache.getFitness( g ) );
+		TEST_ASSERT( rot.getFitness( g2 ) == fitness );
+		double facc, frob, ftrunc, ffold, facc2, frob2, ftrunc2, ffold2;
+		TEST_ASSERT( rot.calcOutcomes( g, facc, frob, ftrunc, ffold ) == rot_nocache.calcOutcomes( g, facc2, frob2, ftrunc2, ffold2 ) );
+		TEST_ASSERT( ffold == ffold2 && frob == frob2 );
+		pair<unsigned long, unsigned long> stats = rot.getNeutralityCacheStats();
+		TEST_ASSERT( stats.first == 3 && stats.second == 2 );
+		stats = rot_nocache.getNeutralityCacheStats();
+		TEST_ASSERT( stats.first == 2 && stats.second == 0 );
+
+		// the neutrality of a folding point mutant is updated from the cached protein
+		Protein m = g.translate();
+		for ( unsigned int i=0; i<m.length() && rot.getNeutralityUpdates() == 0; i++ ) {
+			for ( int j=0; j<20 && rot.getNeutralityUpdates() == 0; j++ ) {
+				m = g.translate();
+				if ( m[i] == GeneticCodeUtil::AMINO_ACIDS[j] )
+					continue;
+				m[i] = GeneticCodeUtil::AMINO_ACIDS[j];
+				auto_ptr<FoldInfo> fi( folder.fold( m ) );
+				if ( fi->getStructure() == sid && fi->getDeltaG() <= max_dg )
+					TEST_ASSERT( rot.getFitness( GeneUtil::reverseTranslate( m ) ) == rot_nocache.getFitness( GeneUtil::reverseTranslate( m ) ) );
+			}
+		}
+		TEST_ASSERT( rot.getNeutralityUpdates() == 1 && rot_nocache.getNeutralityUpdates() == 0 );
+		TEST_ASSERT( rot.getNeutralityCacheStats().first == 4 );
+
+		// shrinking the cache forgets the protein
+		rot.setNeutralityCacheSize( 0 );
+		rot.getFitness( g );
+		TEST_ASSERT( rot.getNeutralityCacheStats().second == 2 );
+	}
+
+	void TEST_FUNCTION( fitness_batch ) {
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 599;
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid);
+
+		// duplicates, a synonymous gene, point mutants, and a truncated gene
+		vector<CodingDNA> genes;
+		genes.push_back( g );
+		genes.push_back( GeneUtil::reverseTranslate( g.translate() ) );
+		for ( unsigned int i=0; i<8; i++ ) {
+			CodingDNA mutant( g );
+			mutant[(37*i) % g.length()] = "ACGT"[i % 4];
+			genes.push_back( mutant );
+		}
+		genes.push_back( g );
+		genes.push_back( CodingDNA( "TAA" + string( g ).substr( 3 ) ) );
+		vector<const CodingDNA*> batch;
+		for ( unsigned int i=0; i<genes.size(); i++ )
+			batch.push_back( &genes[i] );
+
+		ErrorproneTranslation ept(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05, 57.9439, 102.567);
+		ErrorproneTranslation ept_batch(&folder, g.codonLength(), sid, max_dg, 1.0, 6.0, 0.05, 57.9439, 102.567);
+		ept_batch.setBatchThreads( 3 );
+		ept_batch.setOutcomeMemoSize( 2 );
+		vector<double> fitness( genes.size() );
+		ept_batch.getFitnessBatch( batch, &fitness[0] );
+		for ( unsigned int i=0; i<genes.size(); i++ )
+			TEST_ASSERT( fitness[i] == ept.getFitness( genes[i] ) );
+		TEST_ASSERT( fitness.back() == 0 );
+
+		ProteinFreeEnergyFitness pfe( &folder );
+		ProteinFreeEnergyFitness pfe_batch( &folder );
+		pfe_batch.setBatchThreads( 4 );
+		pfe_batch.getFitnessBatch( batch, &fitness[0] );
+		for ( unsigned int i=0; i<genes.size(); i++ )
+			TEST_ASSERT( fitness[i] == pfe.getFitness( genes[i] ) );
+
+		// the batch threads are kept for later batches, and can be replaced
+		vector<double> fitness2( genes.size() );
+		pfe_batch.getFitnessBatch( batch, &fitness2[0] );
+		TEST_ASSERT( fitness2 == fitness );
+		pfe_batch.setBatchThreads( 1 );
+		pfe_batch.getFitnessBatch( batch, &fitness2[0] );
+		TEST_ASSERT( fitness2 == fitness );
+	}
 };
 
 #endif
@@ -24,14 +24,20 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1
 #include "cutee.h"
 #include "decoy-contact-folder.hh"
 #include "compact-lattice-folder.hh"
+#include "folder-factory.hh"
 #include "coding-sequence.hh"
 #include "protein.hh"
 #include "folder-util.hh"
+#include "sequence-bank.hh"
 #include "random.hh"
 
 #include <fstream>
+#include <sstream>
 #include <cmath>
 #include <memory>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/wait.h>
 
 struct TEST_CLASS( folder_basic )
 {
@@ -152,6 +158,36 @@ struct TEST_CLASS( folder_basic )
 		return;
 	}
 
+	void TEST_FUNCTION( parallel_sequence_design )
+	{
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		int sid = 574;
+		Random::seed(11);
+		uint next_random = Random::rint();
+		Random::seed(11);
+
+		vector<CodingDNA> designs1, designs3;
+		FolderUtil::getSequencesForStructure( folder, gene_length, max_dg, sid, 3, designs1, 1, 5 );
+		FolderUtil::getSequencesForStructure( folder, gene_length, max_dg, sid, 3, designs3, 3, 5 );
+		// the designs depend only on the seed, and the global generator is untouched
+		TEST_ASSERT( designs1.size() == 3 );
+		TEST_ASSERT( designs1 == designs3 );
+		TEST_ASSERT( Random::rint() == next_random );
+		for ( unsigned int i=0; i<designs1.size(); i++ ) {
+			auto_ptr<FoldInfo> fi( folder.fold( designs1[i].translate() ) );
+			TEST_ASSERT( fi->getDeltaG() <= max_dg );
+			TEST_ASSERT( fi->getStructure() == (StructureID)sid );
+			for ( unsigned int j=0; j<i; j++ )
+				TEST_ASSERT( designs1[i].translate() != designs1[j].translate() );
+		}
+		// a single design is the first of the list
+		TEST_ASSERT( FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid, 2, 5 ) == designs1[0] );
+
+		auto_ptr<FoldInfo> fi( folder.fold( FolderUtil::getSequence( folder, gene_length, max_dg, 2, 7 ).translate() ) );
+		TEST_ASSERT( fi->getDeltaG() <= max_dg );
+	}
+
 	void TEST_FUNCTION( decoy_sequence_for_structure )
 	{
 		uint protein_length = 300;
@@ -179,6 +215,659 @@ struct TEST_CLASS( folder_basic )
 		return;
 	}
 
+	void TEST_FUNCTION( descent_design )
+	{
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		StructureID sid = 574;
+
+		// the substitution energies agree with energies of the point mutants
+		Protein p = CodingDNA::createRandomNoStops( gene_length ).translate();
+		vector<double> deltas;
+		TEST_ASSERT( folder.getSubstitutionEnergies( p, sid, deltas ) );
+		TEST_ASSERT( deltas.size() == 20*p.size() );
+		double E = folder.getEnergy( p, sid );
+		for ( unsigned int i=0; i<p.size(); i+=7 ) {
+			for ( unsigned int a=0; a<20; a++ ) {
+				Protein mutant( p );
+				mutant[i] = GeneticCodeUtil::indexToAminoAcidLetter( a );
+				TEST_ASSERT( fabs( deltas[20*i+a] - ( folder.getEnergy( mutant, sid ) - E ) ) < 1e-9 );
+			}
+		}
+
+		Random::seed(11);
+		uint next_random = Random::rint();
+		Random::seed(11);
+		uint nfolded = folder.getNumFolded();
+		CodingDNA g = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, sid );
+		uint random_folds = folder.getNumFolded() - nfolded;
+
+		// steepest descent, and Metropolis sampling of the substitutions
+		for ( int t=0; t<2; t++ ) {
+			nfolded = folder.getNumFolded();
+			g = FolderUtil::getSequenceByDescent( folder, gene_length, max_dg, sid, 5, 0.3*t );
+			TEST_ASSERT( folder.getNumFolded() - nfolded < random_folds );
+			TEST_ASSERT( g.encodesFullLength() );
+			auto_ptr<FoldInfo> fi( folder.fold( g.translate() ) );
+			TEST_ASSERT( fi->getDeltaG() <= max_dg );
+			TEST_ASSERT( fi->getStructure() == sid );
+			TEST_ASSERT( FolderUtil::getSequenceByDescent( folder, gene_length, max_dg, sid, 5, 0.3*t ) == g );
+		}
+		// an unreachable cutoff gives up after the given number of restarts
+		nfolded = folder.getNumFolded();
+		g = FolderUtil::getSequenceByDescent( folder, gene_length, -1000, sid, 5, 0, 3 );
+		TEST_ASSERT( g.size() == 0 );
+		TEST_ASSERT( folder.getNumFolded() > nfolded );
+		// the global generator is untouched
+		Random::seed(11);
+		TEST_ASSERT( Random::rint() == next_random );
+
+		uint protein_length = 300;
+		ifstream fin("test/data/rand_contact_maps/maps.txt");
+		TEST_ASSERT( fin.good() );
+		if (!fin.good()) // if we can't read the contact maps, bail out
+			return;
+		DecoyContactFolder decoy_folder(protein_length, 100.0*log(10.0), fin, "test/data/rand_contact_maps/");
+		TEST_ASSERT(decoy_folder.good());
+		if (!decoy_folder.good())
+			return;
+		g = FolderUtil::getSequenceByDescent( decoy_folder, 3*protein_length, max_dg, 0, 5 );
+		auto_ptr<FoldInfo> fi( decoy_folder.fold( g.translate() ) );
+		TEST_ASSERT( fi->getDeltaG() <= max_dg );
+		TEST_ASSERT( fi->getStructure() == 0 );
+		TEST_ASSERT( !decoy_folder.getSubstitutionEnergies( g.translate(), decoy_folder.getNumStructures(), deltas ) );
+	}
+
+	void TEST_FUNCTION( sequence_bank )
+	{
+		stringstream bank_name;
+		bank_name << "/tmp/evoli-test-bank-" << getpid();
+		unlink( bank_name.str().c_str() );
+
+		CompactLatticeFolder folder(side_length);
+		CompactLatticeFolder hot_folder(side_length, 0, -1, 1.0);
+		string key = SequenceBank::getFolderKey( folder, gene_length/3 );
+		TEST_ASSERT( !key.empty() );
+		TEST_ASSERT( key == SequenceBank::getFolderKey( folder, gene_length/3 ) );
+		TEST_ASSERT( key != SequenceBank::getFolderKey( hot_folder, gene_length/3 ) );
+
+		double max_dg = -1;
+		StructureID sid = 574;
+		vector<CodingDNA> designs;
+		FolderUtil::getSequencesForStructure( folder, gene_length, max_dg, sid, 3, designs, 2, 5 );
+		TEST_ASSERT( SequenceBank::addSequences( bank_name.str(), key, gene_length, sid, max_dg, designs ) );
+		// genes already present are skipped
+		TEST_ASSERT( SequenceBank::addSequences( bank_name.str(), key, gene_length, sid, max_dg, designs ) );
+		vector<CodingDNA> other( 1, FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, 599, 1, 7 ) );
+		TEST_ASSERT( SequenceBank::addSequences( bank_name.str(), key, gene_length, 599, max_dg, other ) );
+
+		SequenceBank bank( bank_name.str() );
+		TEST_ASSERT( bank.good() );
+		TEST_ASSERT( bank.getPools().size() == 2 );
+		int pool = bank.findPool( key, gene_length, sid, max_dg );
+		TEST_ASSERT( pool == 0 );
+		TEST_ASSERT( bank.findPool( key, gene_length, sid, max_dg - 1 ) == -1 );
+		vector<CodingDNA> genes;
+		TEST_ASSERT( bank.readPool( pool, genes ) );
+		TEST_ASSERT( genes == designs );
+		TEST_ASSERT( bank.readPool( 1, genes ) );
+		TEST_ASSERT( genes == other );
+
+		// draws are verified genes of the pool; other folders have no pool
+		for ( int i=0; i<5; i++ ) {
+			CodingDNA g;
+			TEST_ASSERT( bank.drawSequence( folder, gene_length, max_dg, sid, g ) );
+			TEST_ASSERT( find( designs.begin(), designs.end(), g ) != designs.end() );
+		}
+		CodingDNA g;
+		TEST_ASSERT( !bank.drawSequence( hot_folder, gene_length, max_dg, sid, g ) );
+		SequenceBank::setDefaultFile( bank_name.str() );
+		int nfolded = folder.getNumFolded();
+		g = SequenceBank::getSequenceForStructure( folder, gene_length, max_dg, 599 );
+		TEST_ASSERT( g == other[0] );
+		TEST_ASSERT( folder.getNumFolded() - nfolded <= 1 );
+		SequenceBank::setDefaultFile( "" );
+
+		SequenceBank missing( bank_name.str() + ".missing" );
+		TEST_ASSERT( missing.good() && missing.getPools().empty() );
+		unlink( bank_name.str().c_str() );
+	}
+
+	void TEST_FUNCTION( neutrality_profile )
+	{
+		CompactLatticeFolder folder(side_length);
+		double max_dg = -1;
+		Random::seed(11);
+		Protein p = FolderUtil::getSequenceForStructure( folder, gene_length, max_dg, 574 ).translate();
+
+		vector<double> sites1, sites3;
+		double nu = FolderUtil::calcNeutrality( folder, p, max_dg );
+		double nu1 = FolderUtil::calcNeutralityProfile( folder, p, max_dg, sites1 );
+		double nu3 = FolderUtil::calcNeutralityProfile( folder, p, max_dg, sites3, 3 );
+		TEST_ASSERT( nu > 0 );
+		TEST_ASSERT( nu == nu1 && nu == nu3 );
+		TEST_ASSERT( sites1 == sites3 );
+		TEST_ASSERT( sites1.size() == p.length() );
+
+		// the profile counts the point mutants that fold at each site
+		double sum = 0;
+		for ( unsigned int i=0; i<p.length(); i++ ) {
+			Protein m = p;
+			int count = 0;
+			for ( int j=0; j<20; j++ ) {
+				if ( GeneticCodeUtil::AMINO_ACIDS[j] == p[i] )
+					continue;
+				m[i] = GeneticCodeUtil::AMINO_ACIDS[j];
+				auto_ptr<FoldInfo> fi( folder.fold( m ) );
+				if ( fi->getStructure() == 574 && fi->getDeltaG() < max_dg )
+					count += 1;
+			}
+			TEST_ASSERT( sites1[i] == count/19.0 );
+			sum += sites1[i];
+		}
+		TEST_ASSERT( fabs( sum/p.length() - nu ) < 1e-12 );
+
+		// a protein that doesn't fold has no neutral mutants
+		TEST_ASSERT( FolderUtil::calcNeutralityProfile( folder, p, -1000, sites3, 3 ) == 0 );
+		TEST_ASSERT( sites3 == vector<double>( p.length(), 0. ) );
+
+		// updates along a chain of point mutants give exactly the full profiles,
+		// with fewer folds
+		NeutralityBounds bounds, new_bounds;
+		FolderUtil::calcNeutralityProfile( folder, p, max_dg, sites1, 1, &bounds );
+		TEST_ASSERT( !bounds.empty() && bounds.structure == 574 );
+		unsigned int full_folds = 0, update_folds = 0;
+		for ( unsigned int k=0; k<6; k++ ) {
+			Protein m = p;
+			unsigned int site = ( 7*k + 3 ) % p.length();
+			m[site] = GeneticCodeUtil::AMINO_ACIDS[( 5*k + 1 ) % 20];
+			if ( m[site] == p[site] )
+				m[site] = GeneticCodeUtil::AMINO_ACIDS[( 5*k + 2 ) % 20];
+			unsigned int n = folder.getNumFolded();
+			double nu_full = FolderUtil::calcNeutralityProfile( folder, m, max_dg, sites1 );
+			full_folds += folder.getNumFolded() - n;
+			n = folder.getNumFolded();
+			double nu_update = FolderUtil::updateNeutralityProfile( folder, p, bounds, m, max_dg, sites3, 3, &new_bounds );
+			update_folds += folder.getNumFolded() - n;
+			TEST_ASSERT( nu_full == nu_update );
+			TEST_ASSERT( sites1 == sites3 );
+			if ( nu_full > 0 ) {
+				p = m;
+				bounds = new_bounds;
+			}
+		}
+		TEST_ASSERT( update_folds < full_folds );
+	}
+
+	void TEST_FUNCTION( get_energies ) {
+		int protein_length = 300;
+		double log_nconf = 160.0*log(10.0);
+		ifstream fin("test/data/williams_contact_maps/maps.txt");
+		TEST_ASSERT( fin.good() );
+		if (!fin.good()) // if we can't read the contact maps, bail out
+			return;
+		DecoyContactFolder decoy_folder(protein_length, log_nconf, fin, "test/data/williams_contact_maps/");
+		CompactLatticeFolder lattice_folder(side_length);
+		TEST_ASSERT(decoy_folder.good());
+		if (!decoy_folder.good())
+			return;
+
+		Protein decoy_p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+		Protein lattice_p = CodingDNA::createRandomNoStops(gene_length).translate();
+		DGCutoffFolder* folders[2] = { &decoy_folder, &lattice_folder };
+		Protein* proteins[2] = { &decoy_p, &lattice_p };
+		for ( int f=0; f<2; f++ ) {
+			uint n = folders[f]->getNumStructures();
+			vector<double> all(n);
+			TEST_ASSERT( folders[f]->getEnergies( *proteins[f], &all[0] ) );
+			vector<StructureID> sids;
+			for ( uint sid=0; sid<n; sid+=7 )
+				sids.push_back( sid );
+			vector<double> some( sids.size() );
+			TEST_ASSERT( folders[f]->getEnergies( *proteins[f], sids, &some[0] ) );
+			for ( uint i=0; i<sids.size(); i++ ) {
+				TEST_ASSERT( some[i] == all[sids[i]] );
+				TEST_ASSERT( some[i] == folders[f]->getEnergy( *proteins[f], sids[i] ) );
+			}
+			// the minimum-energy structure is the one reported by fold()
+			auto_ptr<FoldInfo> fi( folders[f]->fold( *proteins[f] ) );
+			TEST_ASSERT( min_element( all.begin(), all.end() ) - all.begin() == fi->getStructure() );
+		}
+		// structure IDs out of range give a bad energy instead of reading past the table
+		vector<StructureID> bad_sids;
+		bad_sids.push_back( -1 );
+		bad_sids.push_back( lattice_folder.getNumStructures() );
+		double bad[2];
+		TEST_ASSERT( lattice_folder.getEnergies( lattice_p, bad_sids, bad ) );
+		TEST_ASSERT( bad[0] == CompactLatticeFolder::BAD_ENERGY && bad[1] == CompactLatticeFolder::BAD_ENERGY );
+		bad_sids[1] = decoy_folder.getNumStructures();
+		TEST_ASSERT( decoy_folder.getEnergies( decoy_p, bad_sids, bad ) );
+		TEST_ASSERT( bad[0] == DecoyContactFolder::BAD_ENERGY && bad[1] == DecoyContactFolder::BAD_ENERGY );
+		// sequences with stop codons cannot be evaluated
+		vector<double> energies( lattice_folder.getNumStructures() );
+		TEST_ASSERT( !lattice_folder.getEnergies( Protein( string( gene_length/3, '*' ) ), &energies[0] ) );
+	}
+
+	void TEST_FUNCTION( shared_tables ) {
+		// one shared-memory segment and one file-backed table
+		stringstream lattice_name, decoy_name;
+		lattice_name << "/evoli-test-lattice-" << getpid();
+		decoy_name << "/tmp/evoli-test-decoys-" << getpid();
+		SharedSegment::remove( lattice_name.str() );
+		SharedSegment::remove( decoy_name.str() );
+
+		// the first folder builds the table, the second one attaches to it
+		CompactLatticeFolder private_lattice(side_length);
+		CompactLatticeFolder creating_lattice(side_length, 0, -1, 0.6, lattice_name.str());
+		CompactLatticeFolder attached_lattice(side_length, 0, -1, 0.6, lattice_name.str());
+		TEST_ASSERT( attached_lattice.good() );
+		TEST_ASSERT( attached_lattice.getNumStructures() == private_lattice.getNumStructures() );
+		for ( int i=0; i<20; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(gene_length).translate();
+			auto_ptr<FoldInfo> fi( private_lattice.fold( p ) );
+			auto_ptr<FoldInfo> fi2( attached_lattice.fold( p ) );
+			TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+			TEST_ASSERT( fi->getDeltaG() == fi2->getDeltaG() );
+		}
+		stringstream drawing, drawing2;
+		private_lattice.printStructure( 17, drawing, "" );
+		attached_lattice.printStructure( 17, drawing2, "" );
+		TEST_ASSERT( drawing.str() == drawing2.str() );
+		// attached folders build their structures from the shared table
+		LatticeStructure* structure = attached_lattice.getStructure( 17 );
+		TEST_ASSERT( structure != 0 && structure == attached_lattice.getStructure( 17 ) );
+		TEST_ASSERT( strcmp( structure->getStructure(), private_lattice.getStructure( 17 )->getStructure() ) == 0 );
+		TEST_ASSERT( structure->getContacts() == private_lattice.getStructure( 17 )->getContacts() );
+		TEST_ASSERT( attached_lattice.getStructure( attached_lattice.getNumStructures() ) == 0 );
+
+		int protein_length = 300;
+		double log_nconf = 160.0*log(10.0);
+		string dir = "test/data/williams_contact_maps/";
+		ifstream fin( (dir + "maps.txt").c_str() );
+		ifstream fin2( (dir + "maps.txt").c_str() );
+		DecoyContactFolder private_decoys(protein_length, log_nconf, fin, dir);
+		DecoyContactFolder creating_decoys(protein_length, log_nconf, fin2, dir, 0., -1, 0.6, decoy_name.str());
+		ifstream empty; // the attached folder doesn't read any maps
+		DecoyContactFolder attached_decoys(protein_length, log_nconf, empty, dir, 0., -1, 0.6, decoy_name.str());
+		TEST_ASSERT( attached_decoys.good() );
+		TEST_ASSERT( attached_decoys.getNumStructures() == private_decoys.getNumStructures() );
+		for ( int i=0; i<5; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+			auto_ptr<FoldInfo> fi( private_decoys.fold( p ) );
+			auto_ptr<FoldInfo> fi2( attached_decoys.fold( p ) );
+			TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+			TEST_ASSERT( fi->getDeltaG() == fi2->getDeltaG() );
+		}
+
+		SharedSegment::remove( lattice_name.str() );
+		SharedSegment::remove( decoy_name.str() );
+
+		// a segment whose creator exited before publishing it is replaced at once
+		pid_t pid = fork();
+		if ( pid == 0 ) {
+			SharedSegment orphan;
+			_exit( orphan.create( lattice_name.str() ) ? 0 : 1 );
+		}
+		int status;
+		TEST_ASSERT( waitpid( pid, &status, 0 ) == pid && WIFEXITED( status ) && WEXITSTATUS( status ) == 0 );
+		SharedSegment stale;
+		TEST_ASSERT( !stale.attach( lattice_name.str(), 5. ) );
+		CompactLatticeFolder rebuilt_lattice(side_length, 0, -1, 0.6, lattice_name.str());
+		TEST_ASSERT( rebuilt_lattice.good() );
+		TEST_ASSERT( rebuilt_lattice.getNumStructures() == private_lattice.getNumStructures() );
+		SharedSegment published;
+		TEST_ASSERT( published.attach( lattice_name.str(), 0. ) );
+		SharedSegment::remove( lattice_name.str() );
+	}
+
+	void TEST_FUNCTION( multi_temperature ) {
+		vector<double> kTs;
+		kTs.push_back( 0.3 );
+		kTs.push_back( 0.6 );
+		kTs.push_back( 1.2 );
+		vector<double> dGs;
+
+		// each temperature must agree with a folder created at that temperature
+		for ( unsigned int t=0; t<kTs.size(); t++ ) {
+			CompactLatticeFolder folder(side_length, 0, -1, kTs[t]);
+			for ( int i=0; i<20; i++ ) {
+				Protein p = CodingDNA::createRandomNoStops(gene_length).translate();
+				auto_ptr<FoldInfo> fi( folder.fold( p ) );
+				StructureID sid = folder.foldAtTemperatures( p, kTs, dGs );
+				TEST_ASSERT( sid == fi->getStructure() );
+				TEST_ASSERT( dGs.size() == kTs.size() );
+				TEST_ASSERT( fabs( dGs[t] - fi->getDeltaG() ) < 1e-8 );
+			}
+		}
+
+		int protein_length = 300;
+		double log_nconf = 160.0*log(10.0);
+		string dir = "test/data/williams_contact_maps/";
+		for ( unsigned int t=0; t<kTs.size(); t++ ) {
+			ifstream fin( (dir + "maps.txt").c_str() );
+			DecoyContactFolder folder(protein_length, log_nconf, fin, dir, 0., -1, kTs[t]);
+			TEST_ASSERT( folder.good() );
+			for ( int i=0; i<5; i++ ) {
+				Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+				auto_ptr<FoldInfo> fi( folder.fold( p ) );
+				StructureID sid = folder.foldAtTemperatures( p, kTs, dGs );
+				TEST_ASSERT( sid == fi->getStructure() );
+				TEST_ASSERT( fabs( dGs[t] - fi->getDeltaG() ) < 1e-8 );
+			}
+		}
+
+		// sequences with stop codons cannot be folded
+		CompactLatticeFolder folder(side_length);
+		TEST_ASSERT( folder.foldAtTemperatures( Protein( string( gene_length/3, '*' ) ), kTs, dGs ) == -1 );
+		TEST_ASSERT( dGs[0] == 9999 );
+	}
+
+	void TEST_FUNCTION( packed_contact_maps ) {
+		stringstream packed;
+		packed << "/tmp/evoli-test-packed-" << getpid();
+
+		int protein_length = 300;
+		double log_nconf = 160.0*log(10.0);
+		string dir = "test/data/williams_contact_maps/";
+		ifstream fin( (dir + "maps.txt").c_str() );
+		DecoyContactFolder text_folder(protein_length, log_nconf, fin, dir);
+		TEST_ASSERT( text_folder.writePackedMaps( packed.str() ) );
+
+		DecoyContactFolder packed_folder(protein_length, log_nconf, packed.str());
+		TEST_ASSERT( packed_folder.good() );
+		TEST_ASSERT( packed_folder.getNumStructures() == text_folder.getNumStructures() );
+		for ( int i=0; i<5; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+			auto_ptr<FoldInfo> fi( text_folder.fold( p ) );
+			auto_ptr<FoldInfo> fi2( packed_folder.fold( p ) );
+			TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+			TEST_ASSERT( fi->getDeltaG() == fi2->getDeltaG() );
+		}
+		// the packed maps only hold contacts within the protein length
+		DecoyContactFolder short_folder(protein_length/2, log_nconf, packed.str());
+		TEST_ASSERT( !short_folder.good() );
+		remove( packed.str().c_str() );
+
+		// text files are not packed maps
+		DecoyContactFolder bad_folder(protein_length, log_nconf, dir + "maps.txt");
+		TEST_ASSERT( !bad_folder.good() );
+	}
+
+	void TEST_FUNCTION( mutant_folding ) {
+		int protein_length = 300;
+		double log_nconf = 160.0*log(10.0);
+		string dir = "test/data/williams_contact_maps/";
+		ifstream fin( (dir + "maps.txt").c_str() );
+		DecoyContactFolder folder(protein_length, log_nconf, fin, dir);
+		for ( int i=0; i<5; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+			auto_ptr<DecoyParentEnergies> parent( folder.prepareMutants( p ) );
+			TEST_ASSERT( parent.get() != 0 );
+			for ( int j=0; j<50; j++ ) {
+				unsigned int site = Random::rint( protein_length );
+				Protein mutant = p;
+				mutant[site] = GeneticCodeUtil::AMINO_ACIDS[Random::rint( 20 )];
+				auto_ptr<DecoyFoldInfo> fi( folder.fold( mutant ) );
+				auto_ptr<DecoyFoldInfo> fi2( folder.foldMutant( parent.get(), mutant, site ) );
+				// the energies are updated from those of the parent, so they agree up to rounding
+				TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+				TEST_ASSERT( fi->foldIsStable() == fi2->foldIsStable() );
+				TEST_ASSERT( fabs( fi->getMinEnergy() - fi2->getMinEnergy() ) < 1e-9 );
+				TEST_ASSERT( fabs( fi->getDeltaG() - fi2->getDeltaG() ) < 1e-6 );
+				TEST_ASSERT( fabs( fi->getUnfoldedDeltaGMean() - fi2->getUnfoldedDeltaGMean() ) < 1e-9 );
+				TEST_ASSERT( fabs( fi->getUnfoldedDeltaGVariance() - fi2->getUnfoldedDeltaGVariance() ) < 1e-6 );
+			}
+			// a stop codon doesn't fold
+			auto_ptr<DecoyFoldInfo> fi( folder.foldMutant( *parent, 0, '*' ) );
+			TEST_ASSERT( fi->getStructure() == -1 );
+
+			// all mutants of a site at once give the same results as one by one
+			string new_aas = string( GeneticCodeUtil::AMINO_ACIDS, 20 ) + "*";
+			unsigned int sites[] = { 0, (unsigned int) i*protein_length/5, (unsigned int) protein_length-1 };
+			for ( int j=0; j<3; j++ ) {
+				unsigned int site = sites[j];
+				vector<FoldInfo*> fold_data;
+				folder.foldSiteMutants( parent.get(), p, site, new_aas, fold_data );
+				TEST_ASSERT( fold_data.size() == new_aas.size() );
+				for ( unsigned int k=0; k<new_aas.size(); k++ ) {
+					auto_ptr<DecoyFoldInfo> fi2( folder.foldMutant( *parent, site, new_aas[k] ) );
+					TEST_ASSERT( fold_data[k]->getStructure() == fi2->getStructure() );
+					TEST_ASSERT( fold_data[k]->getDeltaG() == fi2->getDeltaG() );
+					delete fold_data[k];
+				}
+			}
+		}
+
+		// mutants within the precision margin are folded exactly
+		folder.setPrecisionMargin( 1e10 );
+		Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+		auto_ptr<DecoyParentEnergies> parent( folder.prepareMutants( p ) );
+		for ( int j=0; j<20; j++ ) {
+			unsigned int site = Random::rint( protein_length );
+			Protein mutant = p;
+			mutant[site] = GeneticCodeUtil::AMINO_ACIDS[Random::rint( 20 )];
+			auto_ptr<DecoyFoldInfo> fi( folder.fold( mutant ) );
+			auto_ptr<DecoyFoldInfo> fi2( folder.foldMutant( parent.get(), mutant, site ) );
+			TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+			TEST_ASSERT( fi->getDeltaG() == fi2->getDeltaG() );
+			TEST_ASSERT( fi->getUnfoldedDeltaGVariance() == fi2->getUnfoldedDeltaGVariance() );
+		}
+
+		// folders without a mutant state fold mutants from scratch
+		CompactLatticeFolder lattice_folder(side_length);
+		p = Protein( side_length*side_length );
+		TEST_ASSERT( lattice_folder.prepareMutants( p ) == 0 );
+		p = Protein( "CSVMQGGKTVFQMPIIERVMQAYNI" );
+		vector<FoldInfo*> fold_data;
+		lattice_folder.foldSiteMutants( 0, p, 3, "ACDW", fold_data );
+		TEST_ASSERT( fold_data.size() == 4 );
+		for ( unsigned int k=0; k<fold_data.size(); k++ ) {
+			Protein mutant( p );
+			mutant[3] = string( "ACDW" )[k];
+			auto_ptr<FoldInfo> fi( lattice_folder.fold( mutant ) );
+			TEST_ASSERT( fold_data[k]->getStructure() == fi->getStructure() );
+			TEST_ASSERT( fold_data[k]->getDeltaG() == fi->getDeltaG() );
+			delete fold_data[k];
+		}
+	}
+
+	void TEST_FUNCTION( threaded_decoy_fold ) {
+		// enough random decoys for several chunks
+		int protein_length = 60;
+		vector<DecoyContactStructure*> structs;
+		for ( int i=0; i<1500; i++ ) {
+			vector<Contact> contacts;
+			for ( int j=0; j<protein_length; j++ ) {
+				int r1 = Random::rint( protein_length-3 );
+				contacts.push_back( Contact( r1, r1 + 3 + Random::rint( protein_length-3-r1 ) ) );
+			}
+			structs.push_back( new DecoyContactStructure( contacts ) );
+		}
+		DecoyContactFolder folder(protein_length, 160.0*log(10.0), structs);
+		TEST_ASSERT( structs.size() == 1500 );
+		TEST_ASSERT( folder.getNumThreads() == 1 );
+
+		vector<double> energies( folder.getNumStructures() );
+		for ( int i=0; i<10; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+			folder.setNumThreads( 1 );
+			auto_ptr<DecoyFoldInfo> fi( folder.fold( p ) );
+			folder.setNumThreads( 3 );
+			TEST_ASSERT( folder.getNumThreads() == 3 );
+			auto_ptr<DecoyFoldInfo> fi2( folder.fold( p ) );
+			// results don't depend on the number of threads
+			TEST_ASSERT( fi->getStructure() == fi2->getStructure() );
+			TEST_ASSERT( fi->getDeltaG() == fi2->getDeltaG() );
+			TEST_ASSERT( fi->getUnfoldedDeltaGVariance() == fi2->getUnfoldedDeltaGVariance() );
+			// the minimum over all chunks is found
+			folder.getEnergies( p, &energies[0] );
+			TEST_ASSERT( min_element( energies.begin(), energies.end() ) - energies.begin() == fi->getStructure() );
+		}
+	}
+
+	void TEST_FUNCTION( empty_decoys ) {
+		// every third decoy is empty, or has contacts only beyond the protein length
+		int protein_length = 60;
+		double log_nconf = 160.0*log(10.0);
+		vector<DecoyContactStructure*> structs;
+		for ( int i=0; i<300; i++ ) {
+			vector<Contact> contacts;
+			for ( int j=0; j<protein_length && i%3 != 0; j++ ) {
+				int r1 = Random::rint( protein_length-3 );
+				contacts.push_back( Contact( r1, r1 + 3 + Random::rint( protein_length-3-r1 ) ) );
+			}
+			if ( i%6 == 3 )
+				contacts.push_back( Contact( protein_length, protein_length+5 ) );
+			// a few residues are in contact with themselves
+			if ( i%6 == 1 )
+				contacts.push_back( Contact( i%protein_length, i%protein_length ) );
+			structs.push_back( new DecoyContactStructure( contacts ) );
+		}
+		DecoyContactFolder folder(protein_length, log_nconf, structs);
+		TEST_ASSERT( folder.getNumStructures() == 300 );
+
+		// fold() gives the result of summing all decoys in order, zeros included;
+		// in a protein of lysines only, the empty decoys have the lowest energy
+		vector<double> energies( folder.getNumStructures() );
+		for ( int i=0; i<6; i++ ) {
+			Protein p = i ? CodingDNA::createRandomNoStops(protein_length*3).translate() : Protein( string( protein_length, 'K' ) );
+			folder.getEnergies( p, &energies[0] );
+			double min_G = 1e50, second_G = 1e50, sum = 0, sum_sq = 0;
+			StructureID min_index = -1;
+			for ( unsigned int sid=0; sid<energies.size(); sid++ ) {
+				if ( energies[sid] < min_G ) {
+					second_G = min_G;
+					min_G = energies[sid];
+					min_index = sid;
+				}
+				else if ( energies[sid] < second_G )
+					second_G = energies[sid];
+				sum += energies[sid];
+				sum_sq += energies[sid]*energies[sid];
+			}
+			sum -= min_G;
+			sum_sq -= min_G*min_G;
+			unsigned int num_confs = energies.size() - 1;
+			double mean_G = sum/num_confs;
+			double var_G = (sum_sq - (sum*sum)/num_confs)/(num_confs-1.0);
+			double kT = folder.getkT();
+			auto_ptr<DecoyFoldInfo> fi( folder.fold( p ) );
+			TEST_ASSERT( fi->getStructure() == min_index );
+			TEST_ASSERT( fi->getMinEnergy() == min_G );
+			TEST_ASSERT( fi->getUnfoldedDeltaGMean() == mean_G );
+			TEST_ASSERT( fi->getUnfoldedDeltaGVariance() == var_G );
+			TEST_ASSERT( fi->getDeltaG() == min_G + (var_G - 2*kT*mean_G)/(2*kT) + kT*log_nconf );
+			if ( i == 0 )
+				TEST_ASSERT( min_index == 0 && min_G == 0 && second_G == 0 );
+
+			// mutants fold as fold() folds them, ties and self-contacts included
+			auto_ptr<DecoyParentEnergies> parent( folder.prepareMutants( p ) );
+			string new_aas = string( GeneticCodeUtil::AMINO_ACIDS, 20 );
+			for ( int site=0; site<protein_length; site+=7 ) {
+				vector<FoldInfo*> fold_data;
+				folder.foldSiteMutants( parent.get(), p, site, new_aas, fold_data );
+				for ( unsigned int k=0; k<new_aas.size(); k++ ) {
+					Protein mutant = p;
+					mutant[site] = new_aas[k];
+					auto_ptr<DecoyFoldInfo> fi2( folder.fold( mutant ) );
+					TEST_ASSERT( fold_data[k]->getStructure() == fi2->getStructure() );
+					TEST_ASSERT( fabs( fold_data[k]->getDeltaG() - fi2->getDeltaG() ) < 1e-6 );
+					delete fold_data[k];
+				}
+			}
+		}
+	}
+
+	void TEST_FUNCTION( threshold_fold ) {
+		// enough random decoys for several chunks
+		int protein_length = 60;
+		vector<DecoyContactStructure*> structs;
+		for ( int i=0; i<1500; i++ ) {
+			vector<Contact> contacts;
+			for ( int j=0; j<protein_length; j++ ) {
+				int r1 = Random::rint( protein_length-3 );
+				contacts.push_back( Contact( r1, r1 + 3 + Random::rint( protein_length-3-r1 ) ) );
+			}
+			structs.push_back( new DecoyContactStructure( contacts ) );
+		}
+		DecoyContactFolder folder(protein_length, 160.0*log(10.0), structs);
+
+		// the decisions are those of fold(), for structures in every chunk and
+		// cutoffs on both sides of the free energy
+		for ( int i=0; i<20; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops(protein_length*3).translate();
+			auto_ptr<DecoyFoldInfo> fi( folder.fold( p ) );
+			StructureID sids[] = { fi->getStructure(), 0, 700, 1499 };
+			double cutoffs[] = { fi->getDeltaG(), fi->getDeltaG() - 1e-6, fi->getDeltaG() + 1, fi->getDeltaG() - 5 };
+			for ( unsigned int threads=1; threads<=3; threads+=2 ) {
+				folder.setNumThreads( threads );
+				for ( int j=0; j<4; j++ )
+					for ( int k=0; k<4; k++ )
+						TEST_ASSERT( folder.foldsInto( p, sids[j], cutoffs[k] ) == ( fi->getStructure() == sids[j] && fi->getDeltaG() <= cutoffs[k] ) );
+			}
+			folder.setNumThreads( 1 );
+		}
+		TEST_ASSERT( !folder.foldsInto( CodingDNA::createRandomNoStops(protein_length*3).translate(), 1500, 1e6 ) );
+	}
+
+	void TEST_FUNCTION( parallel_map_loading ) {
+		string dir = "test/data/williams_contact_maps/";
+		vector<string> filenames;
+		TEST_ASSERT( ContactMapUtil::listContactMaps( dir, filenames ) );
+		TEST_ASSERT( filenames.size() == 47 );
+		for ( unsigned int i=1; i<filenames.size(); i++ )
+			TEST_ASSERT( filenames[i-1] < filenames[i] );
+
+		// the same maps in the same order, for any number of threads
+		vector<DecoyContactStructure*> structs1, structs3;
+		ContactMapLoadTimes times;
+		TEST_ASSERT( ContactMapUtil::readContactMapsFromDirectory( dir, structs1, 1 ) );
+		TEST_ASSERT( ContactMapUtil::readContactMapsFromDirectory( dir, structs3, 3, &times ) );
+		TEST_ASSERT( structs1.size() == filenames.size() );
+		TEST_ASSERT( structs3.size() == filenames.size() );
+		TEST_ASSERT( times.enumerate >= 0 && times.parse >= 0 );
+		for ( unsigned int i=0; i<structs1.size(); i++ ) {
+			TEST_ASSERT( structs1[i]->getContacts() == structs3[i]->getContacts() );
+			delete structs1[i];
+			delete structs3[i];
+		}
+		vector<DecoyContactStructure*> structs;
+		TEST_ASSERT( !ContactMapUtil::readContactMapsFromDirectory( "test/data/no_such_dir/", structs ) );
+		TEST_ASSERT( structs.empty() );
+
+		// a folder reading its list file with several threads folds like one reading with one
+		ifstream fin( ( dir + "maps.txt" ).c_str() );
+		DecoyContactFolder folder1( 300, 160.0*log(10.0), fin, dir );
+		fin.close();
+		ifstream fin3( ( dir + "maps.txt" ).c_str() );
+		DecoyContactFolder folder3( 300, 160.0*log(10.0), fin3, dir, 0., -1, 0.6, "", 3 );
+		fin3.close();
+		TEST_ASSERT( folder3.good() );
+		TEST_ASSERT( folder1.getNumStructures() == folder3.getNumStructures() );
+		TEST_ASSERT( folder3.getLoadTimes().parse >= 0 && folder3.getLoadTimes().build >= 0 );
+		for ( int i=0; i<5; i++ ) {
+			Protein p = CodingDNA::createRandomNoStops( 900 ).translate();
+			auto_ptr<DecoyFoldInfo> fi1( folder1.fold( p ) );
+			auto_ptr<DecoyFoldInfo> fi3( folder3.fold( p ) );
+			TEST_ASSERT( fi1->getStructure() == fi3->getStructure() );
+			TEST_ASSERT( fi1->getDeltaG() == fi3->getDeltaG() );
+		}
+	}
+
+	void TEST_FUNCTION( folder_factory ) {
+		FolderFactory factory;
+
+		// explicit choices
+		auto_ptr<CompactLatticeFolder> folder( factory.createLatticeFolder( side_length, 0, -1, 0.6, "", "double" ) );
+		TEST_ASSERT( folder->getBackend() == "double" );
+		TEST_ASSERT( factory.selectBackend( *folder, "no-such-backend" ) == "double" );
+
+		// automatic choice: the default backend
+		folder.reset( factory.createLatticeFolder( side_length ) );
+		TEST_ASSERT( folder->getBackend() == "double" );
+		TEST_ASSERT( factory.selectBackend( *folder ) == "double" );
+	}
+
 	bool getAminoAcidIndices(const Protein& p, vector<unsigned int>& aa_indices)
 	{
 		int index = 0;
@@ -219,8 +908,10 @@ struct TEST_CLASS( folder_basic )
 		  double sumsqG = 0.0;
 
 		  bool valid = getAminoAcidIndices(p, aa_indices);
+		  vector<double> energies( folder.getNumStructures() );
+		  folder.getEnergies( p, &energies[0] );
 		  for ( unsigned int sid = 0; sid < folder.getNumStructures(); sid++) {
-			double G = folder.getEnergy(p, sid);
+			double G = energies[sid];
 			// check if binding energy is lower than any previously calculated one
 			if ( G < minG ) {
 			  minG = G;
@@ -154,6 +154,63 @@ struct TEST_CLASS( population )
 		
 		TEST_ASSERT( pop.getAveFitness() > fitness );
 	}
+
+	void TEST_FUNCTION( fitness_schedule )
+	{
+		int N = 20;
+		CompactLatticeFolder folder( side_length );
+		Gene g( "AAAAAAAAGAGTCCTACCACCCTTGACCTCATGTCCTGTGCAGATAAT" );
+		auto_ptr<FoldInfo> fi( folder.fold( g.translate() ) );
+		ErrorproneTranslation fe( &folder, g.codonLength(), fi->getStructure(), 0, 1.0, 6.0, 0.01, 16, 16 );
+		double fitness = fe.getFitness( g );
+		// without mutations, the fitness changes only with the error rate
+		Population<Gene, ErrorproneTranslation, SimpleMutator>  pop( N );
+		SimpleMutator mut( 0 );
+		pop.init( g, &fe, &mut );
+
+		FitnessSchedule schedule;
+		schedule.addChange( FitnessSchedule::ERROR_RATE, 2, 0.05 );
+		vector<double> rates;
+		rates.push_back( 0.02 );
+		rates.push_back( 0.01 );
+		schedule.addPeriodicChange( FitnessSchedule::ERROR_RATE, 4, 2, rates );
+		pop.setFitnessSchedule( &schedule );
+
+		unsigned int epochs[] = { 0, 1, 1, 2, 2, 3, 3, 4 };
+		double errors[] = { 0.01, 0.05, 0.05, 0.02, 0.02, 0.01, 0.01, 0.02 };
+		for ( int t=0; t<8; t++ ) {
+			pop.evolve();
+			TEST_ASSERT( fe.getEpoch() == epochs[t] );
+			TEST_ASSERT( fe.getErrorRate() == errors[t] );
+			TEST_ASSERT( (*pop.begin())->getEpoch() == epochs[t] );
+			TEST_ASSERT( fabs( pop.getAveFitness() - fe.getFitness( g ) ) < 1e-12 );
+		}
+		TEST_ASSERT( pop.getAveFitness() < fitness );
+
+		// a direct change takes effect with the next generation, or with updateFitness()
+		double ave_fitness = pop.getAveFitness();
+		fe.setErrorRate( 0.05 );
+		TEST_ASSERT( pop.getAveFitness() == ave_fitness );
+		pop.updateFitness();
+		TEST_ASSERT( pop.getAveFitness() < ave_fitness );
+		TEST_ASSERT( (*pop.begin())->getEpoch() == fe.getEpoch() );
+
+		// the fraction of accurate proteins of RobustnessOnlyTranslation follows the error rate
+		RobustnessOnlyTranslation rot( &folder, g.codonLength(), fi->getStructure(), 0, 1.0, 6.0, 0.01, 16, 16 );
+		fitness = rot.getFitness( g );
+		Population<Gene, RobustnessOnlyTranslation, SimpleMutator>  rot_pop( N );
+		rot_pop.init( g, &rot, &mut );
+		rot_pop.setFitnessSchedule( &schedule );
+		for ( int t=0; t<8; t++ ) {
+			rot_pop.evolve();
+			TEST_ASSERT( rot.getErrorRate() == errors[t] );
+			TEST_ASSERT( fabs( rot_pop.getAveFitness() - rot.getFitness( g ) ) < 1e-12 );
+			if ( errors[t] == 0.01 )
+				TEST_ASSERT( fabs( rot_pop.getAveFitness() - fitness ) < 1e-12 );
+			else
+				TEST_ASSERT( rot_pop.getAveFitness() < fitness );
+		}
+	}
 };
 
 
@@ -123,6 +123,30 @@ struct TEST_CLASS( random )
 		TEST_ASSERT( dpois_test_passed );
 	}
 
+	void TEST_FUNCTION( random_stream )
+	{
+		// streams are reproducible and don't touch the global generator
+		Random::seed( 4357U );
+		RandomStream a( 17, 3 ), b( 17, 3 ), c( 17, 4 ), d( 18, 3 );
+		bool same = true, differ_stream = false, differ_seed = false, in_range = true;
+		for( int i=0; i<1000; i++ )
+		{
+			uint x = a.rint();
+			same = same && ( x == b.rint() );
+			differ_stream = differ_stream || ( x != c.rint() );
+			differ_seed = differ_seed || ( x != d.rint() );
+			double u = a.runif();
+			in_range = in_range && ( u >= 0. && u < 1. ) && ( a.rint( 7 ) < 7 );
+			b.runif();
+			b.rint( 7 );
+		}
+		TEST_ASSERT( same );
+		TEST_ASSERT( differ_stream );
+		TEST_ASSERT( differ_seed );
+		TEST_ASSERT( in_range );
+		TEST_ASSERT( Random::rint() == 3510405877U );
+	}
+
 	void TEST_FUNCTION( dbinom )
 	{
 		// Binomial probabilities for n = 10 and p = .13:
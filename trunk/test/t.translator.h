@@ -40,7 +40,7 @@ public:
 	//									   const double nonPrefCodonPenalty, bool& truncated)
 
 	const vector<vector<pair<double, char> > >& getWeights() {
-		return m_cum_weight_matrix;
+		return m_translation_weights->getCumulativeWeights();
 	}
 	const double* getPrefCodons() {
 		return m_codon_cost;
@@ -68,6 +68,24 @@ struct TEST_CLASS( translator_basic )
 		TEST_ASSERT( p[0] == 'M' );
 		return;
 	}
+
+	void TEST_FUNCTION( shared_translation_weights )
+	{
+		CompactLatticeFolder folder(side_length);
+		TranslationTester t_tester(&folder);
+		TranslationTester t_tester2(&folder);
+		// all evaluators use the same tables
+		TEST_ASSERT( &t_tester.getWeights() == &t_tester2.getWeights() );
+		TEST_ASSERT( &t_tester.getWeights() == &TranslationWeights::getShared()->getCumulativeWeights() );
+		const vector<vector<pair<double, char> > >& weights = t_tester.getWeights();
+		TEST_ASSERT( weights.size() == 64 );
+		for ( int c=0; c<64; c++ ) {
+			TEST_ASSERT( weights[c].size() == 21 );
+			TEST_ASSERT( fabs( weights[c][20].first - 1 ) < 1e-9 );
+			for ( int i=1; i<21; i++ )
+				TEST_ASSERT( weights[c][i].first >= weights[c][i-1].first );
+		}
+	}
 };
 
 #endif